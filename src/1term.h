@@ -36,11 +36,13 @@
 // Global settings
 extern gboolean transparency_enabled;
 extern gboolean scrollback_enabled;
+extern gboolean session_logging_enabled;
 extern GtkCssProvider* css_provider;
 
 // Function declarations
 void update_transparency_all(void);
 void update_scrollback_all(void);
+void update_session_logging_all(void);
 void update_css_transparency(void);
 
 #endif  // ONETERM_H
\ No newline at end of file
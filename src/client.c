@@ -0,0 +1,96 @@
+#include "config.h"
+
+#include <gio/gio.h>
+
+// 1term-client: hands its command line to a resident `1term --server` over
+// D-Bus and exits with the server's answer. It only links GIO and never
+// initializes GTK, so opening a window costs a D-Bus round trip; the server
+// keeps the fonts, CSS and VTE state warm for every window.
+
+#define SERVER_START_TIMEOUT_MS 5000
+#define SERVER_POLL_MS 20
+
+static void print_usage(const char* argv0) {
+    g_print("Usage: %s [--tab] [--cwd=DIR] [-e COMMAND [ARG...]]\n", argv0);
+    g_print("Opens a window (or with --tab, a tab in the active window) in a running `1term --server`,\n");
+    g_print("starting one if needed. The new shell runs in the current directory unless --cwd is given.\n");
+}
+
+static gboolean server_running(GDBusConnection* bus) {
+    GVariant* reply = g_dbus_connection_call_sync(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                  "org.freedesktop.DBus", "NameHasOwner",
+                                                  g_variant_new("(s)", ONETERM_APP_ID), G_VARIANT_TYPE("(b)"),
+                                                  G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+    gboolean running = FALSE;
+    if (reply) {
+        g_variant_get(reply, "(b)", &running);
+        g_variant_unref(reply);
+    }
+    return running;
+}
+
+// The 1term installed (or built) next to this client, so a client never starts another version's server
+static gchar* server_binary(void) {
+    gchar* self = g_file_read_link("/proc/self/exe", NULL);
+    if (!self)
+        return NULL;
+    gchar* dir = g_path_get_dirname(self);
+    gchar* path = g_build_filename(dir, "1term", NULL);
+    g_free(dir);
+    g_free(self);
+    if (!g_file_test(path, G_FILE_TEST_IS_EXECUTABLE))
+        g_clear_pointer(&path, g_free);
+    return path;
+}
+
+static gboolean start_server(GDBusConnection* bus) {
+    gchar* binary = server_binary();
+    char* argv[] = {binary ? binary : "1term", "--server", NULL};
+    GSpawnFlags flags = G_SPAWN_STDOUT_TO_DEV_NULL | (binary ? 0 : G_SPAWN_SEARCH_PATH);
+    GError* err = NULL;
+    gboolean spawned = g_spawn_async(NULL, argv, NULL, flags, NULL, NULL, NULL, &err);
+    g_free(binary);
+    if (!spawned) {
+        g_printerr("1term-client: cannot start 1term --server: %s\n", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+    for (int waited = 0; waited < SERVER_START_TIMEOUT_MS; waited += SERVER_POLL_MS) {
+        if (server_running(bus))
+            return TRUE;
+        g_usleep(SERVER_POLL_MS * 1000);
+    }
+    g_printerr("1term-client: 1term --server did not come up within %d ms\n", SERVER_START_TIMEOUT_MS);
+    return FALSE;
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (g_str_equal(argv[i], "-e") || g_str_equal(argv[i], "--"))
+            break;
+        if (g_str_equal(argv[i], "--help") || g_str_equal(argv[i], "-h")) {
+            print_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    GError* err = NULL;
+    GDBusConnection* bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
+    if (!bus) {
+        g_printerr("1term-client: no session bus: %s\n", err->message);
+        g_clear_error(&err);
+        return 1;
+    }
+    if (!server_running(bus) && !start_server(bus)) {
+        g_object_unref(bus);
+        return 1;
+    }
+    g_object_unref(bus);
+
+    // a launcher never becomes the primary instance; run() forwards argv, the cwd and the environment
+    GApplication* app = g_application_new(
+        ONETERM_APP_ID, G_APPLICATION_IS_LAUNCHER | G_APPLICATION_HANDLES_COMMAND_LINE | G_APPLICATION_SEND_ENVIRONMENT);
+    int status = g_application_run(app, argc, argv);
+    g_object_unref(app);
+    return status;
+}
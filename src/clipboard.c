@@ -1,186 +1,758 @@
 #include "clipboard.h"
+#include "logmaint.h"
+#include "logz.h"
+#include "trace.h"
+#include "watchdog.h"
 
-static GThreadPool* compress_pool = NULL;
+// Rows pulled from VTE per chunk, and how long one idle step may keep reading
+// before yielding back to the main loop (well inside a 60 Hz frame).
+#define CAPTURE_ROWS_PER_CHUNK 2000
+#define CAPTURE_STEP_BUDGET_US 4000
 
+// Text read from VTE but not yet consumed by a worker, over all snapshots.
+// Above this, captures pause (the rows stay in VTE) and poll every
+// CAPTURE_THROTTLE_MS until the workers have caught up.
+#define CAPTURE_QUEUE_BUDGET (64 << 20)
+#define CAPTURE_THROTTLE_MS 20
+
+// Snapshot frames are bigger than session log frames so zstd can split each
+// one over several threads.
+#define SNAPSHOT_FRAME_SIZE (8 << 20)
+
+// Fast enough to keep up with reading; the log maintenance thread recompresses
+// snapshots tightly once the user is idle.
+#define SNAPSHOT_LEVEL 3
+
+#define CAPTURE_KEY "1term-capture"
+#define SNAPSHOT_CHAIN_KEY "1term-snapshot-chain"
+
+static GThreadPool* compress_pool = NULL;  // runs PoolTasks
+static gint running_jobs = 0;
+static gint queued_bytes = 0;
+
+// Pushed after the last chunk; the worker finalizes (EOF) or discards (ABORT) the file.
+static char capture_eof_marker;
+static char capture_abort_marker;
+#define CAPTURE_EOF ((gpointer)&capture_eof_marker)
+#define CAPTURE_ABORT ((gpointer)&capture_abort_marker)
+#define CAPTURE_IS_MARKER(p) ((p) == CAPTURE_EOF || (p) == CAPTURE_ABORT)
+
+// Captures still reading rows on the main thread (main thread only)
+static GList* active_captures = NULL;
+
+enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+// What the earlier snapshots of a tab archived, so the next one only reads the
+// rows after them. Shared with the jobs (atomic refcount): a job that fails
+// makes the next snapshot start over.
 typedef struct {
-    gchar* text;
+    glong next_row;  // first row not archived yet, -1 before the first snapshot
+    glong columns;   // width next_row was taken at; a reflow renumbers the rows
+    gchar* last_path;
+    gint failed;
+} SnapshotChain;
+
+// Shared by the capture and the worker (atomic refcount); whichever lets go last frees it.
+typedef struct {
+    GAsyncQueue* chunks;  // GBytes* in row order, terminated by CAPTURE_EOF
     gchar* path;
-    int lvl;
+    gchar* parent;  // snapshot this one continues, NULL for a full snapshot
+    SnapshotChain* chain;
+    gsize size_hint;  // upper bound on the text size
+    gint state;
+    CompressDoneFunc done;  // optional, with done_vt and done_data
+    VteTerminal* done_vt;   // a reference, released on the main thread
+    gpointer done_data;
 } CompressJob;
 
-static void compress_worker(gpointer data, gpointer unused) {
+typedef struct {
+    VteTerminal* vt;
+    CompressJob* job;
+    glong next_row;
+    glong end_row;
+    glong columns;
+    guint source_id;
+    gboolean throttled;  // polling on a timeout instead of running as an idle
+} CaptureState;
+
+// Work for the compress pool: snapshots, and batches from other background writers
+typedef struct {
+    GFunc func;
+    gpointer data;
+} PoolTask;
+
+static void snapshot_chain_clear(gpointer data) {
+    SnapshotChain* chain = data;
+    g_free(chain->last_path);
+}
+
+static void snapshot_chain_unref(gpointer data) {
+    g_atomic_rc_box_release_full(data, snapshot_chain_clear);
+}
+
+static void compress_job_clear(gpointer data) {
     CompressJob* j = data;
+    gpointer item;
+    while ((item = g_async_queue_try_pop(j->chunks)) != NULL) {
+        if (CAPTURE_IS_MARKER(item))
+            continue;
+        g_atomic_int_add(&queued_bytes, -(gint)g_bytes_get_size(item));
+        g_bytes_unref(item);
+    }
+    g_async_queue_unref(j->chunks);
+    g_free(j->path);
+    g_free(j->parent);
+    g_atomic_rc_box_release_full(j->chain, snapshot_chain_clear);
+}
 
-    ZSTD_CStream* zs = ZSTD_createCStream();
-    if (!zs)
-        goto done;
+static void compress_job_unref(CompressJob* j) {
+    g_atomic_rc_box_release_full(j, compress_job_clear);
+}
 
-    size_t zr = ZSTD_initCStream(zs, j->lvl);
-    if (ZSTD_isError(zr)) {
-        g_printerr("zstd init: %s\n", ZSTD_getErrorName(zr));
-        ZSTD_freeCStream(zs);
-        goto done;
+typedef struct {
+    CompressDoneFunc func;
+    VteTerminal* vt;
+    gpointer data;
+    gboolean ok;
+} CompressDone;
+
+static gboolean compress_done_idle(gpointer user_data) {
+    CompressDone* d = user_data;
+    d->func(d->vt, d->ok, d->data);
+    g_object_unref(d->vt);
+    g_free(d);
+    return G_SOURCE_REMOVE;
+}
+
+// Worker side: report the job's outcome to the main thread
+static void compress_job_notify(CompressJob* j, gboolean ok) {
+    if (!j->done)
+        return;
+    CompressDone* d = g_new(CompressDone, 1);
+    d->func = j->done;
+    d->vt = g_steal_pointer(&j->done_vt);
+    d->data = j->done_data;
+    d->ok = ok;
+    j->done = NULL;
+    g_idle_add(compress_done_idle, d);
+}
+
+static void pool_worker(gpointer data, gpointer unused) {
+    PoolTask* task = data;
+    task->func(task->data, NULL);
+    g_free(task);
+}
+
+static void compress_pool_init(void) {
+    if (!compress_pool) {
+        compress_pool = g_thread_pool_new(pool_worker, NULL, g_get_num_processors(), FALSE, NULL);
     }
+}
+
+// Run func(data, NULL) on the compress pool, e.g. to write a batch of a tab recording.
+void compress_pool_push(GFunc func, gpointer data) {
+    compress_pool_init();
+    PoolTask* task = g_new(PoolTask, 1);
+    task->func = func;
+    task->data = data;
+    g_thread_pool_push(compress_pool, task, NULL);
+}
+
+// Snapshots are compressed while they are read, so the level has to keep up:
+// huge ones or several at once drop to the fastest level, and the cores are
+// shared between the snapshots that are running.
+static void snapshot_options(LogzOptions* o, gsize size_hint, guint busy) {
+    guint cores = g_get_num_processors();
+
+    o->level = size_hint < (128 << 20) && busy == 0 ? SNAPSHOT_LEVEL : 1;
+    o->frame_size = SNAPSHOT_FRAME_SIZE;
+    o->n_workers = cores > 1 ? (int)MAX(1, cores / (busy + 1)) : 0;
+    o->long_distance = FALSE;
+    o->dict = logz_dict_get_current();
+    o->phase = trace_enabled ? trace_logz_phase : NULL;
+}
+
+static void compress_worker(gpointer data, gpointer unused) {
+    TRACE_SCOPE("compress_worker");
+    CompressJob* j = data;
+    gchar* tmpl = NULL;
+    LogzWriter* w = NULL;
+    gboolean ok = FALSE;
+
+    // other snapshots compressing now or waiting for a thread
+    guint busy = (guint)g_atomic_int_add(&running_jobs, 1) + g_thread_pool_unprocessed(compress_pool);
+    log_maintenance_hold();
+    LogzOptions opts;
+    snapshot_options(&opts, j->size_hint, busy);
+    opts.dedup_path = j->path;
+    g_atomic_int_set(&j->state, JOB_RUNNING);
 
     gchar* dir = g_path_get_dirname(j->path);
     if (g_mkdir_with_parents(dir, 0700) != 0) {
         g_printerr("mkdir %s: %s\n", dir, g_strerror(errno));
         g_free(dir);
-        ZSTD_freeCStream(zs);
         goto done;
     }
     g_free(dir);
 
-    gchar* tmpl = g_strdup_printf("%s.XXXXXX", j->path);
-    int tfd = g_mkstemp_full(tmpl, O_WRONLY | O_CLOEXEC, 0600);
+    tmpl = g_strdup_printf("%s.XXXXXX", j->path);
+    int tfd = g_mkstemp_full(tmpl, O_RDWR | O_CLOEXEC, 0600);
     if (tfd < 0) {
         g_printerr("mkstemp %s: %s\n", tmpl, g_strerror(errno));
-        g_free(tmpl);
-        ZSTD_freeCStream(zs);
-        goto done;
-    }
-    FILE* tf = fdopen(tfd, "wb");
-    if (!tf) {
-        g_printerr("fdopen: %s\n", g_strerror(errno));
-        close(tfd);
-        g_unlink(tmpl);
-        g_free(tmpl);
-        ZSTD_freeCStream(zs);
+        g_clear_pointer(&tmpl, g_free);
         goto done;
     }
+    w = logz_writer_new_full(tfd, tmpl, &opts);
+    if (!w)
+        goto fail;
+    logz_writer_set_parent(w, j->parent);
 
-    // zstd streaming loop
-    const size_t in_total = strlen(j->text);
-    ZSTD_inBuffer in = (ZSTD_inBuffer){j->text, in_total, 0};
-    unsigned char outbuf[1 << 15];  // 32 KiB chunk
-    ZSTD_outBuffer out = (ZSTD_outBuffer){outbuf, sizeof(outbuf), 0};
-
-    while (in.pos < in.size) {
-        out.pos = 0;
-        size_t ret = ZSTD_compressStream(zs, &out, &in);
-        if (ZSTD_isError(ret)) {
-            g_printerr("zstd write: %s\n", ZSTD_getErrorName(ret));
-            fclose(tf);
-            g_unlink(tmpl);
-            g_free(tmpl);
-            ZSTD_freeCStream(zs);
-            goto done;
-        }
-        if (out.pos && fwrite(out.dst, 1, out.pos, tf) != out.pos) {
-            g_printerr("fwrite: %s\n", g_strerror(errno));
-            fclose(tf);
-            g_unlink(tmpl);
-            g_free(tmpl);
-            ZSTD_freeCStream(zs);
-            goto done;
-        }
-    }
-
-    // flush remaining
+    // chunks arrive while the main thread is still capturing; the writer
+    // cuts them into independently compressed, indexed frames
     for (;;) {
-        out.pos = 0;
-        size_t ret = ZSTD_endStream(zs, &out);
-        if (ZSTD_isError(ret)) {
-            g_printerr("zstd end: %s\n", ZSTD_getErrorName(ret));
-            fclose(tf);
-            g_unlink(tmpl);
-            g_free(tmpl);
-            ZSTD_freeCStream(zs);
-            goto done;
-        }
-        if (out.pos && fwrite(out.dst, 1, out.pos, tf) != out.pos) {
-            g_printerr("fwrite: %s\n", g_strerror(errno));
-            fclose(tf);
-            g_unlink(tmpl);
-            g_free(tmpl);
-            ZSTD_freeCStream(zs);
-            goto done;
-        }
-        if (ret == 0)
+        gpointer item = g_async_queue_pop(j->chunks);
+        if (item == CAPTURE_EOF)
             break;
+        if (item == CAPTURE_ABORT)
+            goto fail;
+        gsize len = 0;
+        const void* text = g_bytes_get_data(item, &len);
+        gboolean ok = logz_writer_append(w, text, len);
+        g_bytes_unref(item);
+        g_atomic_int_add(&queued_bytes, -(gint)len);
+        if (!ok)
+            goto fail;
     }
 
-    fflush(tf);
-    fsync(fileno(tf));
-    fclose(tf);
+    gboolean closed = logz_writer_close(w, TRUE);
+    w = NULL;
+    if (!closed)
+        goto fail;
 
-    if (g_rename(tmpl, j->path) != 0) {
-        g_printerr("rename %s -> %s: %s\n", tmpl, j->path, g_strerror(errno));
-        g_unlink(tmpl);
-        g_free(tmpl);
-        ZSTD_freeCStream(zs);
-        goto done;
+    // link() fails rather than replace an archive that other ones may continue or reference
+    gint64 renaming = trace_now();
+    if (link(tmpl, j->path) != 0) {
+        g_printerr("link %s -> %s: %s\n", tmpl, j->path, g_strerror(errno));
+        goto fail;
     }
+    g_unlink(tmpl);
+    trace_complete("rename", renaming, trace_now(), -1);
 
-    g_print("Scroll-back compressed → %s\n", j->path);
+    if (j->parent)
+        g_print("Scroll-back compressed → %s (continues %s)\n", j->path, j->parent);
+    else
+        g_print("Scroll-back compressed → %s\n", j->path);
+    ok = TRUE;
+    goto done;
 
-    g_free(tmpl);
-    ZSTD_freeCStream(zs);
+fail:
+    if (w)
+        logz_writer_close(w, FALSE);
+    g_unlink(tmpl);
 
 done:
-    g_free(j->text);
-    g_free(j->path);
-    g_free(j);
+    g_free(tmpl);
+    if (!ok)
+        g_atomic_int_set(&j->chain->failed, TRUE);
+    g_atomic_int_set(&j->state, JOB_DONE);
+    compress_job_notify(j, ok);
+    compress_job_unref(j);
+    g_atomic_int_add(&running_jobs, -1);
+    log_maintenance_release();
 }
 
-static void compress_clipboard_text_ready(GObject* source_object, GAsyncResult* res, gpointer user_data) {
-    GdkClipboard* cb = GDK_CLIPBOARD(source_object);
-    VteTerminal* vt = VTE_TERMINAL(user_data);
-    GError* error = NULL;
-
-    char* text = gdk_clipboard_read_text_finish(cb, res, &error);
-    if (!text) {
-        if (error) {
-            g_printerr("clipboard read: %s\n", error->message);
-            g_clear_error(&error);
-        }
-        vte_terminal_unselect_all(vt);
-        g_object_unref(vt);
-        return;
-    }
-
-    // build destination path under ~/.1term/logs
+gchar* build_log_path(const char* name_fmt) {
+    // build destination path under ~/.1term/logs; name_fmt is a strftime() pattern
     gchar* dir = g_build_filename(g_get_home_dir(), ".1term", "logs", NULL);
     time_t now = time(NULL);
     struct tm tm_info;
     localtime_r(&now, &tm_info);
-    char timestr[64];
-    strftime(timestr, sizeof(timestr), "terminal_%Y%m%d_%H%M%S_%d.logz", &tm_info);
+    char timestr[128];
+    strftime(timestr, sizeof(timestr), name_fmt, &tm_info);
     gchar* path = g_build_filename(dir, timestr, NULL);
     g_free(dir);
+    return path;
+}
 
-    // dispatch compression to thread pool
-    CompressJob* job = g_new0(CompressJob, 1);
-    job->text = text;
-    job->path = path;
-    job->lvl = 15;
+// Unique per process and snapshot, like build_session_log_path(): other
+// archives name this one as their parent or as where their frames are.
+static gchar* build_snapshot_path(void) {
+    static guint snapshot_counter = 0;
+    gchar* fmt = g_strdup_printf("terminal_%%Y%%m%%d_%%H%%M%%S_%d-%u.logz", (int)getpid(), ++snapshot_counter);
+    gchar* path = build_log_path(fmt);
+    g_free(fmt);
+    return path;
+}
 
-    if (!compress_pool) {
-        compress_pool = g_thread_pool_new(compress_worker, NULL, g_get_num_processors(), FALSE, NULL);
+// Hand the worker its last marker and drop the capture (main thread).
+static void capture_finish(CaptureState* st, gpointer marker) {
+    if (marker == CAPTURE_EOF) {
+        // rows above the cursor are final; the cursor row is read again next time
+        SnapshotChain* chain = st->job->chain;
+        glong cursor_row = 0;
+        vte_terminal_get_cursor_position(st->vt, NULL, &cursor_row);
+        chain->next_row = MIN(st->end_row, cursor_row);
+        chain->columns = vte_terminal_get_column_count(st->vt) == st->columns ? st->columns : -1;
+        g_free(chain->last_path);
+        chain->last_path = g_strdup(st->job->path);
     }
-    g_thread_pool_push(compress_pool, job, NULL);
 
-    // optional UX cleanup
-    vte_terminal_unselect_all(vt);
+    active_captures = g_list_remove(active_captures, st);
+    g_object_set_data(G_OBJECT(st->vt), CAPTURE_KEY, NULL);
+    g_async_queue_push(st->job->chunks, marker);
+    compress_job_unref(st->job);
+    g_object_unref(st->vt);
+    g_free(st);
+}
 
-    g_object_unref(vt);
+static gboolean capture_step(gpointer user_data);
+
+static void capture_schedule(CaptureState* st, gboolean throttled) {
+    st->throttled = throttled;
+    if (throttled)
+        st->source_id = g_timeout_add(CAPTURE_THROTTLE_MS, capture_step, st);
+    else
+        st->source_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, capture_step, st, NULL);
 }
 
-void compress_scrollback_via_clipboard_async(VteTerminal* vt) {
-    GtkWidget* widget = GTK_WIDGET(vt);
-    GdkClipboard* cb = gtk_widget_get_clipboard(widget);
+static gboolean capture_over_budget(void) {
+    return g_atomic_int_get(&queued_bytes) >= CAPTURE_QUEUE_BUDGET;
+}
 
-    vte_terminal_select_all(vt);
-    vte_terminal_copy_clipboard_format(vt, VTE_FORMAT_TEXT);
+static gboolean capture_step(gpointer user_data) {
+    WATCHDOG_SCOPE("capture_step");
+    TRACE_SCOPE("capture_step");
+    CaptureState* st = user_data;
+    gint state = g_atomic_int_get(&st->job->state);
+    if (state == JOB_DONE) {
+        // the worker gave up (no log directory, disk full, ...)
+        capture_finish(st, CAPTURE_ABORT);
+        return G_SOURCE_REMOVE;
+    }
+
+    // Read only ahead of a worker that is consuming, and only while everything
+    // queued fits in the budget; a waiting job holds no text at all.
+    gboolean wait = state != JOB_RUNNING || capture_over_budget();
+    if (wait != st->throttled) {
+        capture_schedule(st, wait);
+        return G_SOURCE_REMOVE;
+    }
+    if (wait)
+        return G_SOURCE_CONTINUE;
+
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(st->vt));
+    gint64 deadline = g_get_monotonic_time() + CAPTURE_STEP_BUDGET_US;
+
+    // Output keeps flowing while we capture: rows may have been pushed out of
+    // the ring (skip them) or the terminal may have been reset (stop early).
+    glong first = (glong)gtk_adjustment_get_lower(adj);
+    glong last = (glong)gtk_adjustment_get_upper(adj);
+    if (st->next_row < first)
+        st->next_row = first;
+    if (st->end_row > last)
+        st->end_row = last;
+
+    while (st->next_row < st->end_row) {
+        glong stop = MIN(st->next_row + CAPTURE_ROWS_PER_CHUNK, st->end_row);
+        gsize len = 0;
+        char* text = vte_terminal_get_text_range_format(st->vt, VTE_FORMAT_TEXT, st->next_row, 0, stop, 0, &len);
+        st->next_row = stop;
+        if (text && len > 0) {
+            g_atomic_int_add(&queued_bytes, (gint)len);
+            g_async_queue_push(st->job->chunks, g_bytes_new_take(text, len));
+        }
+        else {
+            g_free(text);
+        }
+
+        if (g_get_monotonic_time() >= deadline || capture_over_budget())
+            return G_SOURCE_CONTINUE;
+    }
+
+    capture_finish(st, CAPTURE_EOF);
+    return G_SOURCE_REMOVE;
+}
+
+static CompressStatus compress_scrollback_start(VteTerminal* vt, CompressDoneFunc done, gpointer user_data) {
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+    SnapshotChain* chain = g_object_get_data(G_OBJECT(vt), SNAPSHOT_CHAIN_KEY);
+    if (!chain) {
+        chain = g_atomic_rc_box_new0(SnapshotChain);
+        chain->next_row = -1;
+        g_object_set_data_full(G_OBJECT(vt), SNAPSHOT_CHAIN_KEY, chain, snapshot_chain_unref);
+    }
+
+    // dispatch compression to thread pool; the worker consumes chunks as they are read
+    CompressJob* job = g_atomic_rc_box_new0(CompressJob);
+    job->chunks = g_async_queue_new();
+    job->path = build_snapshot_path();
+    job->chain = g_atomic_rc_box_acquire(chain);
+    job->state = JOB_QUEUED;
+    if (done) {
+        job->done = done;
+        job->done_vt = g_object_ref(vt);
+        job->done_data = user_data;
+    }
+
+    CaptureState* st = g_new0(CaptureState, 1);
+    st->vt = g_object_ref(vt);
+    st->job = g_atomic_rc_box_acquire(job);
+    st->next_row = (glong)gtk_adjustment_get_lower(adj);
+    st->end_row = (glong)gtk_adjustment_get_upper(adj);
+    st->columns = vte_terminal_get_column_count(vt);
 
-    g_object_ref(vt);
+    // Only read what the previous snapshot of this tab did not archive, unless it
+    // failed or the rows have been renumbered since (reflow, reset). Text that is
+    // archived again anyway is deduplicated by the writer.
+    gboolean incremental = chain->next_row >= 0 && !g_atomic_int_get(&chain->failed) &&
+                           chain->columns == st->columns && chain->next_row <= st->end_row;
+    if (incremental) {
+        st->next_row = MAX(st->next_row, chain->next_row);
+        job->parent = g_strdup(chain->last_path);
+    }
+    g_atomic_int_set(&chain->failed, FALSE);
+    job->size_hint = (gsize)(st->end_row - st->next_row) * (gsize)(vte_terminal_get_column_count(vt) + 1);
+
+    compress_pool_init();
+    gboolean busy = g_atomic_int_get(&running_jobs) >= (gint)g_thread_pool_get_max_threads(compress_pool) ||
+                    capture_over_budget();
+    compress_pool_push(compress_worker, job);
+
+    // read the scrollback in row ranges, yielding to the main loop between steps
+    g_object_set_data(G_OBJECT(vt), CAPTURE_KEY, st);
+    capture_schedule(st, TRUE);
+    active_captures = g_list_prepend(active_captures, st);
+    return busy ? COMPRESS_THROTTLED : COMPRESS_STARTED;
+}
+
+CompressStatus compress_scrollback_async(VteTerminal* vt) {
+    // a snapshot of this tab is still being read: let it run to the current end instead
+    CaptureState* st = g_object_get_data(G_OBJECT(vt), CAPTURE_KEY);
+    if (st) {
+        GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+        st->end_row = MAX(st->end_row, (glong)gtk_adjustment_get_upper(adj));
+        return COMPRESS_MERGED;
+    }
+    return compress_scrollback_start(vt, NULL, NULL);
+}
+
+// Snapshot vt and call done when it is on disk. FALSE, without calling done,
+// while a snapshot of vt is still being read.
+gboolean compress_scrollback_then(VteTerminal* vt, CompressDoneFunc done, gpointer user_data) {
+    if (g_object_get_data(G_OBJECT(vt), CAPTURE_KEY))
+        return FALSE;
+    compress_scrollback_start(vt, done, user_data);
+    return TRUE;
+}
+
+// First row not archived by vt's snapshots, or -1 if none is complete and still
+// numbered like the terminal's rows. Only meaningful from a done callback with ok set.
+glong compress_scrollback_archived_row(VteTerminal* vt) {
+    SnapshotChain* chain = g_object_get_data(G_OBJECT(vt), SNAPSHOT_CHAIN_KEY);
+    if (!chain || g_atomic_int_get(&chain->failed) || chain->columns != vte_terminal_get_column_count(vt))
+        return -1;
+    return chain->next_row;
+}
 
-    gdk_clipboard_read_text_async(cb, NULL, compress_clipboard_text_ready, vt);
+// The newest snapshot of vt; earlier ones are reached through its parents
+gchar* compress_scrollback_last_path(VteTerminal* vt) {
+    SnapshotChain* chain = g_object_get_data(G_OBJECT(vt), SNAPSHOT_CHAIN_KEY);
+    return chain ? g_strdup(chain->last_path) : NULL;
+}
+
+void compress_scrollback_cancel(VteTerminal* vt) {
+    CaptureState* st = g_object_get_data(G_OBJECT(vt), CAPTURE_KEY);
+    if (!st)
+        return;
+    g_source_remove(st->source_id);
+    capture_finish(st, CAPTURE_ABORT);
 }
 
 void free_compress_pool(void) {
+    // The main loop is gone, so unfinished captures will never reach EOF:
+    // release their workers before waiting on the pool.
+    while (active_captures) {
+        CaptureState* st = active_captures->data;
+        g_source_remove(st->source_id);
+        capture_finish(st, CAPTURE_ABORT);
+    }
     if (compress_pool) {
         g_thread_pool_free(compress_pool, TRUE, TRUE);
         compress_pool = NULL;
     }
-}
\ No newline at end of file
+}
+
+/* ── Copy on select ─────────────────────────────────────────────────────── */
+
+// A selection is published once it has been still for SELECTION_SETTLE_MS,
+// not on every drag step. Publishing only hands the clipboard a provider;
+// the text is read from VTE afterwards on the main loop, in one call for an
+// ordinary selection and in row chunks of at most CAPTURE_STEP_BUDGET_US for
+// select-all. Readers that ask earlier are answered when it is complete, and
+// the text is written to them asynchronously. It cannot wait for a reader:
+// VTE drops the selection on the next click.
+
+#define SELECTION_SETTLE_MS 150
+#define SELECTION_SETTLE_KEY "1term-selection-settle"
+#define SELECTION_MIME "text/plain;charset=utf-8"
+
+G_DECLARE_FINAL_TYPE(SelectionProvider, selection_provider, SELECTION, PROVIDER, GdkContentProvider)
+
+struct _SelectionProvider {
+    GdkContentProvider parent_instance;
+    GWeakRef vt;
+    gboolean whole_buffer;  // select-all: read rows [next_row, end_row)
+    glong next_row;
+    glong end_row;
+    GString* text;  // read so far
+    GBytes* done;   // the complete text
+    guint source_id;
+    GList* waiting;  // GTask* of reads that came before the text was complete
+};
+
+G_DEFINE_TYPE(SelectionProvider, selection_provider, GDK_TYPE_CONTENT_PROVIDER)
+
+typedef struct {
+    VteTerminal* vt;
+    guint source_id;
+} SelectionSettle;
+
+static void on_selection_written(GObject* stream, GAsyncResult* res, gpointer user_data) {
+    GTask* task = user_data;
+    GError* err = NULL;
+    if (g_output_stream_write_all_finish(G_OUTPUT_STREAM(stream), res, NULL, &err))
+        g_task_return_boolean(task, TRUE);
+    else
+        g_task_return_error(task, err);
+    g_object_unref(task);
+}
+
+static void selection_write(SelectionProvider* self, GTask* task) {
+    gsize len = 0;
+    const void* text = g_bytes_get_data(self->done, &len);
+    // the task keeps self, and so the text, alive until the write is done
+    g_output_stream_write_all_async(g_task_get_task_data(task), text, len, g_task_get_priority(task),
+                                    g_task_get_cancellable(task), on_selection_written, task);
+}
+
+// Read more of the text from VTE, until deadline (0: all of it); TRUE once complete.
+static gboolean selection_read(SelectionProvider* self, gint64 deadline) {
+    VteTerminal* vt = g_weak_ref_get(&self->vt);
+    if (!vt)
+        return TRUE;  // the tab is gone; keep what we have
+
+    if (!self->whole_buffer) {
+        gsize len = 0;
+        char* text = vte_terminal_get_text_selected_full(vt, VTE_FORMAT_TEXT, &len);
+        if (text)
+            g_string_append_len(self->text, text, (gssize)len);
+        g_free(text);
+        g_object_unref(vt);
+        return TRUE;
+    }
+
+    // rows may scroll out of the ring meanwhile, or the terminal may be reset
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+    self->next_row = MAX(self->next_row, (glong)gtk_adjustment_get_lower(adj));
+    self->end_row = MIN(self->end_row, (glong)gtk_adjustment_get_upper(adj));
+
+    while (self->next_row < self->end_row) {
+        glong stop = MIN(self->next_row + CAPTURE_ROWS_PER_CHUNK, self->end_row);
+        gsize len = 0;
+        char* text = vte_terminal_get_text_range_format(vt, VTE_FORMAT_TEXT, self->next_row, 0, stop, 0, &len);
+        if (text)
+            g_string_append_len(self->text, text, (gssize)len);
+        g_free(text);
+        self->next_row = stop;
+        if (deadline && g_get_monotonic_time() >= deadline)
+            break;
+    }
+
+    g_object_unref(vt);
+    return self->next_row >= self->end_row;
+}
+
+static void selection_complete(SelectionProvider* self) {
+    gsize len = self->text->len;
+    self->done = g_bytes_new_take(g_string_free(self->text, FALSE), len);
+    self->text = NULL;
+
+    GList* waiting = self->waiting;
+    self->waiting = NULL;
+    for (GList* l = waiting; l; l = l->next)
+        selection_write(self, l->data);
+    g_list_free(waiting);
+}
+
+static gboolean selection_step(gpointer user_data) {
+    WATCHDOG_SCOPE("selection_step");
+    TRACE_SCOPE("selection_step");
+    SelectionProvider* self = user_data;
+    if (!selection_read(self, g_get_monotonic_time() + CAPTURE_STEP_BUDGET_US))
+        return G_SOURCE_CONTINUE;
+    self->source_id = 0;
+    selection_complete(self);
+    return G_SOURCE_REMOVE;
+}
+
+// Finish reading now, for a reader that cannot wait.
+static void selection_finish_now(SelectionProvider* self) {
+    if (self->done)
+        return;
+    if (self->source_id) {
+        g_source_remove(self->source_id);
+        self->source_id = 0;
+    }
+    selection_read(self, 0);
+    selection_complete(self);
+}
+
+static GdkContentFormats* selection_ref_formats(GdkContentProvider* provider) {
+    GdkContentFormatsBuilder* b = gdk_content_formats_builder_new();
+    gdk_content_formats_builder_add_gtype(b, G_TYPE_STRING);
+    gdk_content_formats_builder_add_mime_type(b, SELECTION_MIME);
+    gdk_content_formats_builder_add_mime_type(b, "text/plain");
+    return gdk_content_formats_builder_free_to_formats(b);
+}
+
+static void selection_write_mime_type_async(GdkContentProvider* provider,
+                                            const char* mime_type,
+                                            GOutputStream* stream,
+                                            int io_priority,
+                                            GCancellable* cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data) {
+    SelectionProvider* self = SELECTION_PROVIDER(provider);
+    GTask* task = g_task_new(self, cancellable, callback, user_data);
+    g_task_set_priority(task, io_priority);
+    g_task_set_source_tag(task, selection_write_mime_type_async);
+
+    if (!g_str_equal(mime_type, SELECTION_MIME) && !g_str_equal(mime_type, "text/plain")) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Cannot provide %s", mime_type);
+        g_object_unref(task);
+        return;
+    }
+    g_task_set_task_data(task, g_object_ref(stream), g_object_unref);
+    if (self->done)
+        selection_write(self, task);
+    else
+        self->waiting = g_list_append(self->waiting, task);
+}
+
+static gboolean selection_write_mime_type_finish(GdkContentProvider* provider, GAsyncResult* res, GError** error) {
+    return g_task_propagate_boolean(G_TASK(res), error);
+}
+
+static gboolean selection_get_value(GdkContentProvider* provider, GValue* value, GError** error) {
+    SelectionProvider* self = SELECTION_PROVIDER(provider);
+    if (G_VALUE_HOLDS(value, G_TYPE_STRING)) {
+        selection_finish_now(self);
+        g_value_set_string(value, g_bytes_get_data(self->done, NULL));
+        return TRUE;
+    }
+    return GDK_CONTENT_PROVIDER_CLASS(selection_provider_parent_class)->get_value(provider, value, error);
+}
+
+// Replaced by newer content: stop reading unless someone is still waiting for the text.
+static void selection_detach_clipboard(GdkContentProvider* provider, GdkClipboard* clipboard) {
+    SelectionProvider* self = SELECTION_PROVIDER(provider);
+    if (self->source_id && !self->waiting) {
+        g_source_remove(self->source_id);
+        self->source_id = 0;
+    }
+}
+
+static void selection_provider_finalize(GObject* object) {
+    SelectionProvider* self = SELECTION_PROVIDER(object);
+    g_weak_ref_clear(&self->vt);
+    if (self->text)
+        g_string_free(self->text, TRUE);
+    g_clear_pointer(&self->done, g_bytes_unref);
+    G_OBJECT_CLASS(selection_provider_parent_class)->finalize(object);
+}
+
+static void selection_provider_class_init(SelectionProviderClass* klass) {
+    GdkContentProviderClass* provider_class = GDK_CONTENT_PROVIDER_CLASS(klass);
+    provider_class->ref_formats = selection_ref_formats;
+    provider_class->write_mime_type_async = selection_write_mime_type_async;
+    provider_class->write_mime_type_finish = selection_write_mime_type_finish;
+    provider_class->get_value = selection_get_value;
+    provider_class->detach_clipboard = selection_detach_clipboard;
+    G_OBJECT_CLASS(klass)->finalize = selection_provider_finalize;
+}
+
+static void selection_provider_init(SelectionProvider* self) {
+    g_weak_ref_init(&self->vt, NULL);
+    self->text = g_string_new(NULL);
+}
+
+static void selection_publish(VteTerminal* vt, gboolean whole_buffer) {
+    SelectionProvider* self = g_object_new(selection_provider_get_type(), NULL);
+    g_weak_ref_set(&self->vt, vt);
+    self->whole_buffer = whole_buffer;
+    if (whole_buffer) {
+        GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+        self->next_row = (glong)gtk_adjustment_get_lower(adj);
+        self->end_row = (glong)gtk_adjustment_get_upper(adj);
+    }
+    // the source keeps the provider alive while it reads
+    self->source_id =
+        g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, selection_step, g_object_ref(self), g_object_unref);
+
+    gdk_clipboard_set_content(gtk_widget_get_clipboard(GTK_WIDGET(vt)), GDK_CONTENT_PROVIDER(self));
+    g_object_unref(self);
+}
+
+static void selection_settle_free(gpointer data) {
+    SelectionSettle* s = data;
+    if (s->source_id)
+        g_source_remove(s->source_id);
+    g_free(s);
+}
+
+static gboolean selection_settled(gpointer user_data) {
+    WATCHDOG_SCOPE("selection_settled");
+    SelectionSettle* s = user_data;
+    s->source_id = 0;
+    if (vte_terminal_get_has_selection(s->vt))
+        selection_publish(s->vt, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+static SelectionSettle* selection_settle_get(VteTerminal* vt) {
+    SelectionSettle* s = g_object_get_data(G_OBJECT(vt), SELECTION_SETTLE_KEY);
+    if (!s) {
+        s = g_new0(SelectionSettle, 1);
+        s->vt = vt;
+        g_object_set_data_full(G_OBJECT(vt), SELECTION_SETTLE_KEY, s, selection_settle_free);
+    }
+    if (s->source_id) {
+        g_source_remove(s->source_id);
+        s->source_id = 0;
+    }
+    return s;
+}
+
+// Copy-on-select: (re)start the wait for the selection to settle.
+void clipboard_selection_changed(VteTerminal* vt) {
+    SelectionSettle* s = selection_settle_get(vt);
+    if (vte_terminal_get_has_selection(vt))
+        s->source_id = g_timeout_add(SELECTION_SETTLE_MS, selection_settled, s);
+}
+
+void clipboard_copy_selection(VteTerminal* vt) {
+    selection_settle_get(vt);
+    if (vte_terminal_get_has_selection(vt))
+        selection_publish(vt, FALSE);
+}
+
+// Select the whole scrollback and copy it, reading it in steps.
+void clipboard_copy_all(VteTerminal* vt) {
+    vte_terminal_select_all(vt);
+    selection_settle_get(vt);
+    selection_publish(vt, TRUE);
+}
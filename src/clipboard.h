@@ -5,7 +5,25 @@
 
 G_BEGIN_DECLS
 
-void compress_scrollback_via_clipboard_async(VteTerminal* vt);
+typedef enum {
+    COMPRESS_STARTED,    // a new snapshot is being read and compressed
+    COMPRESS_MERGED,     // this tab's snapshot in progress was extended to the current end
+    COMPRESS_THROTTLED,  // queued; reading waits for a free worker or memory budget
+} CompressStatus;
+
+// Called on the main thread once a snapshot is on disk (ok) or has failed
+typedef void (*CompressDoneFunc)(VteTerminal* vt, gboolean ok, gpointer user_data);
+
+CompressStatus compress_scrollback_async(VteTerminal* vt);
+gboolean compress_scrollback_then(VteTerminal* vt, CompressDoneFunc done, gpointer user_data);
+glong compress_scrollback_archived_row(VteTerminal* vt);
+gchar* compress_scrollback_last_path(VteTerminal* vt);
+void compress_scrollback_cancel(VteTerminal* vt);
+gchar* build_log_path(const char* name_fmt);
+void clipboard_selection_changed(VteTerminal* vt);
+void clipboard_copy_selection(VteTerminal* vt);
+void clipboard_copy_all(VteTerminal* vt);
+void compress_pool_push(GFunc func, gpointer data);
 void free_compress_pool(void);
 
 G_END_DECLS
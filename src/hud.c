@@ -0,0 +1,307 @@
+#include "hud.h"
+#include "latency.h"
+#include "tab.h"
+#include "watchdog.h"
+
+// Frame-timing and throughput overlay (Ctrl+Shift+H). Every frame the window's
+// GdkFrameClock paints is pushed into a ring: when the frame started, how long
+// GTK took to lay out and paint it, the gap since the previous frame and how
+// many rows the visible tab gained meanwhile, so a slow frame can be pinned on
+// a burst of output. Slots carry a sequence number written last, so a reader
+// on any thread can copy the ring without a lock and skip slots that were
+// being overwritten. Nothing is recorded while the HUD is hidden.
+
+#define HUD_KEY "1term-hud"
+#define HUD_TAB_KEY "1term-hud-tab"
+#define HUD_RING 1024  // power of two
+#define HUD_SPAN_US (2 * G_USEC_PER_SEC)
+#define HUD_REFRESH_MS 250
+#define HUD_IDLE_GAP_US (100 * 1000)  // a longer gap means the clock was idle, not late
+#define HUD_MAX_ROWS 2000             // rows read per refresh to measure bytes; the rest is extrapolated
+
+gboolean hud_enabled = FALSE;
+
+typedef struct {
+    gint seq;  // (index << 1) | 1 while being written, (index + 1) << 1 once complete
+    gint64 frame_time;
+    gint32 paint_us;     // frame start to end of paint
+    gint32 interval_us;  // since the previous frame; 0 after an idle gap
+    guint32 rows;        // rows the visible tab gained since the previous frame
+} HudFrame;
+
+typedef struct {
+    HudFrame frames[HUD_RING];
+    gint head;  // frames written so far
+} HudRing;
+
+typedef struct {
+    GtkWidget* window;
+    GtkNotebook* notebook;
+    GtkWidget* label;
+    GdkFrameClock* clock;
+    gulong paint_handler;
+    gulong realize_handler;
+    guint refresh_source;
+    gint64 last_frame;
+    VteTerminal* rows_tab;  // the tab rows_seen belongs to
+    glong rows_seen;
+    HudRing ring;
+} Hud;
+
+// Throughput of one tab, sampled at each refresh while it is visible
+typedef struct {
+    gint64 time;
+    glong row;
+    double rows_per_s;
+    double bytes_per_s;
+} HudTab;
+
+static void hud_ring_push(HudRing* ring, gint64 frame_time, gint64 paint_us, gint64 interval_us, glong rows) {
+    guint index = (guint)g_atomic_int_get(&ring->head);
+    HudFrame* f = &ring->frames[index & (HUD_RING - 1)];
+    g_atomic_int_set(&f->seq, (gint)((index << 1) | 1));
+    f->frame_time = frame_time;
+    f->paint_us = (gint32)MIN(paint_us, G_MAXINT32);
+    f->interval_us = (gint32)MIN(interval_us, G_MAXINT32);
+    f->rows = (guint32)CLAMP(rows, 0, G_MAXUINT32);
+    g_atomic_int_set(&f->seq, (gint)((index + 1) << 1));
+    g_atomic_int_set(&ring->head, (gint)(index + 1));
+}
+
+// Copy the frames that started at or after since, oldest first.
+static GArray* hud_ring_snapshot(HudRing* ring, gint64 since) {
+    GArray* out = g_array_new(FALSE, FALSE, sizeof(HudFrame));
+    guint head = (guint)g_atomic_int_get(&ring->head);
+    guint count = MIN(head, HUD_RING);
+    for (guint index = head - count; index != head; index++) {
+        HudFrame* f = &ring->frames[index & (HUD_RING - 1)];
+        gint seq = (gint)((index + 1) << 1);
+        if (g_atomic_int_get(&f->seq) != seq)
+            continue;
+        HudFrame copy = *f;
+        if (g_atomic_int_get(&f->seq) != seq || copy.frame_time < since)
+            continue;  // overwritten while we copied, or too old
+        g_array_append_val(out, copy);
+    }
+    return out;
+}
+
+static VteTerminal* hud_visible_terminal(Hud* hud) {
+    int current = gtk_notebook_get_current_page(hud->notebook);
+    return current >= 0 ? tab_page_get_terminal(gtk_notebook_get_nth_page(hud->notebook, current)) : NULL;
+}
+
+// VTE numbers rows from the start of the session, so the end of the buffer only grows with output
+static glong hud_row_end(VteTerminal* vt) {
+    return (glong)gtk_adjustment_get_upper(gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt)));
+}
+
+static void on_hud_after_paint(GdkFrameClock* clock, gpointer user_data) {
+    Hud* hud = user_data;
+    gint64 now = g_get_monotonic_time();
+    GdkFrameTimings* timings = gdk_frame_clock_get_current_timings(clock);
+    gint64 start = timings ? gdk_frame_timings_get_frame_time(timings) : gdk_frame_clock_get_frame_time(clock);
+    gint64 gap = start - hud->last_frame;
+    gint64 interval = hud->last_frame && gap < HUD_IDLE_GAP_US ? gap : 0;
+    hud->last_frame = start;
+
+    glong rows = 0;
+    VteTerminal* vt = hud_visible_terminal(hud);
+    if (vt) {
+        glong end = hud_row_end(vt);
+        rows = vt == hud->rows_tab ? MAX(end - hud->rows_seen, 0) : 0;
+        hud->rows_tab = vt;
+        hud->rows_seen = end;
+    }
+    hud_ring_push(&hud->ring, start, now - start, interval, rows);
+}
+
+// Rows and bytes per second of the visible tab since its last sample.
+static HudTab* hud_sample_tab(VteTerminal* vt) {
+    HudTab* tab = g_object_get_data(G_OBJECT(vt), HUD_TAB_KEY);
+    if (!tab) {
+        tab = g_new0(HudTab, 1);
+        g_object_set_data_full(G_OBJECT(vt), HUD_TAB_KEY, tab, g_free);
+    }
+
+    gint64 now = g_get_monotonic_time();
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+    glong first = (glong)gtk_adjustment_get_lower(adj);
+    glong end = (glong)gtk_adjustment_get_upper(adj);
+
+    // a tab that was in the background starts over instead of reporting its backlog
+    if (tab->time && now - tab->time <= 4 * HUD_REFRESH_MS * 1000 && end >= tab->row) {
+        double dt = (now - tab->time) / (double)G_USEC_PER_SEC;
+        glong rows = end - tab->row;
+        glong from = MAX(tab->row, first);
+        glong to = MIN(end, from + HUD_MAX_ROWS);
+        gsize len = 0;
+        if (to > from) {
+            char* text = vte_terminal_get_text_range_format(vt, VTE_FORMAT_TEXT, from, 0, to, 0, &len);
+            g_free(text);
+        }
+        double bytes = to > from ? (double)len * rows / (to - from) : 0;
+        tab->rows_per_s = rows / dt;
+        tab->bytes_per_s = bytes / dt;
+    }
+    else {
+        tab->rows_per_s = 0;
+        tab->bytes_per_s = 0;
+    }
+    tab->time = now;
+    tab->row = end;
+    return tab;
+}
+
+static gint compare_gint32(gconstpointer a, gconstpointer b) {
+    gint32 x = *(const gint32*)a, y = *(const gint32*)b;
+    return x < y ? -1 : x > y;
+}
+
+static gboolean hud_refresh(gpointer user_data) {
+    WATCHDOG_SCOPE("hud_refresh");
+    Hud* hud = user_data;
+    gint64 now = g_get_monotonic_time();
+    GArray* frames = hud_ring_snapshot(&hud->ring, now - HUD_SPAN_US);
+
+    gint64 refresh_us = 0;
+    if (hud->clock)
+        gdk_frame_clock_get_refresh_info(hud->clock, 0, &refresh_us, NULL);
+    if (refresh_us <= 0)
+        refresh_us = G_USEC_PER_SEC / 60;
+
+    GString* text = g_string_new(NULL);
+    if (frames->len > 0) {
+        gint32* paint = g_new(gint32, frames->len);
+        guint dropped = 0;
+        HudFrame* worst = NULL;
+        for (guint i = 0; i < frames->len; i++) {
+            HudFrame* f = &g_array_index(frames, HudFrame, i);
+            paint[i] = f->paint_us;
+            if (f->interval_us > refresh_us * 3 / 2)
+                dropped++;
+            if (!worst || f->paint_us > worst->paint_us)
+                worst = f;
+        }
+        qsort(paint, frames->len, sizeof(gint32), compare_gint32);
+        g_string_append_printf(text, "frame  p50 %.1f ms  p99 %.1f ms  max %.1f ms (+%u rows)\n",
+                               paint[frames->len / 2] / 1000.0, paint[frames->len * 99 / 100] / 1000.0,
+                               worst->paint_us / 1000.0, worst->rows);
+        g_string_append_printf(text, "       %u frames in %d s, %u late at %.0f Hz\n", frames->len,
+                               (int)(HUD_SPAN_US / G_USEC_PER_SEC), dropped, (double)G_USEC_PER_SEC / refresh_us);
+        g_free(paint);
+    }
+    else {
+        g_string_append(text, "frame  idle\n");
+    }
+
+    VteTerminal* vt = hud_visible_terminal(hud);
+    if (vt) {
+        HudTab* tab = hud_sample_tab(vt);
+        gchar* rate = g_format_size((guint64)tab->bytes_per_s);
+        g_string_append_printf(text, "output %s/s  %.0f rows/s", rate, tab->rows_per_s);
+        g_free(rate);
+    }
+
+    gchar* latency = latency_describe();
+    if (latency) {
+        g_string_append_printf(text, "\n%s", latency);
+        g_free(latency);
+    }
+
+    gtk_label_set_text(GTK_LABEL(hud->label), text->str);
+    g_string_free(text, TRUE);
+    g_array_free(frames, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+static void hud_stop(Hud* hud) {
+    if (hud->refresh_source) {
+        g_source_remove(hud->refresh_source);
+        hud->refresh_source = 0;
+    }
+    if (hud->clock) {
+        g_signal_handler_disconnect(hud->clock, hud->paint_handler);
+        g_clear_object(&hud->clock);
+        hud->paint_handler = 0;
+    }
+    if (hud->realize_handler) {
+        g_signal_handler_disconnect(hud->window, hud->realize_handler);
+        hud->realize_handler = 0;
+    }
+}
+
+static void on_hud_window_realize(GtkWidget* window, gpointer user_data);
+
+static void hud_start(Hud* hud) {
+    GdkFrameClock* clock = gtk_widget_get_frame_clock(hud->window);
+    if (!clock) {
+        // a new window: its clock exists once it is realized
+        if (!hud->realize_handler)
+            hud->realize_handler = g_signal_connect(hud->window, "realize", G_CALLBACK(on_hud_window_realize), hud);
+        return;
+    }
+    hud->clock = g_object_ref(clock);
+    hud->paint_handler = g_signal_connect(clock, "after-paint", G_CALLBACK(on_hud_after_paint), hud);
+    hud->last_frame = 0;
+    hud->rows_tab = NULL;
+    hud->refresh_source = g_timeout_add(HUD_REFRESH_MS, hud_refresh, hud);
+    hud_refresh(hud);
+}
+
+static void on_hud_window_realize(GtkWidget* window, gpointer user_data) {
+    Hud* hud = user_data;
+    g_signal_handler_disconnect(window, hud->realize_handler);
+    hud->realize_handler = 0;
+    if (hud_enabled)
+        hud_start(hud);
+}
+
+static void on_hud_window_unrealize(GtkWidget* window, gpointer user_data) {
+    Hud* hud = user_data;
+    hud_stop(hud);
+    if (hud_enabled)
+        hud->realize_handler = g_signal_connect(window, "realize", G_CALLBACK(on_hud_window_realize), hud);
+}
+
+static void hud_set_visible(Hud* hud, gboolean visible) {
+    gtk_widget_set_visible(hud->label, visible);
+    hud_stop(hud);
+    if (visible)
+        hud_start(hud);
+}
+
+static void hud_free(gpointer data) {
+    Hud* hud = data;
+    hud_stop(hud);
+    g_free(hud);
+}
+
+void hud_attach(GtkWidget* window, GtkNotebook* notebook, GtkOverlay* overlay) {
+    Hud* hud = g_new0(Hud, 1);
+    hud->window = window;
+    hud->notebook = notebook;
+
+    hud->label = gtk_label_new(NULL);
+    gtk_widget_add_css_class(hud->label, "hud");
+    gtk_widget_set_halign(hud->label, GTK_ALIGN_END);
+    gtk_widget_set_valign(hud->label, GTK_ALIGN_END);
+    gtk_widget_set_can_target(hud->label, FALSE);  // clicks go to the terminal underneath
+    gtk_label_set_xalign(GTK_LABEL(hud->label), 0);
+    gtk_overlay_add_overlay(overlay, hud->label);
+
+    g_signal_connect(window, "unrealize", G_CALLBACK(on_hud_window_unrealize), hud);
+    g_object_set_data_full(G_OBJECT(window), HUD_KEY, hud, hud_free);
+    hud_set_visible(hud, hud_enabled);
+}
+
+void hud_toggle_all(void) {
+    hud_enabled = !hud_enabled;
+    GList* toplevels = gtk_window_list_toplevels();
+    for (GList* l = toplevels; l; l = l->next) {
+        Hud* hud = g_object_get_data(G_OBJECT(l->data), HUD_KEY);
+        if (hud)
+            hud_set_visible(hud, hud_enabled);
+    }
+    g_list_free(toplevels);
+}
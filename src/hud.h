@@ -0,0 +1,15 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+extern gboolean hud_enabled;
+
+void hud_attach(GtkWidget* window, GtkNotebook* notebook, GtkOverlay* overlay);
+void hud_toggle_all(void);
+
+G_END_DECLS
+
+#endif  // HUD_H
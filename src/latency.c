@@ -0,0 +1,226 @@
+#include "latency.h"
+
+// Key-press-to-photon measurement (Ctrl+Shift+K or --latency). A capture-phase
+// key controller stamps each key before VTE sees it. The first
+// contents-changed after it is taken as the echo, the next after-paint of the
+// terminal's frame clock as the frame that shows it, and, where the compositor
+// reports it, that frame's presentation time as the photon. One key is
+// tracked at a time per terminal; keys typed before the previous one echoed
+// are not sampled, so measure by typing at a steady pace into an idle shell.
+
+#define LATENCY_KEY "1term-latency"
+#define LATENCY_BUCKET_US 250
+#define LATENCY_BUCKETS 1000  // 250 ms; slower samples go into the last bucket
+#define LATENCY_ECHO_TIMEOUT_MS 1000
+#define LATENCY_PRESENT_DELAY_MS 100  // presentation feedback arrives a frame or two later
+
+gboolean latency_enabled = FALSE;
+
+typedef struct {
+    guint64 buckets[LATENCY_BUCKETS];
+    guint64 n;
+    gint64 sum_us;
+    gint64 max_us;
+} LatencyHist;
+
+enum { LATENCY_ECHO, LATENCY_FRAME, LATENCY_PRESENT, LATENCY_N_STAGES };
+static const char* const stage_names[LATENCY_N_STAGES] = {"echo", "frame", "present"};
+static LatencyHist hists[LATENCY_N_STAGES];
+
+// Per terminal: the key waiting for its echo and frame
+typedef struct {
+    VteTerminal* vt;
+    gint64 key_time;
+    gint64 echo_time;
+    GdkFrameClock* clock;
+    gulong paint_handler;
+    guint timeout_id;
+} LatencyProbe;
+
+typedef struct {
+    GdkFrameClock* clock;
+    gint64 frame_counter;
+    gint64 key_time;
+} LatencyPresent;
+
+static void latency_record(int stage, gint64 us) {
+    LatencyHist* h = &hists[stage];
+    us = MAX(us, 0);
+    h->buckets[MIN(us / LATENCY_BUCKET_US, LATENCY_BUCKETS - 1)]++;
+    h->n++;
+    h->sum_us += us;
+    h->max_us = MAX(h->max_us, us);
+}
+
+static double latency_percentile(const LatencyHist* h, double p) {
+    guint64 want = (guint64)(p * (double)(h->n - 1)) + 1;
+    guint64 seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= want)
+            return (i + 0.5) * LATENCY_BUCKET_US / 1000.0;  // bucket midpoint, ms
+    }
+    return h->max_us / 1000.0;
+}
+
+static void latency_probe_reset(LatencyProbe* probe) {
+    probe->key_time = 0;
+    probe->echo_time = 0;
+    if (probe->paint_handler) {
+        g_signal_handler_disconnect(probe->clock, probe->paint_handler);
+        probe->paint_handler = 0;
+    }
+    g_clear_object(&probe->clock);
+    if (probe->timeout_id) {
+        g_source_remove(probe->timeout_id);
+        probe->timeout_id = 0;
+    }
+}
+
+static void latency_probe_free(gpointer data) {
+    LatencyProbe* probe = data;
+    latency_probe_reset(probe);
+    g_free(probe);
+}
+
+static gboolean on_present_check(gpointer user_data) {
+    LatencyPresent* present = user_data;
+    GdkFrameTimings* timings = gdk_frame_clock_get_timings(present->clock, present->frame_counter);
+    if (timings && gdk_frame_timings_get_complete(timings)) {
+        gint64 shown = gdk_frame_timings_get_presentation_time(timings);
+        if (shown > 0)
+            latency_record(LATENCY_PRESENT, shown - present->key_time);
+    }
+    g_object_unref(present->clock);
+    g_free(present);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_latency_after_paint(GdkFrameClock* clock, gpointer user_data) {
+    LatencyProbe* probe = user_data;
+    gint64 now = g_get_monotonic_time();
+    latency_record(LATENCY_ECHO, probe->echo_time - probe->key_time);
+    latency_record(LATENCY_FRAME, now - probe->key_time);
+
+    LatencyPresent* present = g_new0(LatencyPresent, 1);
+    present->clock = g_object_ref(clock);
+    present->frame_counter = gdk_frame_clock_get_frame_counter(clock);
+    present->key_time = probe->key_time;
+    g_timeout_add(LATENCY_PRESENT_DELAY_MS, on_present_check, present);
+
+    latency_probe_reset(probe);
+}
+
+static gboolean on_latency_timeout(gpointer user_data) {
+    LatencyProbe* probe = user_data;
+    probe->timeout_id = 0;  // no echo, e.g. a password prompt
+    latency_probe_reset(probe);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_latency_contents_changed(VteTerminal* vt, gpointer user_data) {
+    LatencyProbe* probe = user_data;
+    if (!probe->key_time || probe->echo_time)
+        return;
+    probe->echo_time = g_get_monotonic_time();
+    GdkFrameClock* clock = gtk_widget_get_frame_clock(GTK_WIDGET(vt));
+    if (!clock) {
+        latency_probe_reset(probe);
+        return;
+    }
+    probe->clock = g_object_ref(clock);
+    probe->paint_handler = g_signal_connect(clock, "after-paint", G_CALLBACK(on_latency_after_paint), probe);
+}
+
+static gboolean on_latency_key(GtkEventControllerKey* ctrl,
+                               guint keyval,
+                               guint keycode,
+                               GdkModifierType state,
+                               gpointer user_data) {
+    LatencyProbe* probe = user_data;
+    if (!latency_enabled || probe->key_time)
+        return FALSE;
+    // modifiers and 1term's own shortcuts never echo
+    GdkEvent* event = gtk_event_controller_get_current_event(GTK_EVENT_CONTROLLER(ctrl));
+    if ((event && gdk_key_event_is_modifier(event)) ||
+        (state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) == (GDK_CONTROL_MASK | GDK_SHIFT_MASK))
+        return FALSE;
+
+    probe->key_time = g_get_monotonic_time();
+    probe->timeout_id = g_timeout_add(LATENCY_ECHO_TIMEOUT_MS, on_latency_timeout, probe);
+    return FALSE;
+}
+
+void latency_watch_terminal(VteTerminal* vt) {
+    LatencyProbe* probe = g_new0(LatencyProbe, 1);
+    probe->vt = vt;
+    g_object_set_data_full(G_OBJECT(vt), LATENCY_KEY, probe, latency_probe_free);
+
+    // capture phase: stamped before VTE handles the key and writes it to the PTY
+    GtkEventController* keys = gtk_event_controller_key_new();
+    gtk_event_controller_set_propagation_phase(keys, GTK_PHASE_CAPTURE);
+    g_signal_connect(keys, "key-pressed", G_CALLBACK(on_latency_key), probe);
+    gtk_widget_add_controller(GTK_WIDGET(vt), keys);
+    g_signal_connect(vt, "contents-changed", G_CALLBACK(on_latency_contents_changed), probe);
+}
+
+// Print the histograms as JSON on stdout.
+void latency_dump(void) {
+    g_print("{\n  \"unit\": \"ms since key press\",\n  \"bucket_ms\": %.3f,\n", LATENCY_BUCKET_US / 1000.0);
+    for (int s = 0; s < LATENCY_N_STAGES; s++) {
+        const LatencyHist* h = &hists[s];
+        g_print("  \"%s\": {\"n\": %" G_GUINT64_FORMAT, stage_names[s], h->n);
+        if (h->n > 0) {
+            g_print(", \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"histogram\": {",
+                    h->sum_us / 1000.0 / h->n, latency_percentile(h, 0.5), latency_percentile(h, 0.9),
+                    latency_percentile(h, 0.99), h->max_us / 1000.0);
+            gboolean first = TRUE;
+            for (int i = 0; i < LATENCY_BUCKETS; i++) {
+                if (!h->buckets[i])
+                    continue;
+                g_print("%s\"%.2f\": %" G_GUINT64_FORMAT, first ? "" : ", ", i * LATENCY_BUCKET_US / 1000.0,
+                        h->buckets[i]);
+                first = FALSE;
+            }
+            g_print("}");
+        }
+        g_print("}%s\n", s + 1 < LATENCY_N_STAGES ? "," : "");
+    }
+    g_print("}\n");
+    fflush(stdout);
+}
+
+// Start with empty histograms, or stop and dump them.
+void latency_toggle(void) {
+    latency_enabled = !latency_enabled;
+    if (latency_enabled) {
+        memset(hists, 0, sizeof(hists));
+        g_print("Latency measurement on; type into an idle shell, Ctrl+Shift+K again for the results\n");
+    }
+    else {
+        latency_dump();
+    }
+}
+
+// At exit: results of a measurement still running, e.g. one started by --latency
+void latency_shutdown(void) {
+    if (latency_enabled)
+        latency_dump();
+}
+
+// One line for the HUD, or NULL when not measuring.
+gchar* latency_describe(void) {
+    if (!latency_enabled)
+        return NULL;
+    const LatencyHist* frame = &hists[LATENCY_FRAME];
+    const LatencyHist* present = &hists[LATENCY_PRESENT];
+    if (frame->n == 0)
+        return g_strdup("key→frame  no samples yet");
+    GString* line = g_string_new(NULL);
+    g_string_append_printf(line, "key→frame  p50 %.1f ms  p99 %.1f ms  (%" G_GUINT64_FORMAT " keys)",
+                           latency_percentile(frame, 0.5), latency_percentile(frame, 0.99), frame->n);
+    if (present->n > 0)
+        g_string_append_printf(line, "\nkey→photon p50 %.1f ms  p99 %.1f ms", latency_percentile(present, 0.5),
+                               latency_percentile(present, 0.99));
+    return g_string_free(line, FALSE);
+}
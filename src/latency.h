@@ -0,0 +1,18 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+extern gboolean latency_enabled;
+
+void latency_watch_terminal(VteTerminal* vt);
+void latency_toggle(void);
+void latency_dump(void);
+void latency_shutdown(void);
+gchar* latency_describe(void);
+
+G_END_DECLS
+
+#endif  // LATENCY_H
@@ -0,0 +1,349 @@
+#define _GNU_SOURCE  // syscall(), for per-thread priorities
+
+#include "logmaint.h"
+#include "logz.h"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+// Tiered storage for ~/.1term/logs. Snapshots are written at a fast level so
+// nobody waits for them; once nothing has been archived for LOG_MAINT_IDLE_S,
+// this thread recompresses every archive tightly, at the lowest CPU and I/O
+// priority, and deletes the oldest ones beyond the size and age limits. Any
+// new activity makes it stop at the next frame and wait for quiet again.
+
+#define LOG_MAINT_IDLE_S 60
+#define LOG_MAINT_LEVEL 19
+#define LOG_MAINT_MAX_BYTES (G_GUINT64_CONSTANT(2) << 30)
+#define LOG_MAINT_MAX_AGE_DAYS 180
+
+typedef struct {
+    gchar* name;
+    gchar* path;
+    guint64 size;
+    gint64 mtime;
+    gchar* parent;  // snapshot this one continues, NULL if none
+    gchar** refs;   // archives this one has frames in
+    gboolean compacted;
+    gboolean pinned;
+    gboolean doomed;
+} Archive;
+
+static GThread* maint_thread = NULL;
+static GAsyncQueue* maint_queue = NULL;
+static gint maint_cancel = 0;
+static gint maint_holds = 0;
+static GMutex maint_hold_lock;  // deletions against new holds
+static GMutex pins_lock;
+static GHashTable* pins = NULL;  // archive name -> GUINT_TO_POINTER(count)
+static char maint_kick_marker;
+static char maint_quit_marker;
+#define MAINT_KICK ((gpointer)&maint_kick_marker)
+#define MAINT_QUIT ((gpointer)&maint_quit_marker)
+
+static void archive_free(gpointer data) {
+    Archive* a = data;
+    g_free(a->name);
+    g_free(a->path);
+    g_free(a->parent);
+    g_strfreev(a->refs);
+    g_free(a);
+}
+
+static gint compare_mtime(gconstpointer pa, gconstpointer pb) {
+    const Archive* a = *(Archive* const*)pa;
+    const Archive* b = *(Archive* const*)pb;
+    return a->mtime < b->mtime ? -1 : a->mtime > b->mtime ? 1 : g_strcmp0(a->name, b->name);
+}
+
+// "512M", "2G" or a plain byte count; 0 means no limit.
+static guint64 env_bytes(const char* name, guint64 fallback) {
+    const char* value = g_getenv(name);
+    if (!value || !*value)
+        return fallback;
+    char* end = NULL;
+    guint64 n = g_ascii_strtoull(value, &end, 10);
+    switch (g_ascii_toupper(*end)) {
+        case 'K':
+            return n << 10;
+        case 'M':
+            return n << 20;
+        case 'G':
+            return n << 30;
+        default:
+            return n;
+    }
+}
+
+static gint64 env_days(const char* name, gint64 fallback) {
+    const char* value = g_getenv(name);
+    return value && *value ? (gint64)g_ascii_strtoll(value, NULL, 10) : fallback;
+}
+
+static void lower_priority(void) {
+#ifdef __linux__
+    // both apply to the calling thread only on Linux
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, (id_t)tid, 19);
+    syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, tid, 3 << 13 /* IOPRIO_CLASS_IDLE */);
+#endif
+}
+
+// Finished archives, oldest first; ones still being written are left out.
+static GPtrArray* list_archives(const char* dir) {
+    GPtrArray* list = g_ptr_array_new_with_free_func(archive_free);
+    GDir* d = g_dir_open(dir, 0, NULL);
+    if (!d)
+        return list;
+
+    const gchar* name;
+    while ((name = g_dir_read_name(d)) != NULL) {
+        if (!g_str_has_prefix(name, "terminal_") || !g_str_has_suffix(name, ".logz"))
+            continue;
+        gchar* path = g_build_filename(dir, name, NULL);
+        struct stat st;
+        LogzReader* r = NULL;
+        if (g_stat(path, &st) != 0 || logz_archive_is_busy(path) || !(r = logz_reader_open(path))) {
+            g_free(path);
+            continue;
+        }
+        Archive* a = g_new0(Archive, 1);
+        a->name = g_strdup(name);
+        a->path = path;
+        a->size = (guint64)st.st_size;
+        a->mtime = (gint64)st.st_mtime * G_USEC_PER_SEC;
+        gchar* parent = logz_reader_get_parent(r);
+        a->parent = parent ? g_path_get_basename(parent) : NULL;
+        g_free(parent);
+        a->refs = logz_reader_get_references(r);
+        a->compacted = logz_reader_is_compacted(r);
+        logz_reader_free(r);
+        g_ptr_array_add(list, a);
+    }
+    g_dir_close(d);
+    g_ptr_array_sort(list, compare_mtime);
+    return list;
+}
+
+static Archive* find_archive(GPtrArray* list, const char* name) {
+    for (guint i = 0; i < list->len; i++) {
+        Archive* a = g_ptr_array_index(list, i);
+        if (g_str_equal(a->name, name))
+            return a;
+    }
+    return NULL;
+}
+
+// Pinned archives, and every archive they continue or reference, directly or not.
+static void plan_pins(GPtrArray* list) {
+    GQueue todo = G_QUEUE_INIT;
+    g_mutex_lock(&pins_lock);
+    for (guint i = 0; i < list->len; i++) {
+        Archive* a = g_ptr_array_index(list, i);
+        if (pins && g_hash_table_contains(pins, a->name))
+            g_queue_push_tail(&todo, a);
+    }
+    g_mutex_unlock(&pins_lock);
+
+    Archive* a;
+    while ((a = g_queue_pop_head(&todo))) {
+        if (a->pinned)
+            continue;
+        a->pinned = TRUE;
+        Archive* parent = a->parent ? find_archive(list, a->parent) : NULL;
+        if (parent)
+            g_queue_push_tail(&todo, parent);
+        for (guint i = 0; a->refs[i]; i++) {
+            Archive* target = find_archive(list, a->refs[i]);
+            if (target)
+                g_queue_push_tail(&todo, target);
+        }
+    }
+}
+
+// Mark the oldest archives for deletion until the rest fit the limits.
+static void plan_retention(GPtrArray* list) {
+    guint64 max_bytes = env_bytes("ONETERM_LOG_MAX_BYTES", LOG_MAINT_MAX_BYTES);
+    gint64 max_age_us = env_days("ONETERM_LOG_MAX_AGE_DAYS", LOG_MAINT_MAX_AGE_DAYS) * 86400 * G_USEC_PER_SEC;
+    gint64 now = g_get_real_time();
+
+    guint64 total = 0;
+    for (guint i = 0; i < list->len; i++)
+        total += ((Archive*)g_ptr_array_index(list, i))->size;
+
+    for (guint i = 0; i < list->len; i++) {
+        Archive* a = g_ptr_array_index(list, i);
+        gboolean too_old = max_age_us > 0 && now - a->mtime > max_age_us;
+        gboolean too_big = max_bytes > 0 && total > max_bytes;
+        if (!too_old && !too_big)
+            break;
+        if (a->pinned)
+            continue;
+        a->doomed = TRUE;
+        total -= a->size;
+    }
+}
+
+// Doomed archives that a, if it survives, has frames in.
+static gchar** doomed_refs(GPtrArray* list, Archive* a) {
+    GPtrArray* names = g_ptr_array_new();
+    for (guint i = 0; a->refs[i]; i++) {
+        Archive* target = find_archive(list, a->refs[i]);
+        if (target && target->doomed)
+            g_ptr_array_add(names, g_strdup(target->name));
+    }
+    g_ptr_array_add(names, NULL);
+    return (gchar**)g_ptr_array_free(names, FALSE);
+}
+
+// One round of upkeep; FALSE if it was interrupted and should run again.
+static gboolean maint_pass(void) {
+    gchar* dir = g_build_filename(g_get_home_dir(), ".1term", "logs", NULL);
+    GPtrArray* list = list_archives(dir);
+    g_free(dir);
+    plan_pins(list);
+    plan_retention(list);
+
+    LogzOptions opts = {
+        .level = LOG_MAINT_LEVEL,
+        .long_distance = TRUE,
+        .dict = logz_dict_get_current(),
+    };
+    guint64 before = 0, after = 0;
+    guint recompressed = 0, deleted = 0;
+    gboolean can_delete = TRUE;
+
+    // survivors first, copying in the text they reference from doomed archives;
+    // if that fails for one of them nothing is deleted this time
+    for (guint i = 0; i < list->len && !g_atomic_int_get(&maint_cancel); i++) {
+        Archive* a = g_ptr_array_index(list, i);
+        if (a->doomed)
+            continue;
+        gchar** inline_names = doomed_refs(list, a);
+        if ((!a->compacted || inline_names[0]) &&
+            logz_archive_rewrite(a->path, &opts, (const char* const*)inline_names, &maint_cancel)) {
+            struct stat st;
+            before += a->size;
+            after += g_stat(a->path, &st) == 0 ? (guint64)st.st_size : a->size;
+            recompressed++;
+        }
+        else if (inline_names[0]) {
+            can_delete = FALSE;
+        }
+        g_strfreev(inline_names);
+    }
+
+    // A snapshot may reference any archive this process wrote. One that has
+    // begun holds off the rest; one that begins later finds none of them in
+    // the chunk store.
+    gboolean done = !g_atomic_int_get(&maint_cancel);
+    for (guint i = 0; i < list->len && done && can_delete; i++) {
+        Archive* a = g_ptr_array_index(list, i);
+        if (!a->doomed)
+            continue;
+        g_mutex_lock(&maint_hold_lock);
+        done = !g_atomic_int_get(&maint_cancel) && g_atomic_int_get(&maint_holds) == 0;
+        if (done) {
+            logz_chunk_store_forget(a->path);
+            if (g_unlink(a->path) == 0)
+                deleted++;
+            else
+                g_printerr("unlink %s: %s\n", a->path, g_strerror(errno));
+        }
+        g_mutex_unlock(&maint_hold_lock);
+    }
+
+    if (recompressed)
+        g_print("Log maintenance: recompressed %u archives, %" G_GUINT64_FORMAT " → %" G_GUINT64_FORMAT " bytes\n",
+                recompressed, before, after);
+    if (deleted)
+        g_print("Log maintenance: deleted %u archives past the size or age limit\n", deleted);
+    g_ptr_array_free(list, TRUE);
+    return done;
+}
+
+static gpointer maint_main(gpointer unused) {
+    lower_priority();
+    gboolean pending = TRUE;  // apply the limits once after startup
+    for (;;) {
+        gpointer item = g_async_queue_timeout_pop(maint_queue, LOG_MAINT_IDLE_S * G_USEC_PER_SEC);
+        if (item == MAINT_QUIT)
+            break;
+        if (item) {
+            pending = TRUE;
+            continue;
+        }
+        if (!pending || g_atomic_int_get(&maint_holds) > 0)
+            continue;
+
+        // a kick that got in before the reset is still in the queue
+        g_atomic_int_set(&maint_cancel, 0);
+        if (g_async_queue_length(maint_queue) > 0)
+            continue;
+        pending = !maint_pass();
+    }
+    return NULL;
+}
+
+void log_maintenance_start(void) {
+    if (maint_thread)
+        return;
+    if (!maint_queue)
+        maint_queue = g_async_queue_new();
+    maint_thread = g_thread_new("log-maintenance", maint_main, NULL);
+}
+
+// Something was just archived: stop what the thread is doing and restart the idle wait.
+void log_maintenance_kick(void) {
+    if (!maint_queue)
+        return;
+    g_async_queue_push(maint_queue, MAINT_KICK);
+    g_atomic_int_set(&maint_cancel, 1);
+}
+
+// Hold off maintenance for the duration of a snapshot, however long it takes.
+void log_maintenance_hold(void) {
+    g_mutex_lock(&maint_hold_lock);  // waits for a deletion in progress
+    g_atomic_int_inc(&maint_holds);
+    g_mutex_unlock(&maint_hold_lock);
+    log_maintenance_kick();
+}
+
+void log_maintenance_release(void) {
+    g_atomic_int_add(&maint_holds, -1);
+    log_maintenance_kick();
+}
+
+// Keep the archive at path, and everything it continues or references, from
+// retention, e.g. while a tab's dropped history exists only there.
+void log_maintenance_pin(const char* path) {
+    gchar* name = g_path_get_basename(path);
+    g_mutex_lock(&pins_lock);
+    if (!pins)
+        pins = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    guint count = GPOINTER_TO_UINT(g_hash_table_lookup(pins, name));
+    g_hash_table_insert(pins, name, GUINT_TO_POINTER(count + 1));
+    g_mutex_unlock(&pins_lock);
+}
+
+void log_maintenance_unpin(const char* path) {
+    gchar* name = g_path_get_basename(path);
+    g_mutex_lock(&pins_lock);
+    guint count = pins ? GPOINTER_TO_UINT(g_hash_table_lookup(pins, name)) : 0;
+    if (count > 1)
+        g_hash_table_insert(pins, g_strdup(name), GUINT_TO_POINTER(count - 1));
+    else if (count == 1)
+        g_hash_table_remove(pins, name);
+    g_mutex_unlock(&pins_lock);
+    g_free(name);
+}
+
+void log_maintenance_shutdown(void) {
+    if (!maint_thread)
+        return;
+    g_async_queue_push(maint_queue, MAINT_QUIT);
+    g_atomic_int_set(&maint_cancel, 1);
+    g_thread_join(maint_thread);
+    maint_thread = NULL;
+    // the queue stays: the session log writer may still kick it while it shuts down
+}
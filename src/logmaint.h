@@ -0,0 +1,18 @@
+#ifndef LOGMAINT_H
+#define LOGMAINT_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+void log_maintenance_start(void);
+void log_maintenance_kick(void);
+void log_maintenance_hold(void);
+void log_maintenance_release(void);
+void log_maintenance_pin(const char* path);
+void log_maintenance_unpin(const char* path);
+void log_maintenance_shutdown(void);
+
+G_END_DECLS
+
+#endif  // LOGMAINT_H
@@ -0,0 +1,543 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE  // memmem
+
+#include "config.h"
+#include "logz.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// 1term-logsearch: grep every terminal_*.logz under ~/.1term/logs in parallel.
+//
+// Work is split into (archive, frame) tasks. Each worker owns a deque: it pops
+// its own newest task and, when empty, steals the oldest task of another
+// worker. Opening an archive is a task too, so the frame tasks it produces
+// start out local to the worker that read the index. Results are printed by
+// the main thread in file/line order as soon as each frame is done.
+
+typedef enum {
+    TASK_OPEN,
+    TASK_FRAME,
+} TaskKind;
+
+typedef struct {
+    TaskKind kind;
+    guint file;
+    guint frame;
+} Task;
+
+typedef struct {
+    gchar* path;
+    LogzReader* reader;  // NULL until opened
+    guint n_frames;
+    gboolean opened;    // protected by results_lock
+    GString** results;  // per frame, NULL until searched
+    gboolean* done;
+} Archive;
+
+typedef struct {
+    GMutex lock;
+    GQueue tasks;  // Task*
+} Deque;
+
+static GRegex* regex = NULL;
+static gchar* literal = NULL;  // required substring, NULL if none
+static gsize literal_len = 0;
+static gboolean literal_only = FALSE;
+static gboolean ignore_case = FALSE;
+static gint64 since_us = 0;
+static gint64 until_us = G_MAXINT64;
+
+static Archive* archives = NULL;
+static guint n_archives = 0;
+static Deque* deques = NULL;
+static guint n_workers = 0;
+static gint pending = 0;  // tasks queued or running
+
+static GMutex idle_lock;
+static GCond idle_cond;
+
+static GMutex results_lock;
+static GCond results_cond;
+
+/* ── Pattern prefilter ──────────────────────────────────────────────────── */
+
+// Longest run of plain characters every match must contain, or NULL when there
+// is none or the pattern is too clever to tell (alternation, inline flags,
+// escapes that take arguments).
+static gchar* required_literal(const char* pat) {
+    if (strstr(pat, "(?"))
+        return NULL;
+
+    GString* best = g_string_new(NULL);
+    GString* run = g_string_new(NULL);
+    int depth = 0;
+    gboolean in_class = FALSE;
+    gboolean ok = TRUE;
+
+    for (const char* p = pat; *p && ok; p++) {
+        char c = *p;
+        gboolean plain = FALSE;
+        char lit = c;
+
+        if (in_class) {
+            if (c == '\\' && p[1])
+                p++;
+            else if (c == ']')
+                in_class = FALSE;
+        }
+        else if (c == '\\' && p[1]) {
+            p++;
+            if (!g_ascii_isalnum(*p)) {
+                plain = depth == 0;  // escaped punctuation is literal
+                lit = *p;
+            }
+            else if (!strchr("dDwWsSbBhHvVRAzZG", *p)) {
+                ok = FALSE;  // \x41, \p{..}, backreferences, ...
+            }
+        }
+        else if (c == '|') {
+            ok = depth > 0;
+        }
+        else if (c == '[') {
+            in_class = TRUE;
+        }
+        else if (c == '(') {
+            depth++;
+        }
+        else if (c == ')') {
+            depth--;
+        }
+        else if (c == '{') {
+            const char* close = strchr(p, '}');
+            p = close ? close : p + strlen(p) - 1;
+        }
+        else if (!strchr(".^$*+?}", c)) {
+            plain = depth == 0;
+        }
+
+        // a quantifier makes the preceding character optional, or lets it repeat
+        char next = *p ? p[1] : 0;
+        if (plain && (next == '*' || next == '?' || next == '{'))
+            plain = FALSE;
+
+        if (plain)
+            g_string_append_c(run, lit);
+        if (!plain || next == '+') {
+            if (run->len > best->len)
+                g_string_assign(best, run->str);
+            g_string_truncate(run, 0);
+        }
+    }
+    if (run->len > best->len)
+        g_string_assign(best, run->str);
+    g_string_free(run, TRUE);
+
+    if (!ok || best->len == 0) {
+        g_string_free(best, TRUE);
+        return NULL;
+    }
+    return g_string_free(best, FALSE);
+}
+
+// memmem() for ASCII case-insensitive needles: memchr() on both cases of the
+// first byte, then compare the rest.
+static const char* find_ci(const char* hay, gsize len, const char* needle, gsize nlen) {
+    char lo = g_ascii_tolower(needle[0]);
+    char up = g_ascii_toupper(needle[0]);
+    const char* end = hay + len;
+
+    while ((gsize)(end - hay) >= nlen) {
+        const char* a = memchr(hay, lo, (gsize)(end - hay) - nlen + 1);
+        const char* b = lo == up ? NULL : memchr(hay, up, (gsize)((a ? a : end - nlen + 1) - hay));
+        const char* p = b ? b : a;
+        if (!p)
+            return NULL;
+        if (g_ascii_strncasecmp(p + 1, needle + 1, nlen - 1) == 0)
+            return p;
+        hay = p + 1;
+    }
+    return NULL;
+}
+
+static const char* find_literal(const char* hay, gsize len) {
+    if (ignore_case)
+        return find_ci(hay, len, literal, literal_len);
+    return memmem(hay, len, literal, literal_len);
+}
+
+static gboolean line_matches(const char* line, gsize len) {
+    if (literal_only)
+        return TRUE;  // the prefilter hit is the match
+    return g_regex_match_full(regex, line, (gssize)len, 0, 0, NULL, NULL);
+}
+
+/* ── Searching ──────────────────────────────────────────────────────────── */
+
+static void format_time(gint64 time_us, char* buf, gsize size) {
+    GDateTime* dt = g_date_time_new_from_unix_local(time_us / G_USEC_PER_SEC);
+    gchar* s = dt ? g_date_time_format(dt, "%Y-%m-%dT%H:%M:%S") : NULL;
+    g_strlcpy(buf, s ? s : "?", size);
+    g_free(s);
+    if (dt)
+        g_date_time_unref(dt);
+}
+
+static void emit_line(GString* out, const Archive* a, guint64 line, const char* stamp, const char* text, gsize len) {
+    g_string_append_printf(out, "%s:%" G_GUINT64_FORMAT ":%s: ", a->path, line + 1, stamp);
+    g_string_append_len(out, text, (gssize)len);
+    g_string_append_c(out, '\n');
+}
+
+// Search one decompressed frame. With a required literal only the lines that
+// contain it are handed to the regex; the rest of the block is skipped by
+// memmem()/memchr(), which glibc implements with SIMD.
+static GString* search_frame(Archive* a, guint index) {
+    GString* out = g_string_new(NULL);
+    const LogzFrame* f = logz_reader_get_frame(a->reader, index);
+    GBytes* bytes = logz_reader_read_frame(a->reader, index);
+    if (!bytes)
+        return out;
+
+    gsize size = 0;
+    const char* data = g_bytes_get_data(bytes, &size);
+    const char* end = data + size;
+    const char* p = data;        // start of the next unsearched line
+    const char* counted = data;  // line numbers are known up to here
+    guint64 line = f->line;
+    char stamp[32];
+    format_time(f->time_us, stamp, sizeof(stamp));
+
+    while (p < end) {
+        if (literal) {
+            const char* hit = find_literal(p, (gsize)(end - p));
+            if (!hit)
+                break;
+            // back up to the start of the line holding the hit
+            const char* s = hit;
+            while (s > p && s[-1] != '\n')
+                s--;
+            p = s;
+        }
+        const char* nl = memchr(p, '\n', (gsize)(end - p));
+        const char* eol = nl ? nl : end;
+
+        if (line_matches(p, (gsize)(eol - p))) {
+            for (const char* c = counted; (c = memchr(c, '\n', (gsize)(p - c))) != NULL; c++)
+                line++;
+            counted = p;
+            emit_line(out, a, line, stamp, p, (gsize)(eol - p));
+        }
+        p = nl ? nl + 1 : end;
+    }
+
+    g_bytes_unref(bytes);
+    return out;
+}
+
+/* ── Work-stealing pool ─────────────────────────────────────────────────── */
+
+static void push_task(guint worker, TaskKind kind, guint file, guint frame) {
+    Task* t = g_new(Task, 1);
+    t->kind = kind;
+    t->file = file;
+    t->frame = frame;
+    g_atomic_int_inc(&pending);
+
+    Deque* d = &deques[worker];
+    g_mutex_lock(&d->lock);
+    g_queue_push_tail(&d->tasks, t);
+    g_mutex_unlock(&d->lock);
+
+    g_mutex_lock(&idle_lock);
+    g_cond_broadcast(&idle_cond);
+    g_mutex_unlock(&idle_lock);
+}
+
+static Task* take_task(guint self) {
+    Deque* d = &deques[self];
+    g_mutex_lock(&d->lock);
+    Task* t = g_queue_pop_tail(&d->tasks);
+    g_mutex_unlock(&d->lock);
+    if (t)
+        return t;
+
+    // steal the oldest task of another worker: it is the one furthest from
+    // what that worker is touching now
+    for (guint i = 1; i < n_workers && !t; i++) {
+        Deque* v = &deques[(self + i) % n_workers];
+        g_mutex_lock(&v->lock);
+        t = g_queue_pop_head(&v->tasks);
+        g_mutex_unlock(&v->lock);
+    }
+    return t;
+}
+
+static void frame_done(Archive* a, guint index, GString* result) {
+    g_mutex_lock(&results_lock);
+    a->results[index] = result;
+    a->done[index] = TRUE;
+    g_cond_broadcast(&results_cond);
+    g_mutex_unlock(&results_lock);
+}
+
+// Frame i covers [time_us(i), time_us(i + 1)).
+static gboolean frame_in_range(Archive* a, guint index) {
+    const LogzFrame* f = logz_reader_get_frame(a->reader, index);
+    if (f->time_us >= until_us)
+        return FALSE;
+    if (index + 1 < a->n_frames && logz_reader_get_frame(a->reader, index + 1)->time_us <= since_us)
+        return FALSE;
+    return TRUE;
+}
+
+static void run_open(guint self, guint file) {
+    Archive* a = &archives[file];
+    LogzReader* r = logz_reader_open(a->path);
+    guint n = r ? logz_reader_get_n_frames(r) : 0;
+
+    a->reader = r;
+    a->n_frames = n;
+    a->results = g_new0(GString*, MAX(n, 1));
+    a->done = g_new0(gboolean, MAX(n, 1));
+
+    // frames outside --since/--until are finished right away; the rest are
+    // pushed in reverse so this worker starts with the first one
+    for (guint i = 0; i < n; i++) {
+        if (!frame_in_range(a, i))
+            a->done[i] = TRUE;
+    }
+    for (guint i = n; i > 0; i--) {
+        if (!a->done[i - 1])
+            push_task(self, TASK_FRAME, file, i - 1);
+    }
+
+    g_mutex_lock(&results_lock);
+    a->opened = TRUE;
+    g_cond_broadcast(&results_cond);
+    g_mutex_unlock(&results_lock);
+}
+
+static gpointer worker_main(gpointer data) {
+    guint self = GPOINTER_TO_UINT(data);
+
+    for (;;) {
+        Task* t = take_task(self);
+        if (!t) {
+            if (g_atomic_int_get(&pending) == 0)
+                break;
+            // someone is still running a task that may push more
+            g_mutex_lock(&idle_lock);
+            g_cond_wait_until(&idle_cond, &idle_lock, g_get_monotonic_time() + G_TIME_SPAN_MILLISECOND);
+            g_mutex_unlock(&idle_lock);
+            continue;
+        }
+
+        if (t->kind == TASK_OPEN)
+            run_open(self, t->file);
+        else
+            frame_done(&archives[t->file], t->frame, search_frame(&archives[t->file], t->frame));
+        g_free(t);
+
+        if (g_atomic_int_dec_and_test(&pending)) {
+            g_mutex_lock(&idle_lock);
+            g_cond_broadcast(&idle_cond);
+            g_mutex_unlock(&idle_lock);
+        }
+    }
+    return NULL;
+}
+
+/* ── Output ─────────────────────────────────────────────────────────────── */
+
+// Print results in archive/frame order while the workers keep going.
+static gboolean print_results(void) {
+    gboolean matched = FALSE;
+
+    for (guint i = 0; i < n_archives; i++) {
+        Archive* a = &archives[i];
+        g_mutex_lock(&results_lock);
+        while (!a->opened)
+            g_cond_wait(&results_cond, &results_lock);
+        g_mutex_unlock(&results_lock);
+
+        for (guint j = 0; j < a->n_frames; j++) {
+            g_mutex_lock(&results_lock);
+            while (!a->done[j])
+                g_cond_wait(&results_cond, &results_lock);
+            GString* out = a->results[j];
+            a->results[j] = NULL;
+            g_mutex_unlock(&results_lock);
+
+            if (out && out->len > 0) {
+                fwrite(out->str, 1, out->len, stdout);
+                matched = TRUE;
+            }
+            if (out)
+                g_string_free(out, TRUE);
+        }
+        fflush(stdout);
+    }
+    return matched;
+}
+
+/* ── Main ───────────────────────────────────────────────────────────────── */
+
+static gint compare_paths(gconstpointer a, gconstpointer b) {
+    return g_strcmp0(*(const gchar* const*)a, *(const gchar* const*)b);
+}
+
+// terminal_*.logz under dir, oldest first (the names start with a timestamp).
+static GPtrArray* list_archives(const char* dir) {
+    GPtrArray* paths = g_ptr_array_new_with_free_func(g_free);
+    GError* err = NULL;
+    GDir* d = g_dir_open(dir, 0, &err);
+    if (!d) {
+        g_printerr("%s\n", err->message);
+        g_error_free(err);
+        return paths;
+    }
+    const gchar* name;
+    while ((name = g_dir_read_name(d)) != NULL) {
+        if (g_str_has_prefix(name, "terminal_") && g_str_has_suffix(name, ".logz"))
+            g_ptr_array_add(paths, g_build_filename(dir, name, NULL));
+    }
+    g_dir_close(d);
+    g_ptr_array_sort(paths, compare_paths);
+    return paths;
+}
+
+static gboolean parse_time(const char* s, gint64* out) {
+    GTimeZone* tz = g_time_zone_new_local();
+    GDateTime* dt = g_date_time_new_from_iso8601(s, tz);
+    if (!dt) {
+        // a bare date means midnight local time
+        gchar* full = g_strconcat(s, "T00:00:00", NULL);
+        dt = g_date_time_new_from_iso8601(full, tz);
+        g_free(full);
+    }
+    g_time_zone_unref(tz);
+    if (!dt)
+        return FALSE;
+    *out = g_date_time_to_unix(dt) * G_USEC_PER_SEC;
+    g_date_time_unref(dt);
+    return TRUE;
+}
+
+int main(int argc, char** argv) {
+    gboolean fixed = FALSE;
+    gboolean version = FALSE;
+    gint jobs = 0;
+    gchar* dir = NULL;
+    gchar* since = NULL;
+    gchar* until = NULL;
+    GOptionEntry entries[] = {
+        {"ignore-case", 'i', 0, G_OPTION_ARG_NONE, &ignore_case, "Ignore ASCII case distinctions", NULL},
+        {"fixed-strings", 'F', 0, G_OPTION_ARG_NONE, &fixed, "Treat PATTERN as a literal string", NULL},
+        {"jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Number of worker threads (default: all cores)", "N"},
+        {"dir", 'd', 0, G_OPTION_ARG_FILENAME, &dir, "Archive directory (default: ~/.1term/logs)", "DIR"},
+        {"since", 0, 0, G_OPTION_ARG_STRING, &since, "Skip frames written before TIME (ISO 8601)", "TIME"},
+        {"until", 0, 0, G_OPTION_ARG_STRING, &until, "Skip frames written at or after TIME", "TIME"},
+        {"version", 'V', 0, G_OPTION_ARG_NONE, &version, "Print version", NULL},
+        {NULL},
+    };
+
+    GError* err = NULL;
+    GOptionContext* ctx = g_option_context_new("PATTERN [FILE.logz...]");
+    g_option_context_set_summary(ctx, "Search 1term's compressed scrollback and session logs.");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        g_printerr("%s\n", err->message);
+        return 2;
+    }
+    if (version) {
+        g_print("1term-logsearch %s\n", ONETERM_VERSION);
+        return 0;
+    }
+    if (argc < 2) {
+        gchar* help = g_option_context_get_help(ctx, TRUE, NULL);
+        g_printerr("%s", help);
+        g_free(help);
+        return 2;
+    }
+    g_option_context_free(ctx);
+
+    if ((since && !parse_time(since, &since_us)) || (until && !parse_time(until, &until_us))) {
+        g_printerr("Invalid time: expected ISO 8601, e.g. 2024-05-01 or 2024-05-01T13:00:00\n");
+        return 2;
+    }
+
+    const char* pattern = argv[1];
+    if (fixed) {
+        literal = g_strdup(pattern);
+        literal_only = TRUE;
+    }
+    else {
+        GRegexCompileFlags flags = G_REGEX_OPTIMIZE | G_REGEX_RAW | (ignore_case ? G_REGEX_CASELESS : 0);
+        regex = g_regex_new(pattern, flags, 0, &err);
+        if (!regex) {
+            g_printerr("%s\n", err->message);
+            return 2;
+        }
+        literal = required_literal(pattern);
+    }
+    literal_len = literal ? strlen(literal) : 0;
+    if (literal_len == 0)
+        g_clear_pointer(&literal, g_free);
+    if (fixed && !literal) {
+        g_printerr("Empty pattern\n");
+        return 2;
+    }
+
+    GPtrArray* paths;
+    if (argc > 2) {
+        paths = g_ptr_array_new_with_free_func(g_free);
+        for (int i = 2; i < argc; i++)
+            g_ptr_array_add(paths, g_strdup(argv[i]));
+    }
+    else {
+        if (!dir)
+            dir = g_build_filename(g_get_home_dir(), ".1term", "logs", NULL);
+        paths = list_archives(dir);
+    }
+
+    n_archives = paths->len;
+    archives = g_new0(Archive, MAX(n_archives, 1));
+    for (guint i = 0; i < n_archives; i++)
+        archives[i].path = g_ptr_array_index(paths, i);
+
+    n_workers = jobs > 0 ? (guint)jobs : g_get_num_processors();
+    deques = g_new0(Deque, n_workers);
+    for (guint i = 0; i < n_workers; i++)
+        g_mutex_init(&deques[i].lock);
+    for (guint i = 0; i < n_archives; i++)
+        push_task(i % n_workers, TASK_OPEN, i, 0);
+
+    GThread** threads = g_new(GThread*, n_workers);
+    for (guint i = 0; i < n_workers; i++)
+        threads[i] = g_thread_new("logsearch", worker_main, GUINT_TO_POINTER(i));
+
+    gboolean matched = print_results();
+
+    for (guint i = 0; i < n_workers; i++)
+        g_thread_join(threads[i]);
+    g_free(threads);
+
+    for (guint i = 0; i < n_archives; i++) {
+        logz_reader_free(archives[i].reader);
+        g_free(archives[i].results);
+        g_free(archives[i].done);
+    }
+    for (guint i = 0; i < n_workers; i++)
+        g_mutex_clear(&deques[i].lock);
+    g_free(deques);
+    g_free(archives);
+    g_ptr_array_free(paths, TRUE);
+    g_clear_pointer(&regex, g_regex_unref);
+    g_free(literal);
+    g_free(dir);
+    g_free(since);
+    g_free(until);
+
+    return matched ? 0 : 1;
+}
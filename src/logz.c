@@ -0,0 +1,1281 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "logz.h"
+
+#include <glib/gstdio.h>
+#include <zstd.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// On-disk layout (all integers little-endian):
+//
+//   zstd frames, and index blocks between them (version 3)
+//   skippable frame header: u32 LOGZ_INDEX_MAGIC, u32 payload size
+//   K entries:              u64 line, u64 offset, u32 csize, u32 dsize, i64 time_us
+//   names (version 2):      NUL-terminated archive names, then u32 their total size
+//   link (version 3):       u64 offset of the previous index block (0: none), u32 K
+//   trailer:                u64 total lines, u32 N, u16 version, u16 LOGZ_FLAG_*,
+//                           u32 dictionary ID (0: none), u32 LOGZ_TRAILER_MAGIC
+//
+// The file always ends with an index block, rewritten after every frame, so a
+// file that is still growing (session logs) is complete up to its last frame.
+// That block only holds the entries since the previous block: once it has
+// LOGZ_BLOCK_ENTRIES, the next frame goes after it instead of over it, so a
+// frame costs at most one block of index I/O however long the archive grows.
+// Readers follow the links back; closing the writer replaces the chain with
+// a single block of all N entries (the older blocks stay behind as skippable
+// frames). Versions 1 and 2 have one block without a link.
+//
+// An entry with csize 0 is a reference: its text is frame (offset & 0xffffffff)
+// of the archive named by names[offset >> 32], in the same directory. names[0]
+// is the snapshot this one continues ("" if none).
+
+#define LOGZ_INDEX_MAGIC 0x184D2A5BU    // zstd skippable frame: ignored by zstd(1)
+#define LOGZ_TRAILER_MAGIC 0x5A4C5431U  // "1TLZ"
+#define LOGZ_VERSION 3
+#define LOGZ_SKIP_HEADER_SIZE 8
+#define LOGZ_ENTRY_SIZE 32
+#define LOGZ_LINK_SIZE 12
+#define LOGZ_TRAILER_SIZE 24
+#define LOGZ_BLOCK_ENTRIES 256
+
+#define LOGZ_FLAG_COMPACTED 0x1  // rewritten by logz_archive_rewrite()
+
+// Content-defined frames for deduplicating writers: a boundary is due once the
+// gear hash of the last 64 bytes has LOGZ_CDC_BITS zero bits (about every
+// 1 MiB), and is placed at the next newline. The same text therefore splits
+// into the same frames wherever it starts, as long as frames are not too small.
+#define LOGZ_CDC_BITS 20
+#define LOGZ_CDC_MIN (256 << 10)
+
+typedef struct {
+    guint8 hash[32];  // SHA-256 of the frame text
+    guint frame;
+} LogzChunk;
+
+typedef struct {
+    gchar* path;
+    guint64 ino;  // of the archive when the frame was written: path may be another file by now
+    guint frame;
+} LogzChunkRef;
+
+struct _LogzWriter {
+    int fd;
+    gchar* name;
+    LogzOptions opts;
+    guint8* buf;  // text of the frame being assembled
+    gsize fill;
+    gint64 buf_time;
+    GArray* frames;  // LogzFrame
+    guint64 lines;   // lines in closed frames
+    guint64 data_end;
+    guint16 flags;
+    guint64 ino;  // registered in writing_inodes
+    gboolean failed;
+    guint indexed;            // entries in index blocks that later frames went after
+    guint64 index_prev;       // offset of the newest such block, 0 if none
+    gboolean index_deferred;  // rewriting: one index at the end
+
+    // deduplication (opts.dedup_path set)
+    gchar* path;
+    gchar* dir;
+    GPtrArray* names;     // names[0] is the parent snapshot
+    GArray* new_chunks;   // LogzChunk, published to the chunk store on close
+    guint64 gear_hash;
+    gboolean cut_due;
+};
+
+struct _LogzReader {
+    int fd;
+    gchar* path;
+    GArray* frames;  // LogzFrame
+    guint64 n_lines;
+    gchar** names;  // version 2 only
+    guint32 dict_id;
+    guint16 flags;
+
+    GMutex refs_lock;
+    GHashTable* refs;  // name -> LogzReader*, archives that references point into
+};
+
+// Frames archived by this process, by content (SHA-256 -> LogzChunkRef)
+static GMutex store_lock;
+static GHashTable* chunk_store = NULL;
+
+static guint64 gear[256];
+
+// Files this process is writing. Other processes see the fcntl() lock every
+// writer holds, but a process cannot see its own locks that way.
+static GMutex writing_lock;
+static GHashTable* writing_inodes = NULL;  // guint64* st_ino -> itself
+
+// Compression state kept per thread and reused by every writer that runs on
+// it, so a snapshot job does not allocate a context and an output buffer, and
+// zstd's own worker threads survive from one frame to the next.
+typedef struct {
+    ZSTD_CCtx* cctx;
+    void* out;
+    gsize out_cap;
+} LogzCompressor;
+
+static void free_compressor(gpointer data) {
+    LogzCompressor* c = data;
+    ZSTD_freeCCtx(c->cctx);
+    g_free(c->out);
+    g_free(c);
+}
+
+static void free_dctx(gpointer dctx) {
+    ZSTD_freeDCtx(dctx);
+}
+
+static GPrivate thread_compressor = G_PRIVATE_INIT(free_compressor);
+static GPrivate thread_dctx = G_PRIVATE_INIT(free_dctx);
+
+static LogzCompressor* get_thread_compressor(gsize frame_size) {
+    LogzCompressor* c = g_private_get(&thread_compressor);
+    if (!c) {
+        c = g_new0(LogzCompressor, 1);
+        c->cctx = ZSTD_createCCtx();
+        g_private_set(&thread_compressor, c);
+    }
+    gsize need = ZSTD_compressBound(frame_size);
+    if (c->out_cap < need) {
+        g_free(c->out);
+        c->out = g_malloc(need);
+        c->out_cap = need;
+    }
+    return c->cctx ? c : NULL;
+}
+
+static ZSTD_DCtx* get_thread_dctx(void) {
+    ZSTD_DCtx* dctx = g_private_get(&thread_dctx);
+    if (!dctx) {
+        dctx = ZSTD_createDCtx();
+        g_private_set(&thread_dctx, dctx);
+    }
+    return dctx;
+}
+
+static void put_u16(guint8* p, guint16 v) {
+    v = GUINT16_TO_LE(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void put_u32(guint8* p, guint32 v) {
+    v = GUINT32_TO_LE(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void put_u64(guint8* p, guint64 v) {
+    v = GUINT64_TO_LE(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static guint16 get_u16(const guint8* p) {
+    guint16 v;
+    memcpy(&v, p, sizeof(v));
+    return GUINT16_FROM_LE(v);
+}
+
+static guint32 get_u32(const guint8* p) {
+    guint32 v;
+    memcpy(&v, p, sizeof(v));
+    return GUINT32_FROM_LE(v);
+}
+
+static guint64 get_u64(const guint8* p) {
+    guint64 v;
+    memcpy(&v, p, sizeof(v));
+    return GUINT64_FROM_LE(v);
+}
+
+static gboolean pwrite_all(int fd, const void* data, gsize len, guint64 offset) {
+    const guint8* p = data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        p += n;
+        len -= (gsize)n;
+        offset += (guint64)n;
+    }
+    return TRUE;
+}
+
+static gboolean pread_all(int fd, void* data, gsize len, guint64 offset) {
+    guint8* p = data;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+        p += n;
+        len -= (gsize)n;
+        offset += (guint64)n;
+    }
+    return TRUE;
+}
+
+static const guint8* find_last_newline(const guint8* data, gsize len) {
+    for (gsize i = len; i > 0; i--) {
+        if (data[i - 1] == '\n')
+            return data + i - 1;
+    }
+    return NULL;
+}
+
+static guint64 count_lines(const guint8* data, gsize len) {
+    guint64 n = 0;
+    const guint8* end = data + len;
+    while ((data = memchr(data, '\n', (gsize)(end - data))) != NULL) {
+        n++;
+        data++;
+    }
+    return n;
+}
+
+/* ── Index ──────────────────────────────────────────────────────────────── */
+
+// Write the block of entries since the last kept block at the end of the file.
+static gboolean logz_writer_write_index(LogzWriter* w) {
+    gsize n = w->frames->len;
+    gsize count = n - w->indexed;
+    gsize names_size = 0;
+    for (guint i = 0; i < w->names->len; i++)
+        names_size += strlen(g_ptr_array_index(w->names, i)) + 1;
+    gsize payload = count * LOGZ_ENTRY_SIZE + names_size + 4 + LOGZ_LINK_SIZE + LOGZ_TRAILER_SIZE;
+    gsize total = LOGZ_SKIP_HEADER_SIZE + payload;
+    guint8* idx = g_malloc(total);
+
+    put_u32(idx, LOGZ_INDEX_MAGIC);
+    put_u32(idx + 4, (guint32)payload);
+    guint8* p = idx + LOGZ_SKIP_HEADER_SIZE;
+    for (gsize i = w->indexed; i < n; i++, p += LOGZ_ENTRY_SIZE) {
+        const LogzFrame* f = &g_array_index(w->frames, LogzFrame, i);
+        put_u64(p, f->line);
+        put_u64(p + 8, f->offset);
+        put_u32(p + 16, f->csize);
+        put_u32(p + 20, f->dsize);
+        put_u64(p + 24, (guint64)f->time_us);
+    }
+    for (guint i = 0; i < w->names->len; i++) {
+        const char* name = g_ptr_array_index(w->names, i);
+        gsize len = strlen(name) + 1;
+        memcpy(p, name, len);
+        p += len;
+    }
+    put_u32(p, (guint32)names_size);
+    p += 4;
+    put_u64(p, w->index_prev);
+    put_u32(p + 8, (guint32)count);
+    p += LOGZ_LINK_SIZE;
+    put_u64(p, w->lines);
+    put_u32(p + 8, (guint32)n);
+    put_u16(p + 12, LOGZ_VERSION);
+    put_u16(p + 14, w->flags);
+    put_u32(p + 16, w->opts.dict ? logz_dict_get_id(w->opts.dict) : 0);
+    put_u32(p + 20, LOGZ_TRAILER_MAGIC);
+
+    gboolean ok = pwrite_all(w->fd, idx, total, w->data_end) && ftruncate(w->fd, (off_t)(w->data_end + total)) == 0;
+    if (!ok)
+        g_printerr("logz index %s: %s\n", w->name, g_strerror(errno));
+    g_free(idx);
+
+    // full: keep this block, the next frame goes after it
+    if (ok && count >= LOGZ_BLOCK_ENTRIES) {
+        w->index_prev = w->data_end;
+        w->data_end += total;
+        w->indexed = (guint)n;
+    }
+    return ok;
+}
+
+// One block with every entry, so the finished archive's index is a single read.
+static gboolean logz_writer_finish_index(LogzWriter* w) {
+    w->index_deferred = FALSE;
+    w->indexed = 0;
+    w->index_prev = 0;
+    return logz_writer_write_index(w);
+}
+
+// The context is shared with other writers on this thread: set everything
+// that matters for this one before each frame.
+static void logz_writer_configure(LogzWriter* w, ZSTD_CCtx* cctx) {
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, w->opts.level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+    if (w->opts.dict) {
+        const ZSTD_CDict* cdict = logz_dict_get_cdict(w->opts.dict, w->opts.level);
+        if (cdict) {
+            ZSTD_CCtx_refCDict(cctx, cdict);
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, w->opts.level);
+        }
+        else {
+            w->opts.dict = NULL;  // not written with it after all; the trailer says so
+        }
+    }
+    if (w->opts.long_distance)
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+    if (w->opts.n_workers > 0) {
+        // fails on a libzstd built without threads; compress on this thread then
+        if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, w->opts.n_workers)))
+            w->opts.n_workers = 0;
+        else
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_jobSize, LOGZ_FRAME_SIZE);
+    }
+}
+
+/* ── Chunk store ────────────────────────────────────────────────────────── */
+
+static void chunk_ref_free(gpointer data) {
+    LogzChunkRef* ref = data;
+    g_free(ref->path);
+    g_free(ref);
+}
+
+static void init_gear(void) {
+    static gsize done = 0;
+    if (!g_once_init_enter(&done))
+        return;
+    // any fixed pseudo-random table works; it only has to be the same every run
+    guint64 x = 0x1e7e2a11u;
+    for (int i = 0; i < 256; i++) {
+        x += 0x9E3779B97F4A7C15ULL;  // splitmix64
+        guint64 z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = z ^ (z >> 31);
+    }
+    g_once_init_leave(&done, 1);
+}
+
+static void hash_text(const guint8* data, gsize len, guint8 out[32]) {
+    GChecksum* sum = g_checksum_new(G_CHECKSUM_SHA256);
+    gsize out_len = 32;
+    g_checksum_update(sum, data, (gssize)len);
+    g_checksum_get_digest(sum, out, &out_len);
+    g_checksum_free(sum);
+}
+
+// Where the same text was already archived, if that archive is still there.
+static gboolean chunk_store_lookup(const guint8 hash[32], gchar** path, guint* frame) {
+    GBytes* key = g_bytes_new_static(hash, 32);
+    g_mutex_lock(&store_lock);
+    LogzChunkRef* ref = chunk_store ? g_hash_table_lookup(chunk_store, key) : NULL;
+    *path = ref ? g_strdup(ref->path) : NULL;
+    *frame = ref ? ref->frame : 0;
+    guint64 ino = ref ? ref->ino : 0;
+    g_mutex_unlock(&store_lock);
+    g_bytes_unref(key);
+
+    struct stat st;
+    if (*path && (g_stat(*path, &st) != 0 || !S_ISREG(st.st_mode) || (guint64)st.st_ino != ino))
+        g_clear_pointer(path, g_free);
+    return *path != NULL;
+}
+
+static gboolean chunk_ref_is_at(gpointer key, gpointer value, gpointer path) {
+    (void)key;
+    return g_str_equal(((LogzChunkRef*)value)->path, path);
+}
+
+// The archive at path is about to be deleted: stop referencing its frames.
+void logz_chunk_store_forget(const char* path) {
+    g_mutex_lock(&store_lock);
+    if (chunk_store)
+        g_hash_table_foreach_remove(chunk_store, chunk_ref_is_at, (gpointer)path);
+    g_mutex_unlock(&store_lock);
+}
+
+// logz_archive_rewrite() replaced the archive at path with the same frames in a new file.
+static void chunk_store_moved(const char* path, guint64 ino) {
+    g_mutex_lock(&store_lock);
+    if (chunk_store) {
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, chunk_store);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            LogzChunkRef* ref = value;
+            if (g_str_equal(ref->path, path))
+                ref->ino = ino;
+        }
+    }
+    g_mutex_unlock(&store_lock);
+}
+
+static void chunk_store_publish(LogzWriter* w) {
+    g_mutex_lock(&store_lock);
+    if (!chunk_store)
+        chunk_store = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, (GDestroyNotify)g_bytes_unref, chunk_ref_free);
+    for (guint i = 0; i < w->new_chunks->len; i++) {
+        const LogzChunk* c = &g_array_index(w->new_chunks, LogzChunk, i);
+        LogzChunkRef* ref = g_new(LogzChunkRef, 1);
+        ref->path = g_strdup(w->path);
+        ref->ino = w->ino;  // the file is linked to path under the same inode
+        ref->frame = c->frame;
+        g_hash_table_replace(chunk_store, g_bytes_new(c->hash, 32), ref);
+    }
+    g_mutex_unlock(&store_lock);
+}
+
+static guint32 logz_writer_name_index(LogzWriter* w, const char* name) {
+    for (guint i = 1; i < w->names->len; i++) {
+        if (g_str_equal(g_ptr_array_index(w->names, i), name))
+            return i;
+    }
+    g_ptr_array_add(w->names, g_strdup(name));
+    return w->names->len - 1;
+}
+
+// Record buf[0, n) as a reference if the chunk store already has it.
+static gboolean logz_writer_try_ref(LogzWriter* w, gsize n, const guint8 hash[32]) {
+    gchar* path = NULL;
+    guint frame = 0;
+    if (!chunk_store_lookup(hash, &path, &frame))
+        return FALSE;
+
+    gchar* dir = g_path_get_dirname(path);
+    gboolean same_dir = g_str_equal(dir, w->dir) && !g_str_equal(path, w->path);
+    if (same_dir) {
+        gchar* base = g_path_get_basename(path);
+        LogzFrame f = {
+            .line = w->lines,
+            .offset = ((guint64)logz_writer_name_index(w, base) << 32) | frame,
+            .csize = 0,
+            .dsize = (guint32)n,
+            .time_us = w->buf_time,
+        };
+        g_array_append_val(w->frames, f);
+        g_free(base);
+    }
+    g_free(dir);
+    g_free(path);
+    return same_dir;
+}
+
+/* ── Writer ─────────────────────────────────────────────────────────────── */
+
+// Advisory, so that logz_archive_rewrite() leaves files alone while they grow.
+static void logz_writer_lock(LogzWriter* w) {
+    struct flock fl = {.l_type = F_WRLCK, .l_whence = SEEK_SET};
+    struct stat st;
+    fcntl(w->fd, F_SETLK, &fl);
+    if (fstat(w->fd, &st) != 0)
+        return;
+    w->ino = st.st_ino;
+    g_mutex_lock(&writing_lock);
+    if (!writing_inodes)
+        writing_inodes = g_hash_table_new(g_int64_hash, g_int64_equal);
+    g_hash_table_add(writing_inodes, &w->ino);
+    g_mutex_unlock(&writing_lock);
+}
+
+static void logz_writer_unlock(LogzWriter* w) {
+    if (w->ino == 0)
+        return;
+    g_mutex_lock(&writing_lock);
+    g_hash_table_remove(writing_inodes, &w->ino);
+    g_mutex_unlock(&writing_lock);
+}
+
+// Compress buf[0, n) into its own frame, or reference an archived copy of it,
+// append it and refresh the index.
+static gboolean logz_writer_emit(LogzWriter* w, gsize n) {
+    if (n == 0)
+        return TRUE;
+
+    LogzChunk chunk;
+    gboolean stored = FALSE;
+    if (w->opts.dedup_path) {
+        hash_text(w->buf, n, chunk.hash);
+        stored = logz_writer_try_ref(w, n, chunk.hash);
+    }
+
+    if (!stored) {
+        LogzCompressor* c = get_thread_compressor(w->opts.frame_size);
+        if (!c) {
+            g_printerr("zstd write %s: cannot allocate a compression context\n", w->name);
+            return FALSE;
+        }
+        logz_writer_configure(w, c->cctx);
+        gint64 t0 = w->opts.phase ? g_get_monotonic_time() : 0;
+        size_t csize = ZSTD_compress2(c->cctx, c->out, c->out_cap, w->buf, n);
+        if (ZSTD_isError(csize)) {
+            g_printerr("zstd write %s: %s\n", w->name, ZSTD_getErrorName(csize));
+            return FALSE;
+        }
+        gint64 t1 = w->opts.phase ? g_get_monotonic_time() : 0;
+        if (!pwrite_all(w->fd, c->out, csize, w->data_end)) {
+            g_printerr("write %s: %s\n", w->name, g_strerror(errno));
+            return FALSE;
+        }
+        if (w->opts.phase) {
+            w->opts.phase("compress", t0, t1, n);
+            w->opts.phase("write", t1, g_get_monotonic_time(), csize);
+        }
+
+        LogzFrame f = {
+            .line = w->lines,
+            .offset = w->data_end,
+            .csize = (guint32)csize,
+            .dsize = (guint32)n,
+            .time_us = w->buf_time,
+        };
+        if (w->opts.dedup_path) {
+            chunk.frame = w->frames->len;
+            g_array_append_val(w->new_chunks, chunk);
+        }
+        g_array_append_val(w->frames, f);
+        w->data_end += csize;
+    }
+    w->lines += count_lines(w->buf, n);
+
+    // keep the partial line for the next frame
+    memmove(w->buf, w->buf + n, w->fill - n);
+    w->fill -= n;
+    if (w->fill == 0)
+        w->buf_time = 0;
+
+    return w->index_deferred || logz_writer_write_index(w);
+}
+
+// Takes ownership of fd; name is only used in messages.
+LogzWriter* logz_writer_new(int fd, const char* name, int level) {
+    LogzOptions opts = {.level = level};
+    return logz_writer_new_full(fd, name, &opts);
+}
+
+LogzWriter* logz_writer_new_full(int fd, const char* name, const LogzOptions* opts) {
+    LogzWriter* w = g_new0(LogzWriter, 1);
+    w->fd = fd;
+    w->name = g_strdup(name);
+    w->opts = *opts;
+    if (w->opts.frame_size == 0)
+        w->opts.frame_size = LOGZ_FRAME_SIZE;
+    w->opts.frame_size = CLAMP(w->opts.frame_size, 4096, LOGZ_MAX_FRAME_SIZE);
+    w->buf = g_malloc(w->opts.frame_size);
+    w->frames = g_array_new(FALSE, FALSE, sizeof(LogzFrame));
+    w->names = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(w->names, g_strdup(""));
+    logz_writer_lock(w);
+
+    if (w->opts.dedup_path) {
+        init_gear();
+        w->path = g_strdup(w->opts.dedup_path);
+        w->dir = g_path_get_dirname(w->path);
+        w->opts.dedup_path = w->path;
+        w->new_chunks = g_array_new(FALSE, FALSE, sizeof(LogzChunk));
+        // a content-defined boundary needs room after LOGZ_CDC_MIN
+        w->opts.frame_size = MAX(w->opts.frame_size, 2 * LOGZ_CDC_MIN);
+        w->buf = g_realloc(w->buf, w->opts.frame_size);
+    }
+    return w;
+}
+
+// Name of the snapshot this archive continues (stored as a basename).
+void logz_writer_set_parent(LogzWriter* w, const char* path) {
+    g_free(g_ptr_array_index(w->names, 0));
+    g_ptr_array_index(w->names, 0) = path ? g_path_get_basename(path) : g_strdup("");
+}
+
+// Cut buf after the last complete line so lines never straddle frames.
+static void logz_writer_cut_full(LogzWriter* w) {
+    const guint8* nl = find_last_newline(w->buf, w->fill);
+    gsize cut = nl ? (gsize)(nl - w->buf) + 1 : w->fill;
+    if (!logz_writer_emit(w, cut))
+        w->failed = TRUE;
+}
+
+// Hash the bytes from `from` on and emit a frame at every content-defined boundary.
+static void logz_writer_cut_cdc(LogzWriter* w, gsize from) {
+    const guint64 mask = (G_GUINT64_CONSTANT(1) << LOGZ_CDC_BITS) - 1;
+    for (gsize i = from; i < w->fill && !w->failed; i++) {
+        guint8 b = w->buf[i];
+        w->gear_hash = (w->gear_hash << 1) + gear[b];
+        if (!w->cut_due && i + 1 >= LOGZ_CDC_MIN && (w->gear_hash & mask) == 0)
+            w->cut_due = TRUE;
+        if (w->cut_due && b == '\n') {
+            if (!logz_writer_emit(w, i + 1))
+                w->failed = TRUE;
+            w->cut_due = FALSE;
+            w->gear_hash = 0;
+            i = (gsize)-1;  // the rest moved to the front
+        }
+    }
+}
+
+gboolean logz_writer_append(LogzWriter* w, const void* data, gsize len) {
+    const guint8* p = data;
+    while (len > 0 && !w->failed) {
+        if (w->fill == 0)
+            w->buf_time = g_get_real_time();
+        gsize take = MIN(len, w->opts.frame_size - w->fill);
+        gsize from = w->fill;
+        memcpy(w->buf + w->fill, p, take);
+        w->fill += take;
+        p += take;
+        len -= take;
+
+        if (w->opts.dedup_path)
+            logz_writer_cut_cdc(w, from);
+        if (w->fill == w->opts.frame_size && !w->failed) {
+            logz_writer_cut_full(w);
+            w->cut_due = FALSE;
+            w->gear_hash = 0;
+        }
+    }
+    return !w->failed;
+}
+
+// Close the frame being assembled, even if it is short, so it becomes readable.
+gboolean logz_writer_flush(LogzWriter* w) {
+    if (!w->failed && !logz_writer_emit(w, w->fill))
+        w->failed = TRUE;
+    return !w->failed;
+}
+
+// Wall-clock time of the oldest byte not yet in a frame, 0 if nothing is pending.
+gint64 logz_writer_pending_since(LogzWriter* w) {
+    return w->buf_time;
+}
+
+gboolean logz_writer_close(LogzWriter* w, gboolean sync) {
+    logz_writer_flush(w);
+    if (!w->failed && (w->frames->len == 0 || w->indexed > 0 || w->index_deferred) && !logz_writer_finish_index(w))
+        w->failed = TRUE;
+    if (!w->failed && sync) {
+        gint64 t0 = w->opts.phase ? g_get_monotonic_time() : 0;
+        if (fsync(w->fd) != 0) {
+            g_printerr("fsync %s: %s\n", w->name, g_strerror(errno));
+            w->failed = TRUE;
+        }
+        if (w->opts.phase)
+            w->opts.phase("fsync", t0, g_get_monotonic_time(), (gsize)w->data_end);
+    }
+    gboolean ok = !w->failed;
+    if (ok && w->opts.dedup_path)
+        chunk_store_publish(w);
+
+    logz_writer_unlock(w);
+    close(w->fd);
+    g_array_free(w->frames, TRUE);
+    g_ptr_array_free(w->names, TRUE);
+    if (w->new_chunks)
+        g_array_free(w->new_chunks, TRUE);
+    g_free(w->buf);
+    g_free(w->name);
+    g_free(w->path);
+    g_free(w->dir);
+    g_free(w);
+    return ok;
+}
+
+/* ── Reader ─────────────────────────────────────────────────────────────── */
+
+// Decode count index entries at p into out; frames must lie before the block at limit.
+static gboolean logz_parse_entries(const guint8* p, guint64 count, guint16 version, guint64 limit, GArray* out) {
+    for (guint64 i = 0; i < count; i++, p += LOGZ_ENTRY_SIZE) {
+        LogzFrame f = {
+            .line = get_u64(p),
+            .offset = get_u64(p + 8),
+            .csize = get_u32(p + 16),
+            .dsize = get_u32(p + 20),
+            .time_us = (gint64)get_u64(p + 24),
+        };
+        if (f.csize == 0 ? version < 2 : f.offset + f.csize > limit)
+            return FALSE;
+        g_array_append_val(out, f);
+    }
+    return TRUE;
+}
+
+// An index block other than the last one (version 3): its entries, and the block before it
+static GArray* logz_reader_load_block(LogzReader* r, guint64 offset, guint64 limit, guint16 version, guint64* prev) {
+    guint8 head[LOGZ_SKIP_HEADER_SIZE];
+    guint8 link[LOGZ_LINK_SIZE];
+    if (!pread_all(r->fd, head, sizeof(head), offset) || get_u32(head) != LOGZ_INDEX_MAGIC)
+        return NULL;
+    guint64 payload = get_u32(head + 4);
+    guint64 end = offset + LOGZ_SKIP_HEADER_SIZE + payload;
+    if (payload < 4 + LOGZ_LINK_SIZE + LOGZ_TRAILER_SIZE || end > limit ||
+        !pread_all(r->fd, link, sizeof(link), end - LOGZ_TRAILER_SIZE - LOGZ_LINK_SIZE))
+        return NULL;
+    guint64 count = get_u32(link + 8);
+    if (count * LOGZ_ENTRY_SIZE + 4 + LOGZ_LINK_SIZE + LOGZ_TRAILER_SIZE > payload)
+        return NULL;
+
+    guint8* entries = g_malloc(count * LOGZ_ENTRY_SIZE);
+    GArray* out = g_array_sized_new(FALSE, FALSE, sizeof(LogzFrame), (guint)count);
+    gboolean ok = pread_all(r->fd, entries, count * LOGZ_ENTRY_SIZE, offset + LOGZ_SKIP_HEADER_SIZE) &&
+                  logz_parse_entries(entries, count, version, offset, out);
+    g_free(entries);
+    if (!ok) {
+        g_array_unref(out);
+        return NULL;
+    }
+    *prev = get_u64(link);
+    return out;
+}
+
+static gboolean logz_reader_load_index(LogzReader* r, guint64 size) {
+    guint8 trailer[LOGZ_TRAILER_SIZE];
+    if (size < LOGZ_SKIP_HEADER_SIZE + LOGZ_TRAILER_SIZE ||
+        !pread_all(r->fd, trailer, sizeof(trailer), size - sizeof(trailer)))
+        return FALSE;
+    guint16 version = get_u16(trailer + 12);
+    if (get_u32(trailer + 20) != LOGZ_TRAILER_MAGIC || version < 1 || version > LOGZ_VERSION)
+        return FALSE;
+
+    // version 3 links the block to the one before; its entries are the newest count
+    guint64 n = get_u32(trailer + 8);
+    guint64 count = n;
+    guint64 prev = 0;
+    guint64 link_size = version >= 3 ? LOGZ_LINK_SIZE : 0;
+    guint8 link[LOGZ_LINK_SIZE];
+    if (version >= 3) {
+        if (size < LOGZ_SKIP_HEADER_SIZE + LOGZ_TRAILER_SIZE + LOGZ_LINK_SIZE ||
+            !pread_all(r->fd, link, sizeof(link), size - LOGZ_TRAILER_SIZE - LOGZ_LINK_SIZE))
+            return FALSE;
+        prev = get_u64(link);
+        count = get_u32(link + 8);
+        if (count > n)
+            return FALSE;
+    }
+
+    // version 2 stores the names between the entries and the trailer
+    guint64 names_size = 0;
+    guint8 names_len[4];
+    if (version >= 2) {
+        if (size < LOGZ_SKIP_HEADER_SIZE + LOGZ_TRAILER_SIZE + link_size + 4 ||
+            !pread_all(r->fd, names_len, sizeof(names_len), size - LOGZ_TRAILER_SIZE - link_size - 4))
+            return FALSE;
+        names_size = (guint64)get_u32(names_len) + 4;
+    }
+
+    guint64 payload = count * LOGZ_ENTRY_SIZE + names_size + link_size + LOGZ_TRAILER_SIZE;
+    if (LOGZ_SKIP_HEADER_SIZE + payload > size)
+        return FALSE;
+    guint64 index_start = size - payload - LOGZ_SKIP_HEADER_SIZE;
+
+    guint8* idx = g_malloc(LOGZ_SKIP_HEADER_SIZE + payload);
+    gboolean ok = pread_all(r->fd, idx, LOGZ_SKIP_HEADER_SIZE + payload, index_start) &&
+                  get_u32(idx) == LOGZ_INDEX_MAGIC && get_u32(idx + 4) == payload;
+
+    // the older blocks, newest first; each lies before the one that links to it
+    GPtrArray* blocks = g_ptr_array_new_with_free_func((GDestroyNotify)g_array_unref);
+    guint64 total = count;
+    guint64 limit = index_start;
+    while (ok && prev) {
+        guint64 offset = prev;
+        GArray* block = offset < limit ? logz_reader_load_block(r, offset, limit, version, &prev) : NULL;
+        ok = block && total + block->len <= n;
+        if (block) {
+            total += block->len;
+            g_ptr_array_add(blocks, block);
+        }
+        limit = offset;
+    }
+    ok = ok && total == n;
+    for (guint i = blocks->len; ok && i > 0; i--) {
+        GArray* block = g_ptr_array_index(blocks, i - 1);
+        g_array_append_vals(r->frames, block->data, block->len);
+    }
+    g_ptr_array_free(blocks, TRUE);
+
+    const guint8* p = idx + LOGZ_SKIP_HEADER_SIZE;
+    ok = ok && logz_parse_entries(p, count, version, index_start, r->frames);
+    p += count * LOGZ_ENTRY_SIZE;
+    if (ok && names_size > 4) {
+        // NUL-separated, NUL-terminated
+        const char* names = (const char*)p;
+        gsize len = (gsize)names_size - 4;
+        ok = names[len - 1] == '\0';
+        if (ok) {
+            GPtrArray* list = g_ptr_array_new();
+            for (const char* s = names; s < names + len; s += strlen(s) + 1)
+                g_ptr_array_add(list, g_strdup(s));
+            g_ptr_array_add(list, NULL);
+            r->names = (gchar**)g_ptr_array_free(list, FALSE);
+        }
+    }
+    r->n_lines = get_u64(trailer);
+    r->flags = get_u16(trailer + 14);
+    r->dict_id = get_u32(trailer + 16);
+    g_free(idx);
+
+    if (!ok)
+        g_array_set_size(r->frames, 0);
+    return ok;
+}
+
+// The dictionary for id; NULL if there is none or (with a message) it is not installed.
+static const ZSTD_DDict* logz_reader_get_ddict(LogzReader* r, guint32 id) {
+    if (id == 0)
+        return NULL;
+    LogzDict* d = logz_dict_get(id);
+    const ZSTD_DDict* ddict = d ? logz_dict_get_ddict(d) : NULL;
+    if (!ddict)
+        g_printerr("%s: needs zstd dictionary %08x, not found in ~/.1term/dicts\n", r->path, id);
+    return ddict;
+}
+
+// No usable index (legacy single-stream snapshot, or a writer that died
+// mid-frame): decode the file once and rebuild the frame table in memory.
+static gboolean logz_reader_scan(LogzReader* r, guint64 size, gint64 mtime_us) {
+    ZSTD_DCtx* dctx = get_thread_dctx();
+    guint8* in_buf = g_malloc(ZSTD_DStreamInSize());
+    guint8* out_buf = g_malloc(ZSTD_DStreamOutSize());
+    guint64 offset = 0;
+    guint64 lines = 0;
+    gboolean ok = TRUE;
+
+    while (ok && offset + 8 <= size) {
+        guint8 head[8];
+        if (!pread_all(r->fd, head, sizeof(head), offset))
+            break;
+        if ((get_u32(head) & 0xFFFFFFF0U) == 0x184D2A50U) {  // skippable frame
+            offset += 8 + (guint64)get_u32(head + 4);
+            continue;
+        }
+
+        LogzFrame f = {.line = lines, .offset = offset, .time_us = mtime_us};
+        guint64 pos = offset;
+        guint64 dsize = 0;
+        guint64 frame_lines = 0;
+        gboolean frame_done = FALSE;
+        ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+
+        while (!frame_done && pos < size) {
+            gsize want = MIN(ZSTD_DStreamInSize(), size - pos);
+            if (!pread_all(r->fd, in_buf, want, pos)) {
+                ok = FALSE;
+                break;
+            }
+            if (pos == offset) {
+                // no index to tell us, but the frame header names its dictionary
+                guint32 id = ZSTD_getDictID_fromFrame(in_buf, want);
+                const ZSTD_DDict* ddict = logz_reader_get_ddict(r, id);
+                if (id && !ddict) {
+                    ok = FALSE;
+                    break;
+                }
+                ZSTD_DCtx_refDDict(dctx, ddict);
+                if (id)
+                    r->dict_id = id;
+            }
+            ZSTD_inBuffer in = {in_buf, want, 0};
+            ZSTD_outBuffer out = {out_buf, ZSTD_DStreamOutSize(), 0};
+            // a full output buffer means zstd may still hold decoded data
+            while (!frame_done && (in.pos < in.size || out.pos == out.size)) {
+                out.pos = 0;
+                size_t ret = ZSTD_decompressStream(dctx, &out, &in);
+                if (ZSTD_isError(ret)) {
+                    ok = FALSE;
+                    break;
+                }
+                dsize += out.pos;
+                frame_lines += count_lines(out_buf, out.pos);
+                frame_done = ret == 0;
+            }
+            if (!ok)
+                break;
+            pos += in.pos;
+        }
+        if (!frame_done || dsize > G_MAXUINT32)
+            break;  // truncated tail: keep the complete frames before it
+
+        f.csize = (guint32)(pos - offset);
+        f.dsize = (guint32)dsize;
+        g_array_append_val(r->frames, f);
+        lines += frame_lines;
+        offset = pos;
+    }
+    r->n_lines = lines;
+
+    g_free(in_buf);
+    g_free(out_buf);
+    return r->frames->len > 0;
+}
+
+LogzReader* logz_reader_open(const char* path) {
+    int fd = g_open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        g_printerr("open %s: %s\n", path, g_strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        g_printerr("stat %s: %s\n", path, g_strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    LogzReader* r = g_new0(LogzReader, 1);
+    r->fd = fd;
+    r->path = g_strdup(path);
+    r->frames = g_array_new(FALSE, FALSE, sizeof(LogzFrame));
+    g_mutex_init(&r->refs_lock);
+
+    if (!logz_reader_load_index(r, (guint64)st.st_size) &&
+        !logz_reader_scan(r, (guint64)st.st_size, (gint64)st.st_mtime * G_USEC_PER_SEC)) {
+        if (st.st_size > 0)
+            g_printerr("%s: not a readable .logz archive\n", path);
+    }
+    return r;
+}
+
+void logz_reader_free(LogzReader* r) {
+    if (!r)
+        return;
+    close(r->fd);
+    g_array_free(r->frames, TRUE);
+    g_strfreev(r->names);
+    if (r->refs)
+        g_hash_table_unref(r->refs);
+    g_mutex_clear(&r->refs_lock);
+    g_free(r->path);
+    g_free(r);
+}
+
+guint logz_reader_get_n_frames(LogzReader* r) {
+    return r->frames->len;
+}
+
+const LogzFrame* logz_reader_get_frame(LogzReader* r, guint index) {
+    g_return_val_if_fail(index < r->frames->len, NULL);
+    return &g_array_index(r->frames, LogzFrame, index);
+}
+
+guint64 logz_reader_get_n_lines(LogzReader* r) {
+    return r->n_lines;
+}
+
+// Path of the snapshot this archive continues, or NULL.
+gchar* logz_reader_get_parent(LogzReader* r) {
+    if (!r->names || !r->names[0] || !r->names[0][0])
+        return NULL;
+    gchar* dir = g_path_get_dirname(r->path);
+    gchar* path = g_build_filename(dir, r->names[0], NULL);
+    g_free(dir);
+    return path;
+}
+
+// Basenames of the archives this one references frames of, NULL-terminated.
+gchar** logz_reader_get_references(LogzReader* r) {
+    guint n_names = r->names ? g_strv_length(r->names) : 0;
+    gchar** refs = g_new0(gchar*, MAX(n_names, 1));
+    for (guint i = 1; i < n_names; i++)
+        refs[i - 1] = g_strdup(r->names[i]);
+    return refs;
+}
+
+gboolean logz_reader_is_compacted(LogzReader* r) {
+    return (r->flags & LOGZ_FLAG_COMPACTED) != 0;
+}
+
+// The archive a reference points into, opened once and kept for later frames.
+static LogzReader* logz_reader_get_ref(LogzReader* r, guint32 name_index) {
+    guint n_names = r->names ? g_strv_length(r->names) : 0;
+    if (name_index == 0 || name_index >= n_names)
+        return NULL;
+
+    g_mutex_lock(&r->refs_lock);
+    if (!r->refs)
+        r->refs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)logz_reader_free);
+    const char* name = r->names[name_index];
+    LogzReader* target = g_hash_table_lookup(r->refs, name);
+    if (!target) {
+        gchar* dir = g_path_get_dirname(r->path);
+        gchar* path = g_build_filename(dir, name, NULL);
+        target = logz_reader_open(path);
+        if (target)
+            g_hash_table_insert(r->refs, g_strdup(name), target);
+        g_free(path);
+        g_free(dir);
+    }
+    g_mutex_unlock(&r->refs_lock);
+    return target;
+}
+
+// Index of the frame holding `line` (0-based), or n_frames if it is past the end.
+guint logz_reader_find_line(LogzReader* r, guint64 line) {
+    guint n = r->frames->len;
+    if (n == 0 || line >= r->n_lines)
+        return n;
+    guint lo = 0, hi = n - 1;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo + 1) / 2;
+        if (g_array_index(r->frames, LogzFrame, mid).line <= line)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+// Index of the frame that was being written at time_us (the first frame if earlier).
+guint logz_reader_find_time(LogzReader* r, gint64 time_us) {
+    guint n = r->frames->len;
+    if (n == 0)
+        return 0;
+    guint lo = 0, hi = n - 1;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo + 1) / 2;
+        if (g_array_index(r->frames, LogzFrame, mid).time_us <= time_us)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+GBytes* logz_reader_read_frame(LogzReader* r, guint index) {
+    g_return_val_if_fail(index < r->frames->len, NULL);
+    const LogzFrame* f = &g_array_index(r->frames, LogzFrame, index);
+
+    if (f->csize == 0) {
+        // deduplicated: the text lives in another archive, which never refers further
+        LogzReader* target = logz_reader_get_ref(r, (guint32)(f->offset >> 32));
+        guint ref_index = (guint)(f->offset & 0xffffffffu);
+        if (!target || ref_index >= target->frames->len ||
+            g_array_index(target->frames, LogzFrame, ref_index).csize == 0 ||
+            g_array_index(target->frames, LogzFrame, ref_index).dsize != f->dsize) {
+            g_printerr("%s: frame %u: referenced archive is missing or changed\n", r->path, index);
+            return NULL;
+        }
+        return logz_reader_read_frame(target, ref_index);
+    }
+
+    guint8* in = g_malloc(f->csize);
+    if (!pread_all(r->fd, in, f->csize, f->offset)) {
+        g_printerr("read %s: %s\n", r->path, g_strerror(errno));
+        g_free(in);
+        return NULL;
+    }
+    const ZSTD_DDict* ddict = logz_reader_get_ddict(r, r->dict_id);
+    if (r->dict_id && !ddict) {
+        g_free(in);
+        return NULL;
+    }
+    guint8* out = g_malloc(MAX(f->dsize, 1));
+    size_t ret = ZSTD_decompress_usingDDict(get_thread_dctx(), out, f->dsize, in, f->csize, ddict);
+    g_free(in);
+    if (ZSTD_isError(ret) || ret != f->dsize) {
+        g_printerr("%s: frame %u: %s\n", r->path, index, ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "size mismatch");
+        g_free(out);
+        return NULL;
+    }
+    return g_bytes_new_take(out, f->dsize);
+}
+
+// Lines [first, first + count) decompressing only the frames that hold them.
+gchar* logz_reader_read_lines(LogzReader* r, guint64 first, guint64 count, gsize* len) {
+    GString* out = g_string_new(NULL);
+    guint64 wanted = count;
+
+    for (guint i = logz_reader_find_line(r, first); i < r->frames->len && wanted > 0; i++) {
+        GBytes* bytes = logz_reader_read_frame(r, i);
+        if (!bytes)
+            break;
+        gsize size = 0;
+        const char* p = g_bytes_get_data(bytes, &size);
+        const char* end = p + size;
+
+        // skip the lines of the first frame that precede `first`
+        for (guint64 skip = first > g_array_index(r->frames, LogzFrame, i).line
+                                ? first - g_array_index(r->frames, LogzFrame, i).line
+                                : 0;
+             skip > 0 && p < end; skip--) {
+            const char* nl = memchr(p, '\n', (gsize)(end - p));
+            p = nl ? nl + 1 : end;
+        }
+
+        const char* start = p;
+        while (wanted > 0 && p < end) {
+            const char* nl = memchr(p, '\n', (gsize)(end - p));
+            p = nl ? nl + 1 : end;
+            if (nl)
+                wanted--;
+        }
+        g_string_append_len(out, start, p - start);
+        g_bytes_unref(bytes);
+    }
+
+    if (len)
+        *len = out->len;
+    return g_string_free(out, FALSE);
+}
+
+// Text of every frame written in [from_us, to_us); resolution is one frame.
+gchar* logz_reader_read_time_range(LogzReader* r, gint64 from_us, gint64 to_us, gsize* len) {
+    GString* out = g_string_new(NULL);
+
+    for (guint i = logz_reader_find_time(r, from_us); i < r->frames->len; i++) {
+        if (g_array_index(r->frames, LogzFrame, i).time_us >= to_us)
+            break;
+        GBytes* bytes = logz_reader_read_frame(r, i);
+        if (!bytes)
+            break;
+        gsize size = 0;
+        const char* data = g_bytes_get_data(bytes, &size);
+        g_string_append_len(out, data, size);
+        g_bytes_unref(bytes);
+    }
+
+    if (len)
+        *len = out->len;
+    return g_string_free(out, FALSE);
+}
+
+/* ── Rewriting ──────────────────────────────────────────────────────────── */
+
+// Whether a writer, in this process or another one, still has the archive open.
+gboolean logz_archive_is_busy(const char* path) {
+    struct stat st;
+    if (g_stat(path, &st) != 0)
+        return FALSE;
+    guint64 ino = st.st_ino;
+    g_mutex_lock(&writing_lock);
+    gboolean busy = writing_inodes && g_hash_table_contains(writing_inodes, &ino);
+    g_mutex_unlock(&writing_lock);
+    if (busy)
+        return TRUE;
+
+    // closing this fd drops no lock of ours: we hold none on a file we are not writing
+    int fd = g_open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return FALSE;
+    struct flock fl = {.l_type = F_WRLCK, .l_whence = SEEK_SET};
+    busy = fcntl(fd, F_GETLK, &fl) == 0 && fl.l_type != F_UNLCK;
+    close(fd);
+    return busy;
+}
+
+static gboolean logz_rewrite_frames(LogzReader* r, LogzWriter* w, const char* const* inline_names, const gint* cancel) {
+    guint n_names = r->names ? g_strv_length(r->names) : 0;
+    for (guint i = 0; i < r->frames->len; i++) {
+        if (cancel && g_atomic_int_get(cancel))
+            return FALSE;
+        const LogzFrame* f = &g_array_index(r->frames, LogzFrame, i);
+        guint64 next_line = i + 1 < r->frames->len ? g_array_index(r->frames, LogzFrame, i + 1).line : r->n_lines;
+
+        // a broken reference is left to logz_reader_read_frame() to report
+        guint64 name_index = f->offset >> 32;
+        const char* target = f->csize == 0 && name_index > 0 && name_index < n_names ? r->names[name_index] : NULL;
+        if (target && !(inline_names && g_strv_contains(inline_names, target))) {
+            LogzFrame ref = *f;
+            ref.offset = ((guint64)logz_writer_name_index(w, target) << 32) | (f->offset & 0xffffffffU);
+            g_array_append_val(w->frames, ref);
+            w->lines = next_line;
+            continue;
+        }
+
+        GBytes* text = logz_reader_read_frame(r, i);
+        if (!text)
+            return FALSE;
+        // A frame over the writer's LOGZ_MAX_FRAME_SIZE is cut up on line
+        // boundaries. Only archives without an index have those (one frame per
+        // zstd stream, see logz_reader_scan()), and nothing references them.
+        gsize len = 0;
+        const guint8* p = g_bytes_get_data(text, &len);
+        gboolean ok = TRUE;
+        while (len > 0 && ok) {
+            gsize take = MIN(len, w->opts.frame_size - w->fill);
+            memcpy(w->buf + w->fill, p, take);
+            w->fill += take;
+            p += take;
+            len -= take;
+            w->buf_time = f->time_us;
+            const guint8* nl = len > 0 ? find_last_newline(w->buf, w->fill) : NULL;
+            ok = logz_writer_emit(w, nl ? (gsize)(nl - w->buf) + 1 : w->fill);
+        }
+        g_bytes_unref(text);
+        if (!ok)
+            return FALSE;
+    }
+    return logz_writer_finish_index(w);
+}
+
+// Recompress the archive at path with opts and replace it atomically. Frame
+// numbers, line numbers and times stay the same, so references from other
+// archives into this one remain valid. Its own references are kept, except
+// those into the archives named in inline_names, whose text is copied in.
+// Gives up, leaving path as it was, if it is still being written or once
+// *cancel is set.
+gboolean logz_archive_rewrite(const char* path, const LogzOptions* opts, const char* const* inline_names,
+                              const gint* cancel) {
+    if (logz_archive_is_busy(path))
+        return FALSE;
+    LogzReader* r = logz_reader_open(path);
+    if (!r)
+        return FALSE;
+
+    gchar* tmpl = g_strdup_printf("%s.XXXXXX", path);
+    LogzWriter* w = NULL;
+    gboolean ok = FALSE;
+    struct stat before, now;
+
+    if (fstat(r->fd, &before) != 0) {
+        g_printerr("stat %s: %s\n", path, g_strerror(errno));
+        goto out;
+    }
+    int fd = g_mkstemp_full(tmpl, O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        g_printerr("mkstemp %s: %s\n", tmpl, g_strerror(errno));
+        goto out;
+    }
+
+    LogzOptions o = *opts;
+    o.dedup_path = NULL;
+    o.frame_size = 0;
+    for (guint i = 0; i < r->frames->len; i++)
+        o.frame_size = MAX(o.frame_size, g_array_index(r->frames, LogzFrame, i).dsize);
+    w = logz_writer_new_full(fd, tmpl, &o);
+    w->flags = LOGZ_FLAG_COMPACTED;
+    w->index_deferred = TRUE;
+    if (r->names && r->names[0] && r->names[0][0])
+        logz_writer_set_parent(w, r->names[0]);
+
+    ok = logz_rewrite_frames(r, w, inline_names, cancel);
+    ok = logz_writer_close(w, ok) && ok;
+    w = NULL;
+
+    // keep the original's mtime: it is when the text was archived
+    struct timespec times[2] = {before.st_atim, before.st_mtim};
+    if (ok && utimensat(AT_FDCWD, tmpl, times, 0) != 0) {
+        g_printerr("utimensat %s: %s\n", tmpl, g_strerror(errno));
+        ok = FALSE;
+    }
+    // a writer still appending would lose what it wrote since we opened it
+    if (ok && (g_stat(path, &now) != 0 || now.st_ino != before.st_ino || now.st_size != before.st_size)) {
+        g_printerr("%s changed while it was being recompressed\n", path);
+        ok = FALSE;
+    }
+    struct stat rewritten;
+    if (ok && g_stat(tmpl, &rewritten) != 0) {
+        g_printerr("stat %s: %s\n", tmpl, g_strerror(errno));
+        ok = FALSE;
+    }
+    if (ok && g_rename(tmpl, path) != 0) {
+        g_printerr("rename %s -> %s: %s\n", tmpl, path, g_strerror(errno));
+        ok = FALSE;
+    }
+    if (ok)
+        chunk_store_moved(path, (guint64)rewritten.st_ino);
+    if (!ok)
+        g_unlink(tmpl);
+
+out:
+    g_free(tmpl);
+    logz_reader_free(r);
+    return ok;
+}
@@ -0,0 +1,90 @@
+#ifndef LOGZ_H
+#define LOGZ_H
+
+#include <glib.h>
+#include <zstd.h>
+
+G_BEGIN_DECLS
+
+// Seekable .logz archives: a run of independent zstd frames (each at most
+// LOGZ_FRAME_SIZE bytes of text, cut on a line boundary when possible)
+// followed by an index stored in a zstd skippable frame, so plain `zstdcat`
+// still reads the file while 1term can jump straight to a line or time.
+// Only depends on GLib and zstd so tools outside the GTK app can use it.
+//
+// A reader may be shared between threads: frames are read with pread() and
+// decompressed with a per-thread context.
+
+#define LOGZ_FRAME_SIZE (1 << 20)
+#define LOGZ_MAX_FRAME_SIZE (64 << 20)
+
+typedef struct _LogzDict LogzDict;
+
+typedef struct {
+    int level;
+    gsize frame_size;        // 0 means LOGZ_FRAME_SIZE
+    int n_workers;           // zstd threads per frame; 0 compresses on the calling thread
+    gboolean long_distance;  // long-distance matching, for repetitive output such as build logs
+
+    // Where the archive will end up (it may be written under a temporary name).
+    // When set, frames are cut at content-defined boundaries, and a frame whose
+    // text this process already archived in the same directory is stored as a
+    // reference to it instead of being compressed again.
+    const char* dedup_path;
+
+    LogzDict* dict;  // trained dictionary; its ID is recorded in the archive
+
+    // Told the start and end (g_get_monotonic_time) of each frame's "compress"
+    // and "write" and of the closing "fsync", e.g. for tracing; may be NULL.
+    void (*phase)(const char* name, gint64 start_us, gint64 end_us, gsize bytes);
+} LogzOptions;
+
+typedef struct {
+    guint64 line;     // number of lines before this frame
+    guint64 offset;   // byte offset of the compressed frame in the file
+    guint32 csize;    // compressed size; 0 for a reference to a frame of another archive
+    guint32 dsize;    // decompressed size
+    gint64 time_us;   // wall clock (g_get_real_time) of the frame's first byte
+} LogzFrame;
+
+typedef struct _LogzWriter LogzWriter;
+typedef struct _LogzReader LogzReader;
+
+LogzWriter* logz_writer_new(int fd, const char* name, int level);
+LogzWriter* logz_writer_new_full(int fd, const char* name, const LogzOptions* opts);
+void logz_writer_set_parent(LogzWriter* w, const char* path);
+gboolean logz_writer_append(LogzWriter* w, const void* data, gsize len);
+gboolean logz_writer_flush(LogzWriter* w);
+gint64 logz_writer_pending_since(LogzWriter* w);
+gboolean logz_writer_close(LogzWriter* w, gboolean sync);
+
+LogzReader* logz_reader_open(const char* path);
+void logz_reader_free(LogzReader* r);
+guint logz_reader_get_n_frames(LogzReader* r);
+const LogzFrame* logz_reader_get_frame(LogzReader* r, guint index);
+guint64 logz_reader_get_n_lines(LogzReader* r);
+gchar* logz_reader_get_parent(LogzReader* r);
+gchar** logz_reader_get_references(LogzReader* r);
+gboolean logz_reader_is_compacted(LogzReader* r);
+guint logz_reader_find_line(LogzReader* r, guint64 line);
+guint logz_reader_find_time(LogzReader* r, gint64 time_us);
+GBytes* logz_reader_read_frame(LogzReader* r, guint index);
+gchar* logz_reader_read_lines(LogzReader* r, guint64 first, guint64 count, gsize* len);
+gchar* logz_reader_read_time_range(LogzReader* r, gint64 from_us, gint64 to_us, gsize* len);
+
+gboolean logz_archive_is_busy(const char* path);
+void logz_chunk_store_forget(const char* path);
+gboolean logz_archive_rewrite(const char* path, const LogzOptions* opts, const char* const* inline_names,
+                              const gint* cancel);
+
+gchar* logz_dict_dir(void);
+LogzDict* logz_dict_get_current(void);
+LogzDict* logz_dict_get(guint32 id);
+guint32 logz_dict_get_id(LogzDict* d);
+const ZSTD_CDict* logz_dict_get_cdict(LogzDict* d, int level);
+const ZSTD_DDict* logz_dict_get_ddict(LogzDict* d);
+gboolean logz_dict_train(const char* logs_dir);
+
+G_END_DECLS
+
+#endif  // LOGZ_H
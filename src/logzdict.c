@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "logz.h"
+
+#include <glib/gstdio.h>
+#include <zdict.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+// zstd dictionaries trained on our own logs. Terminal output repeats prompts,
+// paths and compiler diagnostics that a fresh zstd frame cannot know about;
+// with a dictionary even a small frame starts out knowing them.
+//
+// Dictionaries live in ~/.1term/dicts as <id>.zdict, named by the zstd
+// dictionary ID that is also written into every frame and into the .logz
+// trailer, and current.zdict points at the one new archives use. Old
+// dictionaries must be kept for as long as archives written with them.
+
+#define LOGZ_DICT_SIZE (112 << 10)          // zstd's recommended default
+#define LOGZ_DICT_SAMPLE_SIZE (8 << 10)     // samples are cut on line boundaries
+#define LOGZ_DICT_MAX_INPUT (64 << 20)      // newest logs first
+#define LOGZ_DICT_CURRENT "current.zdict"
+
+struct _LogzDict {
+    guint32 id;
+    GBytes* data;
+    GMutex lock;
+    GHashTable* cdicts;  // level -> ZSTD_CDict*
+    ZSTD_DDict* ddict;
+};
+
+// Loaded dictionaries, kept for the lifetime of the process
+static GMutex dicts_lock;
+static GHashTable* dicts = NULL;  // id -> LogzDict*
+static LogzDict* current_dict = NULL;
+static gboolean current_loaded = FALSE;
+
+gchar* logz_dict_dir(void) {
+    return g_build_filename(g_get_home_dir(), ".1term", "dicts", NULL);
+}
+
+static void free_cdict(gpointer cdict) {
+    ZSTD_freeCDict(cdict);
+}
+
+// Called with dicts_lock held.
+static LogzDict* logz_dict_load(const char* path) {
+    gchar* contents = NULL;
+    gsize len = 0;
+    GError* err = NULL;
+    if (!g_file_get_contents(path, &contents, &len, &err)) {
+        if (!g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_printerr("%s\n", err->message);
+        g_error_free(err);
+        return NULL;
+    }
+
+    guint32 id = ZDICT_getDictID(contents, len);
+    if (id == 0) {
+        g_printerr("%s: not a zstd dictionary\n", path);
+        g_free(contents);
+        return NULL;
+    }
+
+    if (!dicts)
+        dicts = g_hash_table_new(g_direct_hash, g_direct_equal);
+    LogzDict* d = g_hash_table_lookup(dicts, GUINT_TO_POINTER(id));
+    if (d) {
+        g_free(contents);
+        return d;
+    }
+
+    d = g_new0(LogzDict, 1);
+    d->id = id;
+    d->data = g_bytes_new_take(contents, len);
+    g_mutex_init(&d->lock);
+    d->cdicts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_cdict);
+    g_hash_table_insert(dicts, GUINT_TO_POINTER(id), d);
+    return d;
+}
+
+// The dictionary new archives should use, or NULL if none was trained.
+LogzDict* logz_dict_get_current(void) {
+    g_mutex_lock(&dicts_lock);
+    if (!current_loaded) {
+        gchar* dir = logz_dict_dir();
+        gchar* path = g_build_filename(dir, LOGZ_DICT_CURRENT, NULL);
+        current_dict = logz_dict_load(path);
+        current_loaded = TRUE;
+        g_free(path);
+        g_free(dir);
+    }
+    LogzDict* d = current_dict;
+    g_mutex_unlock(&dicts_lock);
+    return d;
+}
+
+// The dictionary an archive was written with, or NULL if it is not installed.
+LogzDict* logz_dict_get(guint32 id) {
+    g_mutex_lock(&dicts_lock);
+    LogzDict* d = dicts ? g_hash_table_lookup(dicts, GUINT_TO_POINTER(id)) : NULL;
+    if (!d) {
+        gchar* dir = logz_dict_dir();
+        gchar* name = g_strdup_printf("%08x.zdict", id);
+        gchar* path = g_build_filename(dir, name, NULL);
+        d = logz_dict_load(path);
+        if (d && d->id != id) {
+            g_printerr("%s: dictionary ID is %08x\n", path, d->id);
+            d = NULL;
+        }
+        g_free(path);
+        g_free(name);
+        g_free(dir);
+    }
+    g_mutex_unlock(&dicts_lock);
+    return d;
+}
+
+guint32 logz_dict_get_id(LogzDict* d) {
+    return d->id;
+}
+
+// Digested once per compression level, then shared by all threads.
+const ZSTD_CDict* logz_dict_get_cdict(LogzDict* d, int level) {
+    g_mutex_lock(&d->lock);
+    ZSTD_CDict* cdict = g_hash_table_lookup(d->cdicts, GINT_TO_POINTER(level));
+    if (!cdict) {
+        gsize len = 0;
+        const void* data = g_bytes_get_data(d->data, &len);
+        cdict = ZSTD_createCDict(data, len, level);
+        if (cdict)
+            g_hash_table_insert(d->cdicts, GINT_TO_POINTER(level), cdict);
+    }
+    g_mutex_unlock(&d->lock);
+    return cdict;
+}
+
+const ZSTD_DDict* logz_dict_get_ddict(LogzDict* d) {
+    g_mutex_lock(&d->lock);
+    if (!d->ddict) {
+        gsize len = 0;
+        const void* data = g_bytes_get_data(d->data, &len);
+        d->ddict = ZSTD_createDDict(data, len);
+    }
+    ZSTD_DDict* ddict = d->ddict;
+    g_mutex_unlock(&d->lock);
+    return ddict;
+}
+
+/* ── Training ───────────────────────────────────────────────────────────── */
+
+static gint compare_names_desc(gconstpointer a, gconstpointer b) {
+    return g_strcmp0(*(const gchar* const*)b, *(const gchar* const*)a);
+}
+
+// Cut text into samples of about LOGZ_DICT_SAMPLE_SIZE ending on a newline.
+static void add_samples(GByteArray* samples, GArray* sizes, const guint8* data, gsize len) {
+    const guint8* end = data + len;
+    while (data < end && samples->len < LOGZ_DICT_MAX_INPUT) {
+        gsize take = MIN((gsize)(end - data), LOGZ_DICT_SAMPLE_SIZE);
+        for (gsize i = take; i > take / 2; i--) {
+            if (data[i - 1] == '\n') {
+                take = i;
+                break;
+            }
+        }
+        g_byte_array_append(samples, data, (guint)take);
+        gsize size = take;
+        g_array_append_val(sizes, size);
+        data += take;
+    }
+}
+
+static gboolean install_dictionary(const void* dict, gsize len, guint32 id) {
+    gchar* dir = logz_dict_dir();
+    gchar* name = g_strdup_printf("%08x.zdict", id);
+    gchar* path = g_build_filename(dir, name, NULL);
+    gchar* link = g_build_filename(dir, LOGZ_DICT_CURRENT, NULL);
+    gchar* tmp_link = g_strdup_printf("%s.tmp", link);
+    GError* err = NULL;
+    gboolean ok = FALSE;
+
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        g_printerr("mkdir %s: %s\n", dir, g_strerror(errno));
+        goto out;
+    }
+    if (!g_file_set_contents(path, dict, (gssize)len, &err)) {
+        g_printerr("%s\n", err->message);
+        g_error_free(err);
+        goto out;
+    }
+
+    // switch current.zdict over atomically; archives name their dictionary by ID
+    g_unlink(tmp_link);
+    if (symlink(name, tmp_link) != 0 || g_rename(tmp_link, link) != 0) {
+        g_printerr("%s: %s\n", link, g_strerror(errno));
+        g_unlink(tmp_link);
+        goto out;
+    }
+    g_print("Dictionary %08x (%" G_GSIZE_FORMAT " bytes) → %s\n", id, len, path);
+    ok = TRUE;
+
+out:
+    g_free(tmp_link);
+    g_free(link);
+    g_free(path);
+    g_free(name);
+    g_free(dir);
+    return ok;
+}
+
+// Train a dictionary from the newest archives in logs_dir and make it current.
+gboolean logz_dict_train(const char* logs_dir) {
+    GError* err = NULL;
+    GDir* d = g_dir_open(logs_dir, 0, &err);
+    if (!d) {
+        g_printerr("%s\n", err->message);
+        g_error_free(err);
+        return FALSE;
+    }
+    GPtrArray* names = g_ptr_array_new_with_free_func(g_free);
+    const gchar* name;
+    while ((name = g_dir_read_name(d)) != NULL) {
+        if (g_str_has_prefix(name, "terminal_") && g_str_has_suffix(name, ".logz"))
+            g_ptr_array_add(names, g_strdup(name));
+    }
+    g_dir_close(d);
+    g_ptr_array_sort(names, compare_names_desc);
+
+    GByteArray* samples = g_byte_array_new();
+    GArray* sizes = g_array_new(FALSE, FALSE, sizeof(gsize));
+    guint used = 0;
+    for (guint i = 0; i < names->len && samples->len < LOGZ_DICT_MAX_INPUT; i++) {
+        gchar* path = g_build_filename(logs_dir, g_ptr_array_index(names, i), NULL);
+        LogzReader* r = logz_reader_open(path);
+        g_free(path);
+        if (!r)
+            continue;
+        for (guint f = 0; f < logz_reader_get_n_frames(r) && samples->len < LOGZ_DICT_MAX_INPUT; f++) {
+            if (logz_reader_get_frame(r, f)->csize == 0)
+                continue;  // deduplicated: the text is sampled where it is stored
+            GBytes* text = logz_reader_read_frame(r, f);
+            if (!text)
+                continue;
+            gsize len = 0;
+            const guint8* data = g_bytes_get_data(text, &len);
+            add_samples(samples, sizes, data, len);
+            g_bytes_unref(text);
+        }
+        logz_reader_free(r);
+        used++;
+    }
+    g_ptr_array_free(names, TRUE);
+
+    gboolean ok = FALSE;
+    void* dict = g_malloc(LOGZ_DICT_SIZE);
+    g_print("Training on %u samples (%u bytes) from %u archives...\n", sizes->len, samples->len, used);
+    size_t len = ZDICT_trainFromBuffer(dict, LOGZ_DICT_SIZE, samples->data, (const size_t*)sizes->data, sizes->len);
+    if (ZDICT_isError(len))
+        g_printerr("Dictionary training failed: %s (more logs needed?)\n", ZDICT_getErrorName(len));
+    else
+        ok = install_dictionary(dict, len, ZDICT_getDictID(dict, len));
+
+    g_free(dict);
+    g_array_free(sizes, TRUE);
+    g_byte_array_free(samples, TRUE);
+    return ok;
+}
@@ -1,14 +1,49 @@
 #include "config.h"
 #include "1term.h"
 #include "window.h"
+#include "tab.h"
 #include "clipboard.h"
+#include "sessionlog.h"
+#include "logmaint.h"
+#include "logz.h"
+#include "shellpool.h"
+#include "startup.h"
+#include "latency.h"
+#include "renderbench.h"
+#include "record.h"
+#include "replay.h"
+#include "spill.h"
+#include "throttle.h"
+#include "trace.h"
+#include "watchdog.h"
+
+static gboolean server_mode = FALSE;
+static const char* replay_path = NULL;
+static double replay_speed = 1.0;
+static gboolean watchdog_enabled = FALSE;
+static guint watchdog_ms = 0;
+static const char* trace_path = NULL;
 
 static void print_usage(const char* argv0) {
-    g_print("Usage: %s [--help] [--version]\n", argv0);
+    g_print("Usage: %s [--help] [--version] [--log-sessions] [--shell-pool=N] [--server]\n"
+            "       [--scrollback-budget=MIB] [--firehose-fps=N] [--record] [--replay=FILE [--replay-speed=X]]\n"
+            "       [--overlay-scrollbar] [--latency] [--startup-bench N] [--render-bench=WORKLOAD]\n"
+            "       [--watchdog[=MS]] [--trace=FILE] [--train-dict]\n",
+            argv0);
 }
 
-static gboolean try_handle_cli(int argc, char** argv) {
-    for (int i = 1; i < argc; i++) {
+static int train_dictionary(void) {
+    gchar* dir = g_build_filename(g_get_home_dir(), ".1term", "logs", NULL);
+    gboolean ok = logz_dict_train(dir);
+    g_free(dir);
+    return ok ? 0 : 1;
+}
+
+// Handles informational flags (returns TRUE to exit) and consumes 1term's own
+// settings flags from argv so GApplication does not reject them.
+static gboolean try_handle_cli(int* argc, char** argv) {
+    int out = 1;
+    for (int i = 1; i < *argc; i++) {
         if (g_str_equal(argv[i], "--help") || g_str_equal(argv[i], "-h")) {
             print_usage(argv[0]);
             return TRUE;
@@ -17,7 +52,81 @@ static gboolean try_handle_cli(int argc, char** argv) {
             g_print("1term %s\n", ONETERM_VERSION);
             return TRUE;
         }
+        if (g_str_equal(argv[i], "--train-dict"))
+            exit(train_dictionary());
+        if (g_str_equal(argv[i], "--log-sessions")) {
+            session_logging_enabled = TRUE;
+            continue;
+        }
+        if (g_str_equal(argv[i], "--startup-bench")) {
+            int runs = i + 1 < *argc ? atoi(argv[i + 1]) : 0;
+            if (runs <= 0) {
+                g_printerr("--startup-bench needs a number of runs\n");
+                exit(2);
+            }
+            exit(startup_bench(runs));
+        }
+        if (g_str_has_prefix(argv[i], "--render-bench=")) {
+            if (!render_bench_set_workload(argv[i] + strlen("--render-bench=")))
+                exit(2);
+            continue;
+        }
+        if (g_str_equal(argv[i], "--render-bench-gen"))
+            exit(i + 1 < *argc ? render_bench_generate(argv[i + 1]) : 2);
+        if (g_str_equal(argv[i], "--record")) {
+            record_all_tabs = TRUE;
+            continue;
+        }
+        if (g_str_has_prefix(argv[i], "--replay=")) {
+            replay_path = argv[i] + strlen("--replay=");
+            continue;
+        }
+        if (g_str_has_prefix(argv[i], "--replay-speed=")) {
+            replay_speed = g_ascii_strtod(argv[i] + strlen("--replay-speed="), NULL);
+            continue;
+        }
+        if (g_str_equal(argv[i], "--overlay-scrollbar")) {
+            tab_overlay_scrollbar = TRUE;
+            continue;
+        }
+        if (g_str_equal(argv[i], "--latency")) {
+            latency_enabled = TRUE;
+            continue;
+        }
+        if (g_str_equal(argv[i], "--watchdog") || g_str_has_prefix(argv[i], "--watchdog=")) {
+            watchdog_enabled = TRUE;
+            if (argv[i][strlen("--watchdog")] == '=')
+                watchdog_ms = (guint)g_ascii_strtoull(argv[i] + strlen("--watchdog="), NULL, 10);
+            continue;
+        }
+        if (g_str_has_prefix(argv[i], "--trace=")) {
+            trace_path = argv[i] + strlen("--trace=");
+            continue;
+        }
+        if (g_str_equal(argv[i], "--startup-report")) {
+            startup_set_report_mode();
+            continue;
+        }
+        if (g_str_equal(argv[i], "--server")) {
+            server_mode = TRUE;
+            continue;
+        }
+        if (g_str_has_prefix(argv[i], "--scrollback-budget=")) {
+            spill_budget_mib = (guint)g_ascii_strtoull(argv[i] + strlen("--scrollback-budget="), NULL, 10);
+            continue;
+        }
+        if (g_str_has_prefix(argv[i], "--firehose-fps=")) {
+            throttle_firehose_fps = (guint)g_ascii_strtoull(argv[i] + strlen("--firehose-fps="), NULL, 10);
+            continue;
+        }
+        if (g_str_has_prefix(argv[i], "--shell-pool=")) {
+            shell_pool_set_size((guint)g_ascii_strtoull(argv[i] + strlen("--shell-pool="), NULL, 10));
+            continue;
+        }
+        argv[out++] = argv[i];
     }
+    argv[out] = NULL;
+    *argc = out;
     return FALSE;
 }
 
@@ -26,7 +135,61 @@ static void new_window_action(GSimpleAction* a, GVariant* p, gpointer user_data)
 }
 
 static void app_activate(GApplication* gapp, gpointer unused) {
-    create_window(GTK_APPLICATION(gapp));
+    startup_mark(STARTUP_ACTIVATE);
+    if (replay_path)
+        replay_open(GTK_APPLICATION(gapp), replay_path, replay_speed);
+    else
+        create_window_full(GTK_APPLICATION(gapp), NULL, render_bench_command(), NULL);
+}
+
+// Server mode: a request from 1term-client, [--tab] [--cwd=DIR] [-e COMMAND...].
+// Runs in the resident process, in the client's working directory by default.
+static int app_command_line(GApplication* gapp, GApplicationCommandLine* cmdline, gpointer unused) {
+    // the server's own launch opens nothing; it waits for clients
+    if (!g_application_command_line_get_is_remote(cmdline))
+        return 0;
+
+    gint argc = 0;
+    gchar** argv = g_application_command_line_get_arguments(cmdline, &argc);
+    const gchar* cwd = g_application_command_line_get_cwd(cmdline);
+    // the client's environment, so its shells get its DISPLAY, SSH_AUTH_SOCK and PATH rather than ours
+    const gchar* const* env = g_application_command_line_get_environ(cmdline);
+    if (!env[0])
+        env = NULL;
+    gboolean new_tab = FALSE;
+    gchar** command = NULL;
+    int status = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (g_str_equal(argv[i], "--tab")) {
+            new_tab = TRUE;
+        }
+        else if (g_str_has_prefix(argv[i], "--cwd=")) {
+            cwd = argv[i] + strlen("--cwd=");
+        }
+        else if (g_str_equal(argv[i], "-e") || g_str_equal(argv[i], "--")) {
+            command = i + 1 < argc ? argv + i + 1 : NULL;
+            break;
+        }
+        else {
+            g_application_command_line_printerr(cmdline, "1term: unknown option %s\n", argv[i]);
+            status = 2;
+            goto out;
+        }
+    }
+
+    GtkWindow* win = gtk_application_get_active_window(GTK_APPLICATION(gapp));
+    if (new_tab && win && MY_IS_WINDOW(win)) {
+        add_tab_full(my_window_get_notebook(MY_WINDOW(win)), cwd, command, (char**)env);
+        gtk_window_present(win);
+    }
+    else {
+        create_window_full(GTK_APPLICATION(gapp), cwd, command, (char**)env);
+    }
+
+out:
+    g_strfreev(argv);
+    return status;
 }
 
 static void hard_disable_a11y(void) {
@@ -35,16 +198,53 @@ static void hard_disable_a11y(void) {
 }
 
 int main(int argc, char** argv) {
-    if (try_handle_cli(argc, argv))
+    startup_mark(STARTUP_MAIN);
+    if (try_handle_cli(&argc, argv))
         return 0;
 
+    // ONETERM_TRACE also reaches a server started by 1term-client; shells must not inherit it
+    g_autofree char* trace_env = g_strdup(g_getenv("ONETERM_TRACE"));
+    g_unsetenv("ONETERM_TRACE");
+    if (!trace_path)
+        trace_path = trace_env;
+    if (trace_path && *trace_path && !trace_start(trace_path))
+        return 1;
+
+    atexit(trace_shutdown);  // runs last, once the pool has drained
     atexit(free_compress_pool);
+    atexit(record_shutdown);  // ends the recordings' streams and joins their writers
+    atexit(session_log_shutdown);
+    atexit(shell_pool_shutdown);
+    atexit(latency_shutdown);
+    atexit(log_maintenance_shutdown);  // stops rewriting before the rest shuts down
+    atexit(watchdog_stop);             // runs first: shutting down is not a stall
+    log_maintenance_start();
+    if (watchdog_enabled)
+        watchdog_start(watchdog_ms);
 
     hard_disable_a11y();  // must run before GTK initialization
+    startup_mark(STARTUP_A11Y);
 
-    GtkApplication* app = gtk_application_new("org.oneterm", G_APPLICATION_NON_UNIQUE);
+    // The server owns ONETERM_APP_ID on the session bus and stays up without windows;
+    // standalone instances never claim the name, so both can run side by side.
+    GtkApplication* app = gtk_application_new(
+        ONETERM_APP_ID, server_mode ? G_APPLICATION_HANDLES_COMMAND_LINE : G_APPLICATION_NON_UNIQUE);
 
     g_signal_connect(app, "activate", G_CALLBACK(app_activate), NULL);
+    if (server_mode) {
+        g_signal_connect(app, "command-line", G_CALLBACK(app_command_line), NULL);
+        g_application_hold(G_APPLICATION(app));
+
+        // a second server would only forward its empty command line to the first
+        GError* err = NULL;
+        if (!g_application_register(G_APPLICATION(app), NULL, &err) ||
+            g_application_get_is_remote(G_APPLICATION(app))) {
+            g_printerr("1term --server: %s\n", err ? err->message : "a server is already running");
+            g_clear_error(&err);
+            g_object_unref(app);
+            return 1;
+        }
+    }
 
     GSimpleAction* act = g_simple_action_new("new-window", NULL);
     g_signal_connect(act, "activate", G_CALLBACK(new_window_action), app);
@@ -0,0 +1,329 @@
+#include "paste.h"
+#include "tab.h"
+#include "watchdog.h"
+
+#include <glib-unix.h>
+#include <poll.h>
+
+// Streaming paste. The clipboard is read through an async stream at most
+// PASTE_READ_AHEAD ahead of the terminal, and handed to VTE in PASTE_CHUNK
+// pieces, each only once the PTY is writable after VTE has flushed the
+// previous one, so the receiving program sets the pace and the main loop never
+// blocks. A paste that fits in one chunk goes through vte_terminal_paste_text()
+// as usual. A bigger one is still a single paste for the program: the chunks
+// are filtered the way VTE filters pastes and fed as plain input, between one
+// pair of bracketed-paste markers when the terminal has that mode on.
+
+#define PASTE_KEY "1term-paste"
+#define PASTE_CHUNK 4096
+#define PASTE_READ_AHEAD (256 << 10)
+#define PASTE_PROGRESS_MIN (1 << 20)  // show progress once this much is involved
+#define PASTE_PROGRESS_US (100 * 1000)
+
+typedef struct {
+    VteTerminal* vt;  // NULL once the paste is over; pending callbacks then just let go
+    GCancellable* cancel;
+    GInputStream* in;
+    GByteArray* pending;  // read but not pasted yet
+    gboolean reading;
+    gboolean eof;
+    gboolean streaming;      // the first chunk has gone out
+    const char* bracket_end;  // to send when done, if the paste was bracketed
+    guint watch_id;
+    guint64 sent;
+    gint64 progress_time;
+    GtkWidget* progress;  // in the tab label, for big pastes
+    GtkWidget* stop;
+} Paste;
+
+static void paste_clear(gpointer data) {
+    Paste* p = data;
+    g_clear_object(&p->cancel);
+    g_clear_object(&p->in);
+    g_byte_array_unref(p->pending);
+}
+
+static void paste_release(Paste* p) {
+    g_rc_box_release_full(p, paste_clear);
+}
+
+static void paste_schedule(Paste* p);
+
+// Bytes at the front of data that can go now without splitting a character,
+// or a CR LF pair that VTE would turn into two line ends. Prefers whole lines.
+static gsize paste_cut(const guint8* data, gsize len, gboolean final) {
+    if (final && len <= PASTE_CHUNK)
+        return len;
+    // unless this is the end, the last byte waits to see what follows it
+    gsize max = MIN(final ? len : len - 1, PASTE_CHUNK);
+    gsize n = max;
+    for (gsize i = n; i > n / 2; i--) {
+        if (data[i - 1] == '\n')
+            return i;
+    }
+    while (n > 0 && (data[n] & 0xC0) == 0x80)
+        n--;
+    if (n > 0 && data[n - 1] == '\r' && data[n] == '\n')
+        n--;
+    // more than a character's worth of continuation bytes is not UTF-8 anyway
+    return n > 0 || max < 4 ? n : max;
+}
+
+static void paste_remove_progress(Paste* p) {
+    if (p->progress) {
+        gtk_widget_unparent(p->progress);
+        gtk_widget_unparent(p->stop);
+        p->progress = NULL;
+        p->stop = NULL;
+    }
+}
+
+// Over: give up the terminal; the last reference is dropped by whoever holds it.
+static void paste_finish(Paste* p) {
+    if (!p->vt)
+        return;
+    if (p->bracket_end)
+        vte_terminal_feed_child(p->vt, p->bracket_end, -1);  // also when cancelled: the program leaves paste mode
+    g_cancellable_cancel(p->cancel);
+    if (p->watch_id) {
+        g_source_remove(p->watch_id);
+        p->watch_id = 0;
+    }
+    paste_remove_progress(p);
+    VteTerminal* vt = p->vt;
+    p->vt = NULL;
+    g_object_set_data(G_OBJECT(vt), PASTE_KEY, NULL);
+}
+
+static void on_paste_stop_clicked(GtkButton* btn, gpointer user_data) {
+    Paste* p = user_data;
+    g_print("Paste cancelled after %" G_GUINT64_FORMAT " bytes\n", p->sent);
+    paste_finish(p);
+}
+
+static void paste_update_progress(Paste* p) {
+    gint64 now = g_get_monotonic_time();
+    if (now - p->progress_time < PASTE_PROGRESS_US || p->sent + p->pending->len < PASTE_PROGRESS_MIN)
+        return;
+    p->progress_time = now;
+
+    if (!p->progress) {
+        TabContext* ctx = tab_context_get(p->vt);
+        if (!ctx || !ctx->notebook)
+            return;
+        GtkWidget* box = ctx->tab_label;
+        // label, progress, stop, close
+        p->progress = gtk_progress_bar_new();
+        gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(p->progress), TRUE);
+        gtk_widget_set_valign(p->progress, GTK_ALIGN_CENTER);
+        p->stop = gtk_button_new_from_icon_name("process-stop");
+        gtk_button_set_has_frame(GTK_BUTTON(p->stop), FALSE);
+        gtk_widget_set_tooltip_text(p->stop, "Cancel paste");
+        g_signal_connect(p->stop, "clicked", G_CALLBACK(on_paste_stop_clicked), p);
+        gtk_box_insert_child_after(GTK_BOX(box), p->progress, ctx->label);
+        gtk_box_insert_child_after(GTK_BOX(box), p->stop, p->progress);
+    }
+
+    // the total is unknown until the clipboard stream ends
+    gchar* size = g_format_size(p->sent);
+    gchar* text = g_strdup_printf("Pasting %s", size);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(p->progress), text);
+    if (p->eof)
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(p->progress),
+                                      (double)p->sent / (double)(p->sent + p->pending->len));
+    else
+        gtk_progress_bar_pulse(GTK_PROGRESS_BAR(p->progress));
+    g_free(text);
+    g_free(size);
+}
+
+static void on_paste_read(GObject* source, GAsyncResult* res, gpointer user_data) {
+    WATCHDOG_SCOPE("on_paste_read");
+    Paste* p = user_data;
+    GError* err = NULL;
+    GBytes* bytes = g_input_stream_read_bytes_finish(G_INPUT_STREAM(source), res, &err);
+    if (p->vt) {
+        p->reading = FALSE;
+        if (!bytes) {
+            g_printerr("Paste: %s\n", err->message);
+            paste_finish(p);
+        }
+        else {
+            gsize len = 0;
+            const guint8* data = g_bytes_get_data(bytes, &len);
+            g_byte_array_append(p->pending, data, (guint)len);
+            p->eof = len == 0;
+            paste_schedule(p);
+        }
+    }
+    g_clear_error(&err);
+    if (bytes)
+        g_bytes_unref(bytes);
+    paste_release(p);
+}
+
+static void on_paste_probe_commit(VteTerminal* vt, const gchar* text, guint size, gpointer user_data) {
+    const char** end = user_data;
+    if (size >= 6 && memcmp(text, "\033[200~", 6) == 0)
+        *end = "\033[201~";
+    else if (size >= 6 && memcmp(text, "\302\233" "200~", 6) == 0)
+        *end = "\302\233" "201~";  // 8-bit C1 controls
+}
+
+// VTE has no getter for bracketed-paste mode, so ask it: an empty paste comes
+// back through "commit" wrapped in the start and end markers when the mode is on
+// (the program sees an empty paste), and as nothing at all when it is off.
+// Returns the end marker, NULL if pastes are not bracketed.
+static const char* paste_probe_brackets(VteTerminal* vt) {
+    const char* end = NULL;
+    gulong id = g_signal_connect(vt, "commit", G_CALLBACK(on_paste_probe_commit), &end);
+    vte_terminal_paste_text(vt, "");
+    g_signal_handler_disconnect(vt, id);
+    return end;
+}
+
+// What VTE's paste path does to text: LF and CR LF become CR, the other C0
+// controls, DEL and C1 controls are dropped. text is valid UTF-8.
+static void paste_sanitize(GString* out, const gchar* text, gsize len) {
+    for (gsize i = 0; i < len; i++) {
+        guint8 c = (guint8)text[i];
+        if (c == '\r' && i + 1 < len && text[i + 1] == '\n')
+            continue;  // the LF sends the CR
+        if (c == '\n')
+            c = '\r';
+        else if ((c < 0x20 && c != '\t' && c != '\r') || c == 0x7F)
+            continue;
+        else if (c == 0xC2 && i + 1 < len && (guint8)text[i + 1] <= 0x9F) {
+            i++;  // U+0080..U+009F
+            continue;
+        }
+        g_string_append_c(out, (gchar)c);
+    }
+}
+
+static gboolean paste_pty_writable(int fd, GIOCondition condition, gpointer user_data);
+
+// Read ahead if there is room, and wait for the PTY if there is something to paste.
+static void paste_schedule(Paste* p) {
+    if (!p->reading && !p->eof && p->pending->len < PASTE_READ_AHEAD / 2) {
+        p->reading = TRUE;
+        g_input_stream_read_bytes_async(p->in, PASTE_READ_AHEAD - p->pending->len, G_PRIORITY_LOW, p->cancel,
+                                        on_paste_read, g_rc_box_acquire(p));
+    }
+
+    if (p->eof && p->pending->len == 0) {
+        paste_finish(p);
+        return;
+    }
+    VtePty* pty = vte_terminal_get_pty(p->vt);
+    if (!pty) {
+        paste_finish(p);
+        return;
+    }
+    if (!p->watch_id && p->pending->len > 0) {
+        // below VTE's own PTY source, so it has written out what it holds by the time we run
+        p->watch_id = g_unix_fd_add_full(G_PRIORITY_LOW, vte_pty_get_fd(pty), G_IO_OUT, paste_pty_writable, p, NULL);
+    }
+}
+
+static gboolean paste_pty_writable(int fd, GIOCondition condition, gpointer user_data) {
+    WATCHDOG_SCOPE("paste_pty_writable");
+    Paste* p = user_data;
+
+    // still writable after VTE's turn: its buffer is empty and the kernel has room
+    struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+    if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLOUT))
+        return G_SOURCE_CONTINUE;
+
+    gsize n = paste_cut(p->pending->data, p->pending->len, p->eof);
+    if (n == 0) {
+        p->watch_id = 0;
+        paste_schedule(p);  // waiting for the rest of a character
+        return G_SOURCE_REMOVE;
+    }
+    gchar* text = g_utf8_make_valid((const gchar*)p->pending->data, (gssize)n);
+    if (!p->streaming && p->eof && n == p->pending->len) {
+        vte_terminal_paste_text(p->vt, text);  // all of it in one go
+    }
+    else {
+        if (!p->streaming) {
+            p->streaming = TRUE;
+            p->bracket_end = paste_probe_brackets(p->vt);
+            if (p->bracket_end)
+                vte_terminal_feed_child(p->vt, p->bracket_end[0] == '\033' ? "\033[200~" : "\302\233" "200~", -1);
+        }
+        GString* body = g_string_sized_new(n);
+        paste_sanitize(body, text, strlen(text));
+        vte_terminal_feed_child(p->vt, body->str, (gssize)body->len);
+        g_string_free(body, TRUE);
+    }
+    g_free(text);
+    g_byte_array_remove_range(p->pending, 0, (guint)n);
+    p->sent += n;
+
+    paste_update_progress(p);
+    if (p->pending->len > 0 && (p->eof || p->pending->len >= PASTE_READ_AHEAD / 2))
+        return G_SOURCE_CONTINUE;
+    p->watch_id = 0;
+    paste_schedule(p);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_clipboard_stream(GObject* source, GAsyncResult* res, gpointer user_data) {
+    WATCHDOG_SCOPE("on_clipboard_stream");
+    Paste* p = user_data;
+    GError* err = NULL;
+    GInputStream* in = gdk_clipboard_read_finish(GDK_CLIPBOARD(source), res, NULL, &err);
+    if (p->vt) {
+        if (!in) {
+            if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+                g_printerr("Paste: %s\n", err->message);
+            paste_finish(p);
+        }
+        else {
+            p->in = g_object_ref(in);
+            paste_schedule(p);
+        }
+    }
+    g_clear_error(&err);
+    g_clear_object(&in);
+    paste_release(p);
+}
+
+static void paste_detach(gpointer data) {
+    Paste* p = data;
+    if (p->vt) {
+        // the terminal is going away without paste_cancel()
+        p->vt = NULL;
+        g_cancellable_cancel(p->cancel);
+        if (p->watch_id)
+            g_source_remove(p->watch_id);
+        p->watch_id = 0;
+        p->progress = NULL;  // gone with the tab
+        p->stop = NULL;
+    }
+    paste_release(p);
+}
+
+void paste_clipboard_async(VteTerminal* vt) {
+    if (g_object_get_data(G_OBJECT(vt), PASTE_KEY)) {
+        g_print("Paste already in progress in this tab\n");
+        return;
+    }
+
+    Paste* p = g_rc_box_new0(Paste);
+    p->vt = vt;
+    p->cancel = g_cancellable_new();
+    p->pending = g_byte_array_new();
+    g_object_set_data_full(G_OBJECT(vt), PASTE_KEY, p, paste_detach);
+
+    static const char* mime_types[] = {"text/plain;charset=utf-8", "text/plain", NULL};
+    gdk_clipboard_read_async(gtk_widget_get_clipboard(GTK_WIDGET(vt)), mime_types, G_PRIORITY_DEFAULT, p->cancel,
+                             on_clipboard_stream, g_rc_box_acquire(p));
+}
+
+void paste_cancel(VteTerminal* vt) {
+    Paste* p = g_object_get_data(G_OBJECT(vt), PASTE_KEY);
+    if (p)
+        paste_finish(p);
+}
@@ -0,0 +1,13 @@
+#ifndef PASTE_H
+#define PASTE_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+void paste_clipboard_async(VteTerminal* vt);
+void paste_cancel(VteTerminal* vt);
+
+G_END_DECLS
+
+#endif  // PASTE_H
@@ -0,0 +1,512 @@
+#include "record.h"
+#include "tab.h"
+
+#include <glib-unix.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+// Tab recordings (--record, Ctrl+Shift+R). VTE reads its PTY itself and has
+// no tap on the bytes, so a recorded tab gets two PTYs: the shell runs on its
+// own one, and a relay thread copies between that PTY's master and the slave
+// of the terminal's PTY, in raw mode, stamping each read of shell output. The
+// main thread is not involved. Output goes into asciicast v2 event lines that
+// a writer thread of the recording appends to a zstd stream in batches; while
+// more than RECORD_PENDING_MAX waits for it, the relay stops reading the
+// shell, which then blocks on its PTY. Output that is not UTF-8 is stored as
+// "b" events with base64 data, so a replay feeds exactly the bytes the shell
+// wrote.
+
+#define RECORD_KEY "1term-record"
+#define RECORD_RELAY_BUF 65536
+#define RECORD_BATCH (256 << 10)             // event text handed to the writer at once
+#define RECORD_FLUSH_US (1 * G_USEC_PER_SEC)  // ... or after this long, so a crash loses little
+#define RECORD_PENDING_MAX (8 << 20)         // event text waiting for the writer before the shell waits
+#define RECORD_POLL_MS 100                   // window size checks while idle
+#define RECORD_LEVEL 3
+
+gboolean record_all_tabs = FALSE;
+static gboolean record_next_tab = FALSE;
+
+typedef struct {
+    guint8 data[RECORD_RELAY_BUF];
+    gsize off;
+    gsize len;
+} RelayBuf;
+
+// Shared by the relay thread and its writer thread (atomic refcount)
+typedef struct {
+    // relay thread only
+    int outer;       // slave of the terminal's PTY; VTE reads the master
+    VtePty* inner;   // the shell's PTY
+    int wake[2];     // record_shutdown() stops the relay through this pipe
+    GThread* thread;
+    gint64 start_us;
+    gint64 last_flush_us;
+    guint8 carry[4];  // start of a UTF-8 character continued in the next read
+    gsize carry_len;
+    struct winsize size;
+
+    // relay thread and writer thread
+    GMutex lock;
+    GCond cond;
+    GString* pending;    // event lines not handed to the writer yet
+    gboolean flush;      // the writer should take pending
+    gboolean throttled;  // the relay waits for the writer to take pending
+    gboolean closing;    // the relay has ended; the next write ends the stream
+    gint stop;
+
+    // writer thread
+    int fd;
+    ZSTD_CCtx* cctx;
+    gchar* path;
+    gboolean failed;
+} Recording;
+
+// Relays running, for record_shutdown()
+static GMutex live_lock;
+static GList* live = NULL;
+
+static void recording_clear(gpointer data) {
+    Recording* rec = data;
+    if (rec->outer >= 0)
+        close(rec->outer);
+    g_clear_object(&rec->inner);
+    if (rec->wake[0] >= 0) {
+        close(rec->wake[0]);
+        close(rec->wake[1]);
+    }
+    g_mutex_clear(&rec->lock);
+    g_cond_clear(&rec->cond);
+    if (rec->pending)
+        g_string_free(rec->pending, TRUE);
+    if (rec->fd >= 0)
+        close(rec->fd);
+    ZSTD_freeCCtx(rec->cctx);
+    g_free(rec->path);
+}
+
+static void recording_unref(gpointer data) {
+    g_atomic_rc_box_release_full(data, recording_clear);
+}
+
+/* ── Writing (writer thread) ─────────────────────────────────────────────── */
+
+static gboolean write_all(int fd, const void* data, gsize len) {
+    const guint8* p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+        p += n;
+        len -= (gsize)n;
+    }
+    return TRUE;
+}
+
+// Compress one batch; each is flushed to the file, so a recording is readable up to its last batch.
+static void record_write(Recording* rec, GString* batch, gboolean end) {
+    if (rec->failed)
+        return;
+    guint8 out[RECORD_RELAY_BUF];
+    ZSTD_inBuffer in = {batch->str, batch->len, 0};
+    size_t left;
+    do {
+        ZSTD_outBuffer o = {out, sizeof(out), 0};
+        left = ZSTD_compressStream2(rec->cctx, &o, &in, end ? ZSTD_e_end : ZSTD_e_flush);
+        if (ZSTD_isError(left) || !write_all(rec->fd, out, o.pos)) {
+            g_printerr("Recording %s: %s\n", rec->path,
+                       ZSTD_isError(left) ? ZSTD_getErrorName(left) : g_strerror(errno));
+            rec->failed = TRUE;
+            return;
+        }
+    } while (left > 0 || in.pos < in.size);
+}
+
+// Started and joined by the relay thread, which holds the reference.
+static gpointer record_writer_thread(gpointer data) {
+    Recording* rec = data;
+    g_mutex_lock(&rec->lock);
+    for (;;) {
+        while (!rec->flush && !rec->closing)
+            g_cond_wait(&rec->cond, &rec->lock);
+        gboolean end = rec->closing;
+        GString* batch = rec->pending;
+        rec->pending = g_string_sized_new(RECORD_BATCH + RECORD_RELAY_BUF);
+        rec->flush = FALSE;
+        if (rec->throttled) {
+            rec->throttled = FALSE;
+            write_all(rec->wake[1], "x", 1);
+        }
+        g_mutex_unlock(&rec->lock);
+
+        record_write(rec, batch, end);
+        g_string_free(batch, TRUE);
+        if (end)
+            break;
+        g_mutex_lock(&rec->lock);
+    }
+    close(rec->fd);
+    rec->fd = -1;
+    return NULL;
+}
+
+// Wake the writer to take the pending events (lock held).
+static void record_kick_locked(Recording* rec) {
+    rec->flush = TRUE;
+    g_cond_signal(&rec->cond);
+}
+
+// Too much waiting for the writer? It then wakes the relay once it has taken it.
+static gboolean record_over_cap(Recording* rec) {
+    g_mutex_lock(&rec->lock);
+    gboolean full = rec->pending->len >= RECORD_PENDING_MAX;
+    rec->throttled = full;
+    g_mutex_unlock(&rec->lock);
+    return full;
+}
+
+/* ── Events (relay thread) ───────────────────────────────────────────────── */
+
+static void append_json_string(GString* out, const guint8* p, gsize len) {
+    static const char hex[] = "0123456789abcdef";
+    g_string_append_c(out, '"');
+    for (gsize i = 0; i < len; i++) {
+        guint8 c = p[i];
+        if (c == '"' || c == '\\') {
+            g_string_append_c(out, '\\');
+            g_string_append_c(out, (char)c);
+        }
+        else if (c == '\n') {
+            g_string_append(out, "\\n");
+        }
+        else if (c == '\r') {
+            g_string_append(out, "\\r");
+        }
+        else if (c < 0x20 || c == 0x7f) {
+            char esc[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            g_string_append_len(out, esc, sizeof(esc));
+        }
+        else {
+            g_string_append_c(out, (char)c);
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+// The first n bytes of a UTF-8 character that continues after them?
+static gboolean utf8_incomplete(const guint8* p, gsize n) {
+    if (n == 0)
+        return FALSE;
+    gsize need = 0;
+    if (p[0] >= 0xc2 && p[0] < 0xe0)
+        need = 2;
+    else if (p[0] >= 0xe0 && p[0] < 0xf0)
+        need = 3;
+    else if (p[0] >= 0xf0 && p[0] <= 0xf4)
+        need = 4;
+    if (n >= need)
+        return FALSE;
+    for (gsize i = 1; i < n; i++) {
+        if ((p[i] & 0xc0) != 0x80)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static void record_event(Recording* rec, gint64 now, const char* code, const guint8* data, gsize len, gboolean raw) {
+    g_mutex_lock(&rec->lock);
+    g_string_append_printf(rec->pending, "[%.6f, \"%s\", ", (now - rec->start_us) / (double)G_USEC_PER_SEC, code);
+    if (raw) {
+        g_string_append_c(rec->pending, '"');
+        g_string_append_len(rec->pending, (const char*)data, len);
+        g_string_append_c(rec->pending, '"');
+    }
+    else {
+        append_json_string(rec->pending, data, len);
+    }
+    g_string_append(rec->pending, "]\n");
+    if (rec->pending->len >= RECORD_BATCH) {
+        record_kick_locked(rec);
+        rec->last_flush_us = now;
+    }
+    g_mutex_unlock(&rec->lock);
+}
+
+static void record_output(Recording* rec, const guint8* buf, gsize n) {
+    gint64 now = g_get_monotonic_time();
+    guint8 joined[RECORD_RELAY_BUF + sizeof(rec->carry)];
+    const guint8* data = buf;
+    gsize len = n;
+    if (rec->carry_len) {
+        memcpy(joined, rec->carry, rec->carry_len);
+        memcpy(joined + rec->carry_len, buf, n);
+        data = joined;
+        len = rec->carry_len + n;
+        rec->carry_len = 0;
+    }
+
+    const gchar* end = NULL;
+    gsize good = g_utf8_validate_len((const gchar*)data, len, &end) ? len : (gsize)(end - (const gchar*)data);
+    if (good < len && !utf8_incomplete(data + good, len - good)) {
+        gchar* b64 = g_base64_encode(data, len);
+        record_event(rec, now, "b", (const guint8*)b64, strlen(b64), TRUE);
+        g_free(b64);
+        return;
+    }
+    if (good > 0)
+        record_event(rec, now, "o", data, good, FALSE);
+    rec->carry_len = len - good;
+    memcpy(rec->carry, data + good, rec->carry_len);
+}
+
+// Follow the terminal's size: VTE resizes its own PTY, the shell needs the change on its PTY.
+static void record_check_size(Recording* rec) {
+    struct winsize ws;
+    if (ioctl(rec->outer, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 ||
+        (ws.ws_col == rec->size.ws_col && ws.ws_row == rec->size.ws_row))
+        return;
+    rec->size = ws;
+    ioctl(vte_pty_get_fd(rec->inner), TIOCSWINSZ, &ws);
+    char size[32];
+    int len = g_snprintf(size, sizeof(size), "%ux%u", ws.ws_col, ws.ws_row);
+    record_event(rec, g_get_monotonic_time(), "r", (const guint8*)size, (gsize)len, FALSE);
+}
+
+/* ── Relay thread ────────────────────────────────────────────────────────── */
+
+// Read from fd into an empty buf; FALSE once fd is closed (EIO from a PTY).
+static gboolean relay_read(int fd, RelayBuf* buf) {
+    ssize_t n = read(fd, buf->data, sizeof(buf->data));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return TRUE;
+    if (n <= 0)
+        return FALSE;
+    buf->off = 0;
+    buf->len = (gsize)n;
+    return TRUE;
+}
+
+static gboolean relay_write(int fd, RelayBuf* buf) {
+    ssize_t n = write(fd, buf->data + buf->off, buf->len);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return TRUE;
+    if (n <= 0)
+        return FALSE;
+    buf->off += (gsize)n;
+    buf->len -= (gsize)n;
+    return TRUE;
+}
+
+static gpointer relay_thread(gpointer data) {
+    Recording* rec = data;
+    int inner = vte_pty_get_fd(rec->inner);
+    RelayBuf* to_term = g_new0(RelayBuf, 1);
+    RelayBuf* to_shell = g_new0(RelayBuf, 1);
+    gboolean shell_open = TRUE;
+    GThread* writer = g_thread_new("1term-record-writer", record_writer_thread, rec);
+
+    // nothing waits on a full side: output keeps flowing while the shell is not reading input
+    while (!g_atomic_int_get(&rec->stop) && (shell_open || to_term->len > 0)) {
+        gboolean full = shell_open && !to_term->len && record_over_cap(rec);
+        struct pollfd fds[3] = {
+            {inner, (shell_open && !to_term->len && !full ? POLLIN : 0) | (to_shell->len ? POLLOUT : 0), 0},
+            {rec->outer, (!to_shell->len ? POLLIN : 0) | (to_term->len ? POLLOUT : 0), 0},
+            {rec->wake[0], POLLIN, 0},
+        };
+        if (!fds[0].events)
+            fds[0].fd = -1;  // a hung-up shell PTY would wake poll() while VTE catches up
+        if (poll(fds, G_N_ELEMENTS(fds), RECORD_POLL_MS) < 0 && errno != EINTR)
+            break;
+        record_check_size(rec);
+        if (fds[2].revents & POLLIN) {
+            char drain[16];
+            if (read(rec->wake[0], drain, sizeof(drain)) < 0 && errno != EINTR)
+                break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (!to_term->len) {
+                shell_open = relay_read(inner, to_term);
+                if (to_term->len)
+                    record_output(rec, to_term->data, to_term->len);
+            }
+        }
+        // VTE closed its side: the tab is gone
+        if ((fds[1].revents & (POLLIN | POLLHUP | POLLERR)) && !to_shell->len && !relay_read(rec->outer, to_shell))
+            break;
+        if (to_term->len && !relay_write(rec->outer, to_term))
+            break;
+        if (to_shell->len && !relay_write(inner, to_shell))
+            to_shell->len = 0;  // the shell is gone; drop its input
+
+        gint64 now = g_get_monotonic_time();
+        if (now - rec->last_flush_us >= RECORD_FLUSH_US) {
+            g_mutex_lock(&rec->lock);
+            if (rec->pending->len)
+                record_kick_locked(rec);
+            g_mutex_unlock(&rec->lock);
+            rec->last_flush_us = now;
+        }
+    }
+    g_free(to_term);
+    g_free(to_shell);
+
+    // VTE sees EOF once our end of its PTY is closed, and the shell a hangup once its master is
+    close(rec->outer);
+    rec->outer = -1;
+    g_clear_object(&rec->inner);
+
+    g_mutex_lock(&rec->lock);
+    rec->closing = TRUE;
+    g_cond_signal(&rec->cond);
+    g_mutex_unlock(&rec->lock);
+    g_thread_join(writer);
+
+    g_mutex_lock(&live_lock);
+    live = g_list_remove(live, rec);
+    g_thread_unref(rec->thread);
+    g_mutex_unlock(&live_lock);
+    recording_unref(rec);
+    return NULL;
+}
+
+/* ── Main thread ─────────────────────────────────────────────────────────── */
+
+// Should the tab being set up now be recorded?
+gboolean record_wanted(void) {
+    return record_all_tabs || record_next_tab;
+}
+
+// A new tab in notebook whose shell is recorded.
+VteTerminal* record_new_tab(GtkNotebook* notebook) {
+    record_next_tab = TRUE;
+    VteTerminal* vt = add_tab(notebook);
+    record_next_tab = FALSE;
+    return vt;
+}
+
+static int record_open_file(gchar** path_out) {
+    gchar* dir = g_build_filename(g_get_home_dir(), ".1term", "recordings", NULL);
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        g_printerr("mkdir %s: %s\n", dir, g_strerror(errno));
+        g_free(dir);
+        return -1;
+    }
+    GDateTime* now = g_date_time_new_now_local();
+    gchar* stamp = g_date_time_format(now, "%Y%m%d_%H%M%S");
+    g_date_time_unref(now);
+
+    int fd = -1;
+    for (int i = 1; fd < 0 && i < 100; i++) {
+        gchar* name =
+            i == 1 ? g_strdup_printf("tab_%s.cast.zst", stamp) : g_strdup_printf("tab_%s_%d.cast.zst", stamp, i);
+        g_free(*path_out);
+        *path_out = g_build_filename(dir, name, NULL);
+        g_free(name);
+        fd = g_open(*path_out, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0 && errno != EEXIST)
+            break;
+    }
+    if (fd < 0)
+        g_printerr("open %s: %s\n", *path_out, g_strerror(errno));
+    g_free(stamp);
+    g_free(dir);
+    return fd;
+}
+
+// Our end of the terminal's PTY, raw so the relay passes bytes unchanged both ways.
+static int record_open_outer(VtePty* pty) {
+    int fd = ioctl(vte_pty_get_fd(pty), TIOCGPTPEER, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        tio.c_iflag &= ~(tcflag_t)(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+        tio.c_oflag &= ~(tcflag_t)OPOST;
+        tio.c_lflag &= ~(tcflag_t)(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+        tio.c_cflag = (tio.c_cflag & ~(tcflag_t)(CSIZE | PARENB)) | CS8;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// vt's PTY is set and the shell is about to be spawned on shell_pty: get the recording ready.
+// FALSE if it cannot be recorded; the shell should then run on vt's PTY as usual.
+gboolean record_prepare(VteTerminal* vt, VtePty* shell_pty) {
+    VtePty* term_pty = vte_terminal_get_pty(vt);
+    Recording* rec = g_atomic_rc_box_new0(Recording);
+    rec->outer = -1;
+    rec->wake[0] = rec->wake[1] = -1;
+    rec->fd = -1;
+    g_mutex_init(&rec->lock);
+    g_cond_init(&rec->cond);
+    g_object_set_data_full(G_OBJECT(vt), RECORD_KEY, rec, recording_unref);
+
+    rec->outer = term_pty ? record_open_outer(term_pty) : -1;
+    if (rec->outer < 0) {
+        g_printerr("Recording: cannot open the terminal's PTY: %s\n", g_strerror(errno));
+        g_object_set_data(G_OBJECT(vt), RECORD_KEY, NULL);
+        return FALSE;
+    }
+    rec->fd = record_open_file(&rec->path);
+    if (rec->fd < 0) {
+        g_object_set_data(G_OBJECT(vt), RECORD_KEY, NULL);
+        return FALSE;
+    }
+
+    rec->inner = g_object_ref(shell_pty);
+    rec->size.ws_col = (unsigned short)vte_terminal_get_column_count(vt);
+    rec->size.ws_row = (unsigned short)vte_terminal_get_row_count(vt);
+    ioctl(vte_pty_get_fd(shell_pty), TIOCSWINSZ, &rec->size);
+    int flags = fcntl(vte_pty_get_fd(shell_pty), F_GETFL);
+    fcntl(vte_pty_get_fd(shell_pty), F_SETFL, flags | O_NONBLOCK);
+
+    rec->cctx = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(rec->cctx, ZSTD_c_compressionLevel, RECORD_LEVEL);
+    ZSTD_CCtx_setParameter(rec->cctx, ZSTD_c_checksumFlag, 1);
+    rec->pending = g_string_sized_new(RECORD_BATCH + RECORD_RELAY_BUF);
+    g_string_append_printf(rec->pending,
+                           "{\"version\": 2, \"width\": %u, \"height\": %u, \"timestamp\": %" G_GINT64_FORMAT
+                           ", \"env\": {\"TERM\": \"xterm-256color\"}, \"title\": \"1term\"}\n",
+                           rec->size.ws_col, rec->size.ws_row, g_get_real_time() / G_USEC_PER_SEC);
+    return TRUE;
+}
+
+// The shell is running: start relaying. Before that, its PTY has no slave open and reads as closed.
+void record_start(VteTerminal* vt) {
+    Recording* rec = g_object_get_data(G_OBJECT(vt), RECORD_KEY);
+    if (!rec || !rec->inner || rec->thread)
+        return;
+    GError* err = NULL;
+    if (!g_unix_open_pipe(rec->wake, FD_CLOEXEC, &err)) {
+        g_printerr("Recording: %s\n", err->message);
+        g_clear_error(&err);
+        return;
+    }
+    rec->start_us = rec->last_flush_us = g_get_monotonic_time();
+
+    g_mutex_lock(&live_lock);
+    rec->thread = g_thread_new("1term-record", relay_thread, g_atomic_rc_box_acquire(rec));
+    live = g_list_prepend(live, rec);
+    g_mutex_unlock(&live_lock);
+    g_print("Recording tab to %s\n", rec->path);
+}
+
+// At exit: stop the relays; each returns once its writer has ended the stream.
+void record_shutdown(void) {
+    GList* threads = NULL;
+    g_mutex_lock(&live_lock);
+    for (GList* l = live; l; l = l->next) {
+        Recording* rec = l->data;
+        g_atomic_int_set(&rec->stop, TRUE);
+        write_all(rec->wake[1], "x", 1);
+        threads = g_list_prepend(threads, g_thread_ref(rec->thread));
+    }
+    g_mutex_unlock(&live_lock);
+    for (GList* l = threads; l; l = l->next)
+        g_thread_join(l->data);
+    g_list_free(threads);
+}
@@ -0,0 +1,18 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+extern gboolean record_all_tabs;
+
+gboolean record_wanted(void);
+VteTerminal* record_new_tab(GtkNotebook* notebook);
+gboolean record_prepare(VteTerminal* vt, VtePty* shell_pty);
+void record_start(VteTerminal* vt);
+void record_shutdown(void);
+
+G_END_DECLS
+
+#endif  // RECORD_H
@@ -0,0 +1,283 @@
+#include "config.h"
+#include "renderbench.h"
+#include "tab.h"
+
+#include <sys/ioctl.h>
+
+// Reproducible rendering benchmark. `--render-bench=WORKLOAD` opens one window
+// whose tab runs this binary again as `--render-bench-gen WORKLOAD` instead of
+// the shell. The generator writes a fixed, seeded byte stream modelled on the
+// vtebench categories and exits; the terminal side times from the first
+// contents change to child-exited (which VTE emits only after reading the PTY
+// to EOF), collects every after-paint of the window's frame clock in between,
+// prints one line of JSON on stdout and quits. meson.build runs each workload
+// as a benchmark() target.
+
+#define RENDER_BENCH_BYTES (16 * 1024 * 1024)
+#define RENDER_BENCH_SEED 1
+#define RENDER_BENCH_FLUSH 65536
+#define RENDER_BENCH_TIMEOUT_S 240
+#define RENDER_BENCH_GEN_FLAG "--render-bench-gen"
+
+typedef void (*RenderBenchGen)(GString* out, GRand* rand, int columns, int rows);
+
+typedef struct {
+    const char* name;
+    const char* prologue;  // printf format, given the rows
+    RenderBenchGen step;   // appends one unit of the workload
+} RenderBenchWorkload;
+
+static void gen_dense_cells(GString* out, GRand* rand, int columns, int rows) {
+    // every cell with its own colors and attributes, a full screen at a time
+    static const char* const attrs[] = {"", ";1", ";3", ";4", ";1;3;4", ";7"};
+    g_string_append(out, "\033[H");
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            const char* attr = attrs[g_rand_int_range(rand, 0, G_N_ELEMENTS(attrs))];
+            g_string_append_printf(out, "\033[38;5;%d;48;5;%d%sm%c", g_rand_int_range(rand, 0, 256),
+                                   g_rand_int_range(rand, 0, 256), attr, g_rand_int_range(rand, '!', '~' + 1));
+        }
+    }
+}
+
+static void gen_line(GString* out, GRand* rand, int columns, int rows) {
+    int len = g_rand_int_range(rand, 1, columns + 1);
+    for (int i = 0; i < len; i++)
+        g_string_append_c(out, (char)g_rand_int_range(rand, ' ', '~' + 1));
+    g_string_append_c(out, '\n');
+}
+
+static void gen_unicode(GString* out, GRand* rand, int columns, int rows) {
+    // wide CJK, emoji, combining marks, box drawing and other scripts, mixed on one line
+    static const char* const pieces[] = {
+        "日本語の文字", "한국어", "中文字符", "😀🚀🎉", "éäô", "─│┌┐└┘├┤┼", "Ελληνικά", "Кириллица",
+        "∀x∈ℝ: x²≥0", "ｆｕｌｌｗｉｄｔｈ", "👩‍💻", "ascii",
+    };
+    int n = MAX(columns / 8, 1);
+    for (int i = 0; i < n; i++) {
+        g_string_append(out, pieces[g_rand_int_range(rand, 0, G_N_ELEMENTS(pieces))]);
+        g_string_append_c(out, ' ');
+    }
+    g_string_append_c(out, '\n');
+}
+
+static void gen_cursor_motion(GString* out, GRand* rand, int columns, int rows) {
+    g_string_append_printf(out, "\033[%d;%dH%c", g_rand_int_range(rand, 1, rows + 1),
+                           g_rand_int_range(rand, 1, columns + 1), g_rand_int_range(rand, '!', '~' + 1));
+}
+
+static const RenderBenchWorkload workloads[] = {
+    {"dense_cells", "\033[2J", gen_dense_cells},
+    {"scrolling", "\033[2J\033[%d;1H", gen_line},
+    {"scrolling_region", "\033[2J\033[2;%1$dr\033[%1$d;1H", gen_line},  // a fixed line above and below
+    {"unicode", "\033[2J\033[%d;1H", gen_unicode},
+    {"cursor_motion", "\033[2J", gen_cursor_motion},
+};
+
+static const RenderBenchWorkload* find_workload(const char* name) {
+    for (guint i = 0; i < G_N_ELEMENTS(workloads); i++) {
+        if (g_str_equal(workloads[i].name, name))
+            return &workloads[i];
+    }
+    return NULL;
+}
+
+static gboolean write_all(int fd, const char* data, gsize len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+        data += n;
+        len -= (gsize)n;
+    }
+    return TRUE;
+}
+
+// Child of --render-bench: write the workload to stdout (the PTY) and exit.
+int render_bench_generate(const char* name) {
+    const RenderBenchWorkload* w = find_workload(name);
+    if (!w) {
+        g_printerr("%s: unknown workload %s\n", RENDER_BENCH_GEN_FLAG, name);
+        return 2;
+    }
+    struct winsize ws = {0};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 || ws.ws_row == 0) {
+        ws.ws_col = 80;
+        ws.ws_row = 24;
+    }
+    int columns = ws.ws_col, rows = ws.ws_row;
+
+    GRand* rand = g_rand_new_with_seed(RENDER_BENCH_SEED);
+    GString* out = g_string_sized_new(RENDER_BENCH_FLUSH * 2);
+    g_string_append_printf(out, w->prologue, rows - 1);
+    gsize total = 0;
+    gboolean ok = TRUE;
+    while (ok && total < RENDER_BENCH_BYTES) {
+        w->step(out, rand, columns, rows);
+        if (out->len >= RENDER_BENCH_FLUSH) {
+            ok = write_all(STDOUT_FILENO, out->str, out->len);
+            total += out->len;
+            g_string_truncate(out, 0);
+        }
+    }
+    g_string_append(out, "\033[0m\033[r\033[2J\033[H");
+    ok = ok && write_all(STDOUT_FILENO, out->str, out->len);
+
+    g_string_free(out, TRUE);
+    g_rand_free(rand);
+    return ok ? 0 : 1;
+}
+
+// Terminal side
+static const RenderBenchWorkload* workload = NULL;
+static char* command[4];
+static gboolean watching_window = FALSE;
+static gboolean watching_terminal = FALSE;
+static const char* renderer_name = "none";
+static gint64 start_time = 0;
+static gint64 end_time = 0;
+static gint64 last_frame_time = 0;
+static GArray* paint_ms = NULL;
+static GArray* interval_ms = NULL;
+
+// Run workload in the first window instead of the shell; FALSE if there is no such workload.
+gboolean render_bench_set_workload(const char* name) {
+    workload = find_workload(name);
+    if (!workload) {
+        g_printerr("--render-bench: unknown workload %s; one of:", name);
+        for (guint i = 0; i < G_N_ELEMENTS(workloads); i++)
+            g_printerr(" %s", workloads[i].name);
+        g_printerr("\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// The first tab's command in benchmark mode, NULL (the shell) otherwise
+char** render_bench_command(void) {
+    if (!workload)
+        return NULL;
+    if (!command[0]) {
+        command[0] = g_file_read_link("/proc/self/exe", NULL);
+        if (!command[0]) {
+            g_printerr("--render-bench: cannot find our own executable\n");
+            exit(1);
+        }
+        command[1] = RENDER_BENCH_GEN_FLAG;
+        command[2] = (char*)workload->name;
+    }
+    return command;
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(GArray* sorted, double p) {
+    if (sorted->len == 0)
+        return 0;
+    guint rank = (guint)(p * sorted->len + 0.999999);
+    return g_array_index(sorted, double, CLAMP(rank, 1, sorted->len) - 1);
+}
+
+static void print_distribution(GString* json, const char* name, GArray* values) {
+    g_array_sort(values, compare_double);
+    g_string_append_printf(json, ", \"%s\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}", name,
+                           percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99),
+                           percentile(values, 1.0));
+}
+
+static void render_bench_report(VteTerminal* vt, int status) {
+    double wall_ms = (end_time - start_time) / 1000.0;
+    gchar* font = pango_font_description_to_string(vte_terminal_get_font(vt));
+
+    GString* json = g_string_new(NULL);
+    g_string_append_printf(json, "{\"workload\": \"%s\", \"version\": \"%s\", \"status\": %d", workload->name,
+                           ONETERM_VERSION, status);
+    g_string_append_printf(json, ", \"columns\": %ld, \"rows\": %ld, \"font\": \"%s\", \"renderer\": \"%s\"",
+                           vte_terminal_get_column_count(vt), vte_terminal_get_row_count(vt), font, renderer_name);
+    g_string_append_printf(json, ", \"page\": \"%s\"", tab_overlay_scrollbar ? "overlay" : "scrolled");
+    g_string_append_printf(json, ", \"bytes\": %d, \"wall_ms\": %.3f, \"mib_per_s\": %.3f", RENDER_BENCH_BYTES, wall_ms,
+                           wall_ms > 0 ? RENDER_BENCH_BYTES / 1048576.0 / (wall_ms / 1000.0) : 0);
+    g_string_append_printf(json, ", \"frames\": %u, \"fps\": %.2f", paint_ms->len,
+                           wall_ms > 0 ? paint_ms->len / (wall_ms / 1000.0) : 0);
+    print_distribution(json, "paint_ms", paint_ms);
+    print_distribution(json, "interval_ms", interval_ms);
+    g_string_append(json, "}\n");
+
+    g_print("%s", json->str);
+    fflush(stdout);
+    g_string_free(json, TRUE);
+    g_free(font);
+}
+
+static void on_bench_paint(GdkFrameClock* clock, gpointer unused) {
+    if (!start_time || end_time)
+        return;
+    gint64 now = g_get_monotonic_time();
+    gint64 frame_time = gdk_frame_clock_get_frame_time(clock);
+    double paint = (now - frame_time) / 1000.0;
+    g_array_append_val(paint_ms, paint);
+    if (last_frame_time) {
+        double interval = (frame_time - last_frame_time) / 1000.0;
+        g_array_append_val(interval_ms, interval);
+    }
+    last_frame_time = frame_time;
+}
+
+static void on_bench_window_realize(GtkWidget* win, gpointer unused) {
+    g_signal_handlers_disconnect_by_func(win, on_bench_window_realize, unused);
+    // the window is gone by the time the report is printed
+    GskRenderer* renderer = gtk_native_get_renderer(GTK_NATIVE(win));
+    if (renderer)
+        renderer_name = G_OBJECT_TYPE_NAME(renderer);
+    GdkFrameClock* clock = gtk_widget_get_frame_clock(win);
+    if (clock)
+        g_signal_connect(clock, "after-paint", G_CALLBACK(on_bench_paint), NULL);
+}
+
+void render_bench_watch_window(GtkWidget* win) {
+    if (!workload || watching_window)
+        return;
+    watching_window = TRUE;
+    paint_ms = g_array_new(FALSE, FALSE, sizeof(double));
+    interval_ms = g_array_new(FALSE, FALSE, sizeof(double));
+    g_signal_connect(win, "realize", G_CALLBACK(on_bench_window_realize), NULL);
+}
+
+static void on_bench_contents(VteTerminal* vt, gpointer unused) {
+    if (!start_time)
+        start_time = g_get_monotonic_time();
+}
+
+static void on_bench_exit(VteTerminal* vt, int status, gpointer unused) {
+    end_time = g_get_monotonic_time();
+    if (!start_time)
+        start_time = end_time;
+    render_bench_report(vt, status);
+    // keep the tab, and the window with it, open until the application quits
+    g_signal_stop_emission_by_name(vt, "child-exited");
+    if (status != 0)
+        exit(1);
+    GApplication* app = g_application_get_default();
+    if (app)
+        g_application_quit(app);
+}
+
+static gboolean on_bench_timeout(gpointer unused) {
+    g_printerr("--render-bench: %s did not finish within %d s\n", workload->name, RENDER_BENCH_TIMEOUT_S);
+    exit(1);
+    return G_SOURCE_REMOVE;
+}
+
+void render_bench_watch_terminal(VteTerminal* vt) {
+    if (!workload || watching_terminal)
+        return;
+    watching_terminal = TRUE;
+    g_signal_connect(vt, "contents-changed", G_CALLBACK(on_bench_contents), NULL);
+    g_signal_connect(vt, "child-exited", G_CALLBACK(on_bench_exit), NULL);
+    g_timeout_add_seconds(RENDER_BENCH_TIMEOUT_S, on_bench_timeout, NULL);
+}
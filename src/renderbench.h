@@ -0,0 +1,16 @@
+#ifndef RENDERBENCH_H
+#define RENDERBENCH_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+gboolean render_bench_set_workload(const char* name);
+char** render_bench_command(void);
+void render_bench_watch_window(GtkWidget* win);
+void render_bench_watch_terminal(VteTerminal* vt);
+int render_bench_generate(const char* name);
+
+G_END_DECLS
+
+#endif  // RENDERBENCH_H
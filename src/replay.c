@@ -0,0 +1,340 @@
+#include "replay.h"
+#include "tab.h"
+#include "window.h"
+
+// Replay of a tab recording (record.c) or any asciicast v2 file, plain or
+// zstd-compressed, into a tab without a PTY (`--replay=FILE`). A worker thread
+// decompresses and decodes the whole file first, so the main thread only
+// feeds bytes to vte_terminal_feed(): at the recorded pace times
+// --replay-speed, or with --replay-speed=0 as fast as VTE takes them, a
+// bounded amount per main-loop iteration so frames are still drawn in between.
+
+#define REPLAY_KEY "1term-replay"
+#define REPLAY_STEP_BYTES (64 << 10)  // fed per main-loop iteration
+
+typedef struct {
+    gint64 t_us;
+    gsize offset;  // output: bytes in ReplayData.bytes
+    gsize len;
+    guint columns;  // resize: new size; 0 for output
+    guint rows;
+} ReplayEvent;
+
+typedef struct {
+    GByteArray* bytes;
+    GArray* events;
+    guint width;
+    guint height;
+} ReplayData;
+
+typedef struct {
+    VteTerminal* vt;
+    gchar* path;
+    double speed;
+    ReplayData* data;
+    guint next;
+    gint64 start_us;
+    gsize fed;
+    guint source;
+} Replay;
+
+static void replay_data_free(ReplayData* d) {
+    g_byte_array_unref(d->bytes);
+    g_array_unref(d->events);
+    g_free(d);
+}
+
+static void replay_free(gpointer data) {
+    Replay* r = data;
+    if (r->source)
+        g_source_remove(r->source);
+    if (r->data)
+        replay_data_free(r->data);
+    g_free(r->path);
+    g_free(r);
+}
+
+/* ── Decoding (worker thread) ────────────────────────────────────────────── */
+
+static gboolean is_zstd(const guint8* p, gsize len) {
+    return len >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd;
+}
+
+static GByteArray* decompress(const guint8* src, gsize len, GError** error) {
+    GByteArray* out = g_byte_array_sized_new((guint)MIN(len * 8, (gsize)64 << 20));
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    ZSTD_inBuffer in = {src, len, 0};
+    guint8 buf[1 << 17];
+    for (;;) {
+        ZSTD_outBuffer o = {buf, sizeof(buf), 0};
+        size_t ret = ZSTD_decompressStream(dctx, &o, &in);
+        if (ZSTD_isError(ret)) {
+            // a recording cut short by a crash still replays up to its last complete batch
+            if (out->len > 0)
+                break;
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "zstd: %s", ZSTD_getErrorName(ret));
+            ZSTD_freeDCtx(dctx);
+            g_byte_array_unref(out);
+            return NULL;
+        }
+        g_byte_array_append(out, buf, (guint)o.pos);
+        if (in.pos == in.size && o.pos < o.size)
+            break;
+    }
+    ZSTD_freeDCtx(dctx);
+    return out;
+}
+
+// Decode the JSON string at *p (just after its opening quote) into out; *p ends after the closing quote.
+static gboolean json_string(const char** p, const char* end, GByteArray* out) {
+    const char* s = *p;
+    while (s < end && *s != '"') {
+        if (*s != '\\') {
+            const char* run = s;
+            while (s < end && *s != '"' && *s != '\\')
+                s++;
+            g_byte_array_append(out, (const guint8*)run, (guint)(s - run));
+            continue;
+        }
+        if (++s >= end)
+            return FALSE;
+        char c = *s++;
+        char simple = c == 'n' ? '\n' : c == 'r' ? '\r' : c == 't' ? '\t' : c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+        if (c != 'u') {
+            g_byte_array_append(out, (const guint8*)&simple, 1);
+            continue;
+        }
+        gunichar u = 0;
+        for (int i = 0; i < 4; i++, s++) {
+            if (s >= end || !g_ascii_isxdigit(*s))
+                return FALSE;
+            u = u * 16 + (gunichar)g_ascii_xdigit_value(*s);
+        }
+        // surrogate pair
+        if (u >= 0xd800 && u < 0xdc00 && end - s >= 6 && s[0] == '\\' && s[1] == 'u') {
+            gunichar lo = 0;
+            for (int i = 2; i < 6; i++)
+                lo = lo * 16 + (gunichar)(g_ascii_isxdigit(s[i]) ? g_ascii_xdigit_value(s[i]) : 0);
+            if (lo >= 0xdc00 && lo < 0xe000) {
+                u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+                s += 6;
+            }
+        }
+        char utf8[6];
+        g_byte_array_append(out, (const guint8*)utf8, (guint)g_unichar_to_utf8(u, utf8));
+    }
+    if (s >= end)
+        return FALSE;
+    *p = s + 1;
+    return TRUE;
+}
+
+static const char* skip_space(const char* p, const char* end) {
+    while (p < end && g_ascii_isspace(*p))
+        p++;
+    return p;
+}
+
+static guint header_uint(const char* line, const char* end, const char* key) {
+    gchar* found = g_strstr_len(line, end - line, key);
+    if (!found)
+        return 0;
+    const char* p = skip_space(found + strlen(key), end);
+    if (p >= end || *p != ':')
+        return 0;
+    return (guint)g_ascii_strtoull(skip_space(p + 1, end), NULL, 10);
+}
+
+// [time, "code", "data"]
+static void parse_event(const char* p, const char* end, ReplayData* d, GByteArray* scratch) {
+    p = skip_space(p, end);
+    if (p >= end || *p != '[')
+        return;
+    char* after = NULL;
+    double t = g_ascii_strtod(p + 1, &after);
+    p = skip_space(after, end);
+    if (p >= end || *p != ',')
+        return;
+    p = skip_space(p + 1, end);
+    if (end - p < 4 || p[0] != '"' || p[2] != '"')
+        return;
+    char code = p[1];
+    p = skip_space(p + 3, end);
+    if (p >= end || *p != ',')
+        return;
+    p = skip_space(p + 1, end);
+    if (p >= end || *p != '"')
+        return;
+    p++;
+
+    ReplayEvent ev = {.t_us = (gint64)(t * G_USEC_PER_SEC)};
+    if (code == 'o') {
+        ev.offset = d->bytes->len;
+        if (!json_string(&p, end, d->bytes)) {
+            g_byte_array_set_size(d->bytes, (guint)ev.offset);
+            return;
+        }
+        ev.len = d->bytes->len - ev.offset;
+    }
+    else if (code == 'b' || code == 'r') {
+        g_byte_array_set_size(scratch, 0);
+        if (!json_string(&p, end, scratch))
+            return;
+        g_byte_array_append(scratch, (const guint8*)"", 1);
+        if (code == 'r') {
+            if (sscanf((const char*)scratch->data, "%ux%u", &ev.columns, &ev.rows) != 2 || !ev.columns || !ev.rows)
+                return;
+        }
+        else {
+            gsize n = 0;
+            guchar* raw = g_base64_decode((const gchar*)scratch->data, &n);
+            ev.offset = d->bytes->len;
+            ev.len = n;
+            g_byte_array_append(d->bytes, raw, (guint)n);
+            g_free(raw);
+        }
+    }
+    else {
+        return;  // input, markers
+    }
+    g_array_append_val(d->events, ev);
+}
+
+static ReplayData* replay_decode(const char* path, GError** error) {
+    gchar* contents = NULL;
+    gsize len = 0;
+    if (!g_file_get_contents(path, &contents, &len, error))
+        return NULL;
+    GByteArray* text = NULL;
+    if (is_zstd((const guint8*)contents, len)) {
+        text = decompress((const guint8*)contents, len, error);
+        g_free(contents);
+        if (!text)
+            return NULL;
+    }
+    else {
+        text = g_byte_array_new_take((guint8*)contents, len);
+    }
+
+    const char* p = (const char*)text->data;
+    const char* end = p + text->len;
+    const char* eol = memchr(p, '\n', (gsize)(end - p));
+    if (!eol)
+        eol = end;
+    if (header_uint(p, eol, "\"version\"") != 2) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "not an asciicast v2 recording");
+        g_byte_array_unref(text);
+        return NULL;
+    }
+
+    ReplayData* d = g_new0(ReplayData, 1);
+    d->bytes = g_byte_array_sized_new(text->len);
+    d->events = g_array_new(FALSE, FALSE, sizeof(ReplayEvent));
+    d->width = header_uint(p, eol, "\"width\"");
+    d->height = header_uint(p, eol, "\"height\"");
+    GByteArray* scratch = g_byte_array_new();
+    for (p = eol; p < end; p = eol) {
+        p++;
+        eol = memchr(p, '\n', (gsize)(end - p));
+        if (!eol)
+            eol = end;
+        parse_event(p, eol, d, scratch);
+    }
+    g_byte_array_unref(scratch);
+    g_byte_array_unref(text);
+    return d;
+}
+
+static void replay_decode_thread(GTask* task, gpointer source, gpointer task_data, GCancellable* cancel) {
+    GError* err = NULL;
+    ReplayData* d = replay_decode(task_data, &err);
+    if (d)
+        g_task_return_pointer(task, d, (GDestroyNotify)replay_data_free);
+    else
+        g_task_return_error(task, err);
+}
+
+/* ── Feeding (main thread) ───────────────────────────────────────────────── */
+
+static gboolean replay_step(gpointer user_data) {
+    Replay* r = user_data;
+    r->source = 0;
+    TabContext* ctx = tab_context_get(r->vt);
+    if (!ctx || !ctx->notebook)
+        return G_SOURCE_REMOVE;
+
+    gint64 now = g_get_monotonic_time();
+    gsize budget = REPLAY_STEP_BYTES;
+    GArray* events = r->data->events;
+    while (r->next < events->len) {
+        ReplayEvent* ev = &g_array_index(events, ReplayEvent, r->next);
+        if (r->speed > 0) {
+            gint64 due = r->start_us + (gint64)(ev->t_us / r->speed);
+            if (due > now) {
+                r->source = g_timeout_add((guint)((due - now + 999) / 1000), replay_step, r);
+                return G_SOURCE_REMOVE;
+            }
+        }
+        if (budget == 0) {
+            r->source = g_idle_add(replay_step, r);  // below redraw priority: lets a frame through
+            return G_SOURCE_REMOVE;
+        }
+        if (ev->columns)
+            vte_terminal_set_size(r->vt, ev->columns, ev->rows);
+        else
+            vte_terminal_feed(r->vt, (const char*)r->data->bytes->data + ev->offset, (gssize)ev->len);
+        r->fed += ev->len;
+        budget -= MIN(budget, ev->len);
+        r->next++;
+    }
+
+    double ms = (g_get_monotonic_time() - r->start_us) / 1000.0;
+    gchar* size = g_format_size(r->fed);
+    g_print("Replay %s: %u events, %s in %.1f ms (%.1f MiB/s)\n", r->path, events->len, size, ms,
+            ms > 0 ? r->fed / 1048576.0 / (ms / 1000.0) : 0);
+    g_free(size);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_replay_decoded(GObject* source, GAsyncResult* res, gpointer user_data) {
+    Replay* r = user_data;
+    GError* err = NULL;
+    ReplayData* d = g_task_propagate_pointer(G_TASK(res), &err);
+    if (!d) {
+        g_printerr("Replay %s: %s\n", r->path, err->message);
+        g_clear_error(&err);
+        g_object_unref(r->vt);
+        replay_free(r);
+        return;
+    }
+    r->data = d;
+
+    // the window may have been closed while decoding
+    TabContext* ctx = tab_context_get(r->vt);
+    if (!ctx || !ctx->notebook) {
+        g_object_unref(r->vt);
+        replay_free(r);
+        return;
+    }
+    if (d->width && d->height)
+        vte_terminal_set_size(r->vt, d->width, d->height);
+    r->start_us = g_get_monotonic_time();
+    r->source = g_idle_add(replay_step, r);
+    g_object_set_data_full(G_OBJECT(r->vt), REPLAY_KEY, r, replay_free);
+    g_object_unref(r->vt);
+}
+
+// A window with one tab that plays the recording at path; speed 0 feeds it as fast as possible.
+void replay_open(GtkApplication* app, const char* path, double speed) {
+    GtkWidget* win = create_window_bare(app);
+    Replay* r = g_new0(Replay, 1);
+    r->vt = g_object_ref(add_tab_feed(my_window_get_notebook(MY_WINDOW(win))));
+    r->path = g_strdup(path);
+    r->speed = MAX(speed, 0);
+    gtk_window_present(GTK_WINDOW(win));
+
+    GTask* task = g_task_new(NULL, NULL, on_replay_decoded, r);
+    g_task_set_task_data(task, g_strdup(path), g_free);
+    g_task_run_in_thread(task, replay_decode_thread);
+    g_object_unref(task);
+}
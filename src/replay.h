@@ -0,0 +1,12 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+void replay_open(GtkApplication* app, const char* path, double speed);
+
+G_END_DECLS
+
+#endif  // REPLAY_H
@@ -0,0 +1,349 @@
+#include "sessionlog.h"
+#include "clipboard.h"
+#include "logmaint.h"
+#include "logz.h"
+#include "watchdog.h"
+
+// Continuous per-tab logging. The main thread copies finished rows into a
+// per-tab ring buffer at most every SESSION_LOG_BATCH_MS; a single writer
+// thread drains the rings of all tabs into one growing .logz archive per tab.
+
+#define SESSION_LOG_KEY "1term-session-log"
+#define SESSION_LOG_BATCH_MS 200
+#define SESSION_LOG_MAX_ROWS 1000   // rows read from VTE per batch
+#define SESSION_LOG_RING (1 << 20)  // 1 MiB per tab
+#define SESSION_LOG_LEVEL 3
+#define SESSION_LOG_FRAME_MAX_AGE_US (10 * G_USEC_PER_SEC)
+#define SESSION_LOG_AGE_CHECK_US G_USEC_PER_SEC
+
+typedef struct {
+    VteTerminal* vt;  // main thread only; NULL once detached
+    gchar* path;
+    glong logged_row;  // next row to copy out of VTE
+    guint batch_source;
+    gulong changed_handler;
+
+    // ring buffer shared with the writer thread
+    GMutex lock;
+    guint8* ring;
+    gsize tail;  // first unread byte
+    gsize len;   // bytes waiting
+    gboolean closing;   // set with the last push: no more come after it
+    guint queued;       // times s is in writer_queue
+    GByteArray* final;  // on closing, rows the ring had no room for
+
+    // writer thread only
+    LogzWriter* out;
+    gboolean failed;
+} SessionLog;
+
+static GThread* writer_thread = NULL;
+static GAsyncQueue* writer_queue = NULL;
+static char writer_quit_marker;
+#define WRITER_QUIT ((gpointer)&writer_quit_marker)
+
+// Sessions that have not been handed to the writer for closing yet (main thread only)
+static GList* live_sessions = NULL;
+
+// Sessions with an open archive (writer thread only)
+static GList* open_sessions = NULL;
+
+static gboolean session_log_open(SessionLog* s) {
+    gchar* dir = g_path_get_dirname(s->path);
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        g_printerr("mkdir %s: %s\n", dir, g_strerror(errno));
+        g_free(dir);
+        return FALSE;
+    }
+    g_free(dir);
+
+    int fd = g_open(s->path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        g_printerr("open %s: %s\n", s->path, g_strerror(errno));
+        return FALSE;
+    }
+    LogzOptions opts = {.level = SESSION_LOG_LEVEL, .dict = logz_dict_get_current()};
+    s->out = logz_writer_new_full(fd, s->path, &opts);
+    if (s->out)
+        open_sessions = g_list_prepend(open_sessions, s);
+    return s->out != NULL;
+}
+
+// Close a quiet tab's partial frame after a while so the growing .logz stays current on disk.
+static void session_log_flush_aged(SessionLog* s) {
+    gint64 pending = s->failed ? 0 : logz_writer_pending_since(s->out);
+    if (pending && g_get_real_time() - pending >= SESSION_LOG_FRAME_MAX_AGE_US && !logz_writer_flush(s->out))
+        s->failed = TRUE;
+}
+
+static void session_log_free(SessionLog* s) {
+    open_sessions = g_list_remove(open_sessions, s);
+    g_mutex_clear(&s->lock);
+    if (s->final)
+        g_byte_array_unref(s->final);
+    g_free(s->ring);
+    g_free(s->path);
+    g_free(s);
+}
+
+// Writer thread: move everything queued in the ring into the archive.
+static void session_log_drain(SessionLog* s) {
+    g_mutex_lock(&s->lock);
+    s->queued--;  // output from now on queues s again
+    g_mutex_unlock(&s->lock);
+
+    if (!s->out && !s->failed && !session_log_open(s))
+        s->failed = TRUE;
+
+    for (;;) {
+        g_mutex_lock(&s->lock);
+        gsize tail = s->tail;
+        gsize avail = MIN(s->len, SESSION_LOG_RING - tail);  // contiguous part
+        g_mutex_unlock(&s->lock);
+        if (avail == 0)
+            break;
+
+        // the producer never touches [tail, tail + avail) until we release it
+        if (!s->failed && !logz_writer_append(s->out, s->ring + tail, avail))
+            s->failed = TRUE;
+
+        g_mutex_lock(&s->lock);
+        s->tail = (s->tail + avail) % SESSION_LOG_RING;
+        s->len -= avail;
+        g_mutex_unlock(&s->lock);
+    }
+
+    // full frames are written as they fill up
+    if (s->out)
+        session_log_flush_aged(s);
+
+    // the main thread is done with s once it has queued it for closing; the last entry frees it
+    g_mutex_lock(&s->lock);
+    gboolean last = s->closing && s->queued == 0;
+    g_mutex_unlock(&s->lock);
+
+    if (last) {
+        if (s->out && s->final && !s->failed && !logz_writer_append(s->out, s->final->data, s->final->len))
+            s->failed = TRUE;
+        if (s->out && logz_writer_close(s->out, TRUE) && !s->failed)
+            g_print("Session log closed → %s\n", s->path);
+        // open session logs are locked against maintenance; only a finished one restarts its wait
+        if (s->out)
+            log_maintenance_kick();
+        session_log_free(s);
+    }
+}
+
+static gpointer session_log_writer(gpointer unused) {
+    gint64 next_check = g_get_monotonic_time() + SESSION_LOG_AGE_CHECK_US;
+    for (;;) {
+        gint64 wait = MAX(next_check - g_get_monotonic_time(), 0);
+        gpointer item = g_async_queue_timeout_pop(writer_queue, (guint64)wait);
+        if (item == WRITER_QUIT)
+            break;
+        if (item)
+            session_log_drain(item);
+
+        // on a clock, not on a quiet queue: other tabs may keep it busy
+        if (g_get_monotonic_time() >= next_check) {
+            for (GList* l = open_sessions; l; l = l->next)
+                session_log_flush_aged(l->data);
+            next_check = g_get_monotonic_time() + SESSION_LOG_AGE_CHECK_US;
+        }
+    }
+    return NULL;
+}
+
+// Queue s for draining unless it already is; closing queues it a last time.
+static void session_log_kick_full(SessionLog* s, gboolean closing) {
+    g_mutex_lock(&s->lock);
+    if (closing || s->queued == 0) {
+        s->closing = s->closing || closing;
+        s->queued++;
+        g_async_queue_push(writer_queue, s);
+    }
+    g_mutex_unlock(&s->lock);
+}
+
+static void session_log_kick(SessionLog* s) {
+    session_log_kick_full(s, FALSE);
+}
+
+// Append to the ring; FALSE if the writer has not caught up and the batch must be retried.
+// Once s->final is set, what does not fit goes there instead.
+static gboolean session_log_push(SessionLog* s, const char* text, gsize len) {
+    if (s->final) {
+        g_mutex_lock(&s->lock);
+        gboolean fits = s->final->len == 0 && SESSION_LOG_RING - s->len >= len;
+        g_mutex_unlock(&s->lock);
+        if (!fits) {
+            g_byte_array_append(s->final, (const guint8*)text, (guint)len);
+            return TRUE;
+        }
+    }
+    if (len > SESSION_LOG_RING) {
+        g_printerr("Session log %s: truncating oversized batch (%" G_GSIZE_FORMAT " bytes)\n", s->path, len);
+        len = SESSION_LOG_RING;
+    }
+
+    g_mutex_lock(&s->lock);
+    if (SESSION_LOG_RING - s->len < len) {
+        g_mutex_unlock(&s->lock);
+        return FALSE;
+    }
+    gsize head = (s->tail + s->len) % SESSION_LOG_RING;
+    g_mutex_unlock(&s->lock);
+
+    // only the writer moves tail, and only forward: [head, head + len) stays ours
+    gsize first = MIN(len, SESSION_LOG_RING - head);
+    memcpy(s->ring + head, text, first);
+    memcpy(s->ring, text + first, len - first);
+
+    g_mutex_lock(&s->lock);
+    s->len += len;
+    g_mutex_unlock(&s->lock);
+    return TRUE;
+}
+
+// Copy rows [logged_row, stop) out of VTE; complete_only leaves the cursor row for later.
+// Returns FALSE when the ring filled up before everything was copied.
+static gboolean session_log_collect(SessionLog* s, gboolean complete_only) {
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(s->vt));
+    glong first = (glong)gtk_adjustment_get_lower(adj);
+    glong stop = (glong)gtk_adjustment_get_upper(adj);
+
+    if (complete_only) {
+        glong cursor_row = 0;
+        vte_terminal_get_cursor_position(s->vt, NULL, &cursor_row);
+        stop = MIN(stop, cursor_row);
+    }
+
+    if (s->logged_row < first) {
+        g_printerr("Session log %s: %ld rows scrolled out before they were logged\n", s->path, first - s->logged_row);
+        s->logged_row = first;
+    }
+
+    gboolean pushed = FALSE;
+    gboolean complete = TRUE;
+    while (s->logged_row < stop) {
+        glong end = MIN(s->logged_row + SESSION_LOG_MAX_ROWS, stop);
+        gsize len = 0;
+        char* text = vte_terminal_get_text_range_format(s->vt, VTE_FORMAT_TEXT, s->logged_row, 0, end, 0, &len);
+        gboolean ok = !text || len == 0 || session_log_push(s, text, len);
+        g_free(text);
+        if (!ok) {
+            complete = FALSE;  // ring full; the rows are still in VTE, try again next batch
+            break;
+        }
+        s->logged_row = end;
+        pushed = TRUE;
+    }
+
+    if (pushed)
+        session_log_kick(s);
+    return complete;
+}
+
+static gboolean session_log_batch(gpointer user_data) {
+    WATCHDOG_SCOPE("session_log_batch");
+    SessionLog* s = user_data;
+    if (session_log_collect(s, TRUE)) {
+        s->batch_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_session_contents_changed(VteTerminal* vt, gpointer user_data) {
+    SessionLog* s = user_data;
+    if (!s->batch_source)
+        s->batch_source = g_timeout_add(SESSION_LOG_BATCH_MS, session_log_batch, s);
+}
+
+// Hand the session over to the writer for its final drain; s must not be used afterwards.
+static void session_log_close(SessionLog* s) {
+    live_sessions = g_list_remove(live_sessions, s);
+    if (s->batch_source) {
+        g_source_remove(s->batch_source);
+        s->batch_source = 0;
+    }
+    s->vt = NULL;
+    session_log_kick_full(s, TRUE);
+}
+
+// Terminal finalized without session_log_stop(): no VTE access possible anymore.
+static void session_log_detach(gpointer data) {
+    SessionLog* s = data;
+    if (s->vt)
+        session_log_close(s);
+}
+
+static gchar* build_session_log_path(void) {
+    static guint session_counter = 0;
+    gchar* fmt = g_strdup_printf("terminal_%%Y%%m%%d_%%H%%M%%S_s%d-%u.logz", (int)getpid(), ++session_counter);
+    gchar* path = build_log_path(fmt);
+    g_free(fmt);
+    return path;
+}
+
+void session_log_start(VteTerminal* vt) {
+    if (session_log_is_active(vt))
+        return;
+
+    if (!writer_thread) {
+        writer_queue = g_async_queue_new();
+        writer_thread = g_thread_new("session-log", session_log_writer, NULL);
+    }
+
+    SessionLog* s = g_new0(SessionLog, 1);
+    g_mutex_init(&s->lock);
+    s->vt = vt;
+    s->path = build_session_log_path();
+    s->ring = g_malloc(SESSION_LOG_RING);
+
+    // start with whatever is already in the scrollback
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+    s->logged_row = (glong)gtk_adjustment_get_lower(adj);
+
+    s->changed_handler = g_signal_connect(vt, "contents-changed", G_CALLBACK(on_session_contents_changed), s);
+    g_object_set_data_full(G_OBJECT(vt), SESSION_LOG_KEY, s, session_log_detach);
+    live_sessions = g_list_prepend(live_sessions, s);
+
+    on_session_contents_changed(vt, s);
+}
+
+void session_log_stop(VteTerminal* vt) {
+    SessionLog* s = g_object_steal_data(G_OBJECT(vt), SESSION_LOG_KEY);
+    if (!s)
+        return;
+
+    g_signal_handler_disconnect(vt, s->changed_handler);
+    // everything including the cursor row; the tab is going away or logging is off.
+    // What the ring has no room for goes with the close instead of waiting for the writer.
+    s->final = g_byte_array_new();
+    session_log_collect(s, FALSE);
+    session_log_close(s);
+}
+
+gboolean session_log_is_active(VteTerminal* vt) {
+    return g_object_get_data(G_OBJECT(vt), SESSION_LOG_KEY) != NULL;
+}
+
+void session_log_shutdown(void) {
+    if (!writer_thread)
+        return;
+
+    while (live_sessions) {
+        SessionLog* s = live_sessions->data;
+        if (s->vt)
+            session_log_stop(s->vt);
+        else
+            session_log_close(s);
+    }
+
+    g_async_queue_push(writer_queue, WRITER_QUIT);
+    g_thread_join(writer_thread);
+    writer_thread = NULL;
+    g_async_queue_unref(writer_queue);
+    writer_queue = NULL;
+}
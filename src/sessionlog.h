@@ -0,0 +1,15 @@
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+void session_log_start(VteTerminal* vt);
+void session_log_stop(VteTerminal* vt);
+gboolean session_log_is_active(VteTerminal* vt);
+void session_log_shutdown(void);
+
+G_END_DECLS
+
+#endif  // SESSIONLOG_H
@@ -0,0 +1,186 @@
+#include "shellpool.h"
+
+#include <pwd.h>
+#include <signal.h>
+
+// Shell startup off the critical path. PTYs are opened on a worker thread, and
+// with --shell-pool=N up to N shells are started ahead of time: add_tab() then
+// takes a PTY whose shell is already sitting at its prompt and the pool refills
+// in the background. Pooled shells start at 80x24 and redraw on the SIGWINCH
+// they get once a terminal with the real size adopts them.
+
+#define SHELL_POOL_ROWS 24
+#define SHELL_POOL_COLUMNS 80
+
+typedef struct {
+    VtePty* pty;
+    GPid pid;
+    guint watch_id;
+} PooledShell;
+
+static GQueue pool = G_QUEUE_INIT;
+static guint pool_size = 0;
+static guint pool_starting = 0;  // PTYs being opened or shells being spawned for the pool
+static guint fill_source = 0;
+static gboolean pool_closed = FALSE;
+
+static const char* get_user_shell(void) {
+    const char* shell = g_getenv("SHELL");
+    if (shell && *shell)
+        return shell;
+
+    struct passwd* pw = getpwuid(getuid());
+    if (pw && pw->pw_shell && *pw->pw_shell)
+        return pw->pw_shell;
+
+    return "/bin/sh";
+}
+
+static void pty_new_thread(GTask* task, gpointer source, gpointer task_data, GCancellable* cancel) {
+    GError* err = NULL;
+    VtePty* pty = vte_pty_new_sync(VTE_PTY_DEFAULT, cancel, &err);
+    if (pty)
+        g_task_return_pointer(task, pty, g_object_unref);
+    else
+        g_task_return_error(task, err);
+}
+
+// Open a PTY on a worker thread; opening and configuring the pair can block.
+void shell_pty_new_async(GCancellable* cancel, GAsyncReadyCallback callback, gpointer user_data) {
+    GTask* task = g_task_new(NULL, cancel, callback, user_data);
+    g_task_run_in_thread(task, pty_new_thread);
+    g_object_unref(task);
+}
+
+VtePty* shell_pty_new_finish(GAsyncResult* res, GError** error) {
+    return g_task_propagate_pointer(G_TASK(res), error);
+}
+
+// Start command (the user's shell if NULL) on pty in cwd (ours if NULL) with env (ours if NULL);
+// finish with vte_pty_spawn_finish().
+void shell_spawn_async(VtePty* pty,
+                       const char* cwd,
+                       char** command,
+                       char** env,
+                       GAsyncReadyCallback callback,
+                       gpointer user_data) {
+    const char* shell = env ? g_environ_getenv(env, "SHELL") : NULL;
+    if (!shell || !*shell)
+        shell = get_user_shell();
+
+    char* shell_argv[] = {(char*)shell, NULL};
+    char** argv = command && command[0] ? command : shell_argv;
+    char** envp = g_environ_setenv(env ? g_strdupv(env) : g_get_environ(), "TERM", "xterm-256color", TRUE);
+
+    GSpawnFlags spawn_flags = g_path_is_absolute(argv[0]) ? (GSpawnFlags)0 : G_SPAWN_SEARCH_PATH;
+    vte_pty_spawn_async(pty, cwd, argv, envp, spawn_flags, NULL, NULL, NULL, -1, NULL, callback, user_data);
+
+    g_strfreev(envp);
+}
+
+static void pooled_shell_free(PooledShell* s) {
+    if (s->watch_id)
+        g_source_remove(s->watch_id);
+    g_object_unref(s->pty);
+    g_free(s);
+}
+
+static void on_pooled_shell_exited(GPid pid, gint status, gpointer user_data) {
+    PooledShell* s = user_data;
+    g_printerr("Pooled shell (PID=%d) exited before use (status=%d)\n", (int)pid, status);
+    g_spawn_close_pid(pid);
+    g_queue_remove(&pool, s);
+    s->watch_id = 0;  // removed with this dispatch
+    pooled_shell_free(s);
+    // not refilled here: a shell that dies on startup would respawn in a loop
+}
+
+static void on_pool_spawned(GObject* source, GAsyncResult* res, gpointer user_data) {
+    VtePty* pty = user_data;
+    GPid pid = 0;
+    GError* err = NULL;
+    pool_starting--;
+
+    if (!vte_pty_spawn_finish(VTE_PTY(source), res, &pid, &err) || pid <= 0) {
+        g_printerr("Shell pool: error spawning shell: %s\n", err ? err->message : "(unknown)");
+        g_clear_error(&err);
+        g_object_unref(pty);
+        return;
+    }
+    if (pool_closed) {
+        kill(pid, SIGHUP);
+        g_object_unref(pty);
+        return;
+    }
+
+    PooledShell* s = g_new0(PooledShell, 1);
+    s->pty = pty;
+    s->pid = pid;
+    s->watch_id = g_child_watch_add(pid, on_pooled_shell_exited, s);
+    g_queue_push_tail(&pool, s);
+}
+
+static void on_pool_pty(GObject* source, GAsyncResult* res, gpointer user_data) {
+    GError* err = NULL;
+    VtePty* pty = shell_pty_new_finish(res, &err);
+    if (!pty || pool_closed) {
+        if (err)
+            g_printerr("Shell pool: failed to create PTY: %s\n", err->message);
+        g_clear_error(&err);
+        g_clear_object(&pty);
+        pool_starting--;
+        return;
+    }
+    vte_pty_set_size(pty, SHELL_POOL_ROWS, SHELL_POOL_COLUMNS, NULL);
+    shell_spawn_async(pty, NULL, NULL, NULL, on_pool_spawned, pty);  // the callback owns pty
+}
+
+static gboolean shell_pool_fill(gpointer unused) {
+    fill_source = 0;
+    while (!pool_closed && pool.length + pool_starting < pool_size) {
+        pool_starting++;
+        shell_pty_new_async(NULL, on_pool_pty, NULL);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Top the pool up once the main loop has nothing more urgent to do.
+static void shell_pool_schedule_fill(void) {
+    if (!fill_source && pool_size > 0 && !pool_closed)
+        fill_source = g_idle_add_full(G_PRIORITY_LOW, shell_pool_fill, NULL, NULL);
+}
+
+void shell_pool_set_size(guint size) {
+    pool_size = size;
+    shell_pool_schedule_fill();
+}
+
+// Attach a ready shell to vt; FALSE if the pool is empty and the caller must start one.
+gboolean shell_pool_adopt(VteTerminal* vt) {
+    PooledShell* s = g_queue_pop_head(&pool);
+    shell_pool_schedule_fill();
+    if (!s)
+        return FALSE;
+
+    // VTE reaps the child from now on
+    g_source_remove(s->watch_id);
+    s->watch_id = 0;
+    vte_terminal_set_pty(vt, s->pty);
+    vte_terminal_watch_child(vt, s->pid);
+    g_print("Adopted pooled shell (PID=%d)\n", (int)s->pid);
+    pooled_shell_free(s);
+    return TRUE;
+}
+
+void shell_pool_shutdown(void) {
+    pool_closed = TRUE;
+    if (fill_source) {
+        g_source_remove(fill_source);
+        fill_source = 0;
+    }
+    PooledShell* s;
+    while ((s = g_queue_pop_head(&pool)) != NULL) {
+        kill(s->pid, SIGHUP);
+        pooled_shell_free(s);
+    }
+}
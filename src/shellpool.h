@@ -0,0 +1,23 @@
+#ifndef SHELLPOOL_H
+#define SHELLPOOL_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+void shell_pool_set_size(guint size);
+gboolean shell_pool_adopt(VteTerminal* vt);
+void shell_pool_shutdown(void);
+
+void shell_pty_new_async(GCancellable* cancel, GAsyncReadyCallback callback, gpointer user_data);
+VtePty* shell_pty_new_finish(GAsyncResult* res, GError** error);
+void shell_spawn_async(VtePty* pty,
+                       const char* cwd,
+                       char** command,
+                       char** env,
+                       GAsyncReadyCallback callback,
+                       gpointer user_data);
+
+G_END_DECLS
+
+#endif  // SHELLPOOL_H
@@ -0,0 +1,339 @@
+#include "spill.h"
+#include "clipboard.h"
+#include "logmaint.h"
+#include "logz.h"
+#include "tab.h"
+#include "terminal.h"
+#include "watchdog.h"
+
+// Process-wide scrollback budget (--scrollback-budget=MIB, 0 turns it off).
+// Every SPILL_CHECK_S the history all tabs hold is estimated at a byte per
+// cell. Over the budget, the largest tab that is in the background (not
+// mapped) and has printed nothing for SPILL_IDLE_S is snapshotted with the
+// same incremental pipeline as Ctrl+Shift+B; once the snapshot is on disk, the
+// tab's ring is shrunk to the rows after it (at least SPILL_KEEP_ROWS) and its
+// limit restored, so VTE drops only archived rows. One tab is spilled at a
+// time, and its snapshots are kept from log retention while the tab is open.
+// Off by default, since it drops rows from VTE. Ctrl+Shift+O opens a tab's
+// archived history in a new tab; those count against the budget too, and in
+// the background they are trimmed right away, since everything they hold is
+// on disk already.
+
+#define SPILL_KEY "1term-spill"
+#define SPILL_HISTORY_KEY "1term-spill-history"
+#define SPILL_CHECK_S 5
+#define SPILL_IDLE_S 30
+#define SPILL_RETRY_S 60  // after a snapshot failed
+#define SPILL_KEEP_ROWS 10000
+#define SPILL_HISTORY_MAX ((gsize)256 << 20)  // text loaded into a history tab
+#define SPILL_STEP_BYTES (64 << 10)           // fed to a history tab per main-loop iteration
+
+guint spill_budget_mib = 0;
+
+typedef struct {
+    VteTerminal* vt;  // not a reference: the entry goes with the terminal
+    gint64 last_output;
+    gint64 retry_at;
+    glong spilled_rows;
+    GPtrArray* pinned;  // snapshots holding the dropped rows, kept from log retention
+    gboolean history;  // fed from the archive: trimmed instead of snapshotted
+} SpillTab;
+
+static GList* tabs = NULL;
+static SpillTab* spilling = NULL;
+static guint check_source = 0;
+
+static void spill_tab_free(gpointer data) {
+    SpillTab* t = data;
+    tabs = g_list_remove(tabs, t);
+    if (spilling == t)
+        spilling = NULL;
+    for (guint i = 0; i < t->pinned->len; i++)
+        log_maintenance_unpin(g_ptr_array_index(t->pinned, i));
+    g_ptr_array_free(t->pinned, TRUE);
+    g_free(t);
+}
+
+static void on_spill_contents_changed(VteTerminal* vt, gpointer user_data) {
+    (void)vt;
+    SpillTab* t = user_data;
+    t->last_output = g_get_monotonic_time();
+}
+
+// Rows the ring holds beyond the screen
+static glong spill_history_rows(VteTerminal* vt) {
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+    glong rows = (glong)(gtk_adjustment_get_upper(adj) - gtk_adjustment_get_lower(adj));
+    return MAX(rows - vte_terminal_get_row_count(vt), 0);
+}
+
+static gboolean spill_candidate(SpillTab* t, gint64 now) {
+    TabContext* ctx = tab_context_get(t->vt);
+    if (!ctx || !ctx->notebook || gtk_widget_get_mapped(GTK_WIDGET(t->vt)))
+        return FALSE;
+    if (!t->history && (now - t->last_output < SPILL_IDLE_S * G_USEC_PER_SEC || now < t->retry_at))
+        return FALSE;
+    return spill_history_rows(t->vt) > SPILL_KEEP_ROWS;
+}
+
+// A history tab has nothing that is not in the archive: shrink it now, and keep
+// it at that size while the rest of its history is still being fed.
+static void spill_trim_history(SpillTab* t) {
+    glong dropped = spill_history_rows(t->vt) - SPILL_KEEP_ROWS;
+    vte_terminal_set_scrollback_lines(t->vt, SPILL_KEEP_ROWS);
+
+    TabContext* ctx = tab_context_get(t->vt);
+    g_autofree char* tip =
+        g_strdup_printf("Trimmed to its last %d lines; Ctrl+Shift+O in the original tab reloads it", SPILL_KEEP_ROWS);
+    gtk_widget_set_tooltip_text(ctx->tab_label, tip);
+    g_print("Scroll-back spill: %ld rows dropped from a history tab\n", dropped);
+}
+
+static void spill_archived(VteTerminal* vt, gboolean ok, gpointer user_data) {
+    WATCHDOG_SCOPE("spill_archived");
+    (void)user_data;
+    SpillTab* t = g_object_get_data(G_OBJECT(vt), SPILL_KEY);
+    if (!t)
+        return;
+    if (spilling == t)
+        spilling = NULL;
+    TabContext* ctx = tab_context_get(vt);
+    if (!ctx || !ctx->notebook)
+        return;  // closed meanwhile
+    if (!ok) {
+        g_printerr("Scroll-back spill failed; the tab keeps its history in memory\n");
+        t->retry_at = g_get_monotonic_time() + SPILL_RETRY_S * G_USEC_PER_SEC;
+        return;
+    }
+    glong archived = compress_scrollback_archived_row(vt);
+    if (!scrollback_enabled || archived < 0)
+        return;
+
+    // the ring keeps every row from the first unarchived one on
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+    glong lower = (glong)gtk_adjustment_get_lower(adj);
+    glong upper = (glong)gtk_adjustment_get_upper(adj);
+    glong keep = MAX(SPILL_KEEP_ROWS + vte_terminal_get_row_count(vt), upper - archived);
+    if (keep >= upper - lower)
+        return;
+    // pinned before the rows exist nowhere else, and for as long as the tab lives;
+    // a snapshot that was not incremental does not continue the earlier spills
+    g_autofree char* path = compress_scrollback_last_path(vt);
+    log_maintenance_pin(path);
+    g_ptr_array_add(t->pinned, g_strdup(path));
+    vte_terminal_set_scrollback_lines(vt, keep);
+    vte_terminal_set_scrollback_lines(vt, TERMINAL_SCROLLBACK_LINES);
+    glong dropped = (glong)gtk_adjustment_get_lower(adj) - lower;
+    t->spilled_rows += dropped;
+
+    g_autofree char* tip = g_strdup_printf("%ld older lines archived; Ctrl+Shift+O shows them", t->spilled_rows);
+    gtk_widget_set_tooltip_text(ctx->tab_label, tip);
+    g_print("Scroll-back spill: %ld rows moved to %s\n", dropped, path);
+}
+
+static gboolean spill_check(gpointer user_data) {
+    WATCHDOG_SCOPE("spill_check");
+    (void)user_data;
+    if (!tabs) {
+        check_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    if (spilling || !spill_budget_mib || !scrollback_enabled)
+        return G_SOURCE_CONTINUE;
+
+    gint64 now = g_get_monotonic_time();
+    guint64 total = 0;
+    guint64 victim_bytes = 0;
+    SpillTab* victim = NULL;
+    for (GList* l = tabs; l; l = l->next) {
+        SpillTab* t = l->data;
+        guint64 bytes = (guint64)spill_history_rows(t->vt) * (guint64)(vte_terminal_get_column_count(t->vt) + 1);
+        total += bytes;
+        // history tabs first: trimming them loses nothing
+        gboolean better = !victim || (t->history != victim->history ? t->history : bytes > victim_bytes);
+        if (better && spill_candidate(t, now)) {
+            victim = t;
+            victim_bytes = bytes;
+        }
+    }
+    if (total <= (guint64)spill_budget_mib << 20 || !victim)
+        return G_SOURCE_CONTINUE;
+    if (victim->history) {
+        spill_trim_history(victim);
+        return G_SOURCE_CONTINUE;
+    }
+
+    // a snapshot of this tab already running is left alone; the next check tries again
+    if (compress_scrollback_then(victim->vt, spill_archived, NULL))
+        spilling = victim;
+    return G_SOURCE_CONTINUE;
+}
+
+static void spill_watch(VteTerminal* vt, gboolean history) {
+    SpillTab* t = g_new0(SpillTab, 1);
+    t->vt = vt;
+    t->history = history;
+    t->pinned = g_ptr_array_new_with_free_func(g_free);
+    t->last_output = g_get_monotonic_time();
+    g_object_set_data_full(G_OBJECT(vt), SPILL_KEY, t, spill_tab_free);
+    g_signal_connect(vt, "contents-changed", G_CALLBACK(on_spill_contents_changed), t);
+    tabs = g_list_prepend(tabs, t);
+    if (!check_source)
+        check_source = g_timeout_add_seconds(SPILL_CHECK_S, spill_check, NULL);
+}
+
+// Count vt's history against the budget (tabs with a shell; history tabs are added by spill_open_history())
+void spill_watch_terminal(VteTerminal* vt) {
+    spill_watch(vt, FALSE);
+}
+
+/* ── History tabs ───────────────────────────────────────────────────────── */
+
+typedef struct {
+    VteTerminal* vt;
+    gchar* path;  // newest snapshot of the tab
+    GByteArray* text;
+    gsize fed;
+    guint source;
+} SpillHistory;
+
+static void spill_history_free(gpointer data) {
+    SpillHistory* h = data;
+    if (h->source)
+        g_source_remove(h->source);
+    if (h->text)
+        g_byte_array_unref(h->text);
+    g_free(h->path);
+    g_free(h);
+}
+
+// Text a history tab loads: SPILL_HISTORY_MAX, or the whole budget if that is less
+static gsize spill_history_limit(void) {
+    gsize budget = (gsize)spill_budget_mib << 20;
+    return spill_budget_mib && budget < SPILL_HISTORY_MAX ? budget : SPILL_HISTORY_MAX;
+}
+
+// Worker thread: the newest spill_history_limit() bytes of the snapshot chain,
+// from the first whole line on, with CR LF line ends for VTE. Frames are
+// decoded newest first, and only as many as that takes.
+static void spill_history_load(GTask* task, gpointer source, gpointer task_data, GCancellable* cancel) {
+    (void)source;
+    (void)cancel;
+    gsize max = spill_history_limit();
+    GPtrArray* frames = g_ptr_array_new();  // newest first
+    gboolean found = FALSE;
+    gsize size = 0;
+    gchar* path = g_strdup(task_data);
+    while (path && size < max) {
+        LogzReader* r = logz_reader_open(path);  // gone: deleted by log retention
+        g_free(path);
+        path = NULL;
+        if (!r)
+            break;
+        found = TRUE;
+        for (guint i = logz_reader_get_n_frames(r); i > 0 && size < max; i--) {
+            GBytes* frame = logz_reader_read_frame(r, i - 1);
+            if (!frame)
+                continue;
+            size += g_bytes_get_size(frame);
+            g_ptr_array_add(frames, frame);
+        }
+        if (size < max)
+            path = logz_reader_get_parent(r);
+        logz_reader_free(r);
+    }
+    g_free(path);
+    if (!found) {
+        g_ptr_array_free(frames, TRUE);
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "%s: cannot be read", (char*)task_data);
+        return;
+    }
+
+    // only the oldest frame can reach past the limit
+    gsize skip = size > max ? size - max : 0;
+    GByteArray* text = g_byte_array_sized_new((guint)MIN(size - skip + (size - skip) / 16, max * 2));
+    for (guint n = frames->len; n > 0; n--) {
+        GBytes* frame = g_ptr_array_index(frames, n - 1);
+        gsize len = 0;
+        const char* p = g_bytes_get_data(frame, &len);
+        const char* end = p + len;
+        if (skip) {
+            const char* nl = memchr(p + skip, '\n', len - skip);
+            p = nl ? nl + 1 : end;
+            skip = 0;
+        }
+        while (p < end) {
+            const char* nl = memchr(p, '\n', (gsize)(end - p));
+            const char* stop = nl ? nl : end;
+            g_byte_array_append(text, (const guint8*)p, (guint)(stop - p));
+            if (nl)
+                g_byte_array_append(text, (const guint8*)"\r\n", 2);
+            p = nl ? nl + 1 : end;
+        }
+        g_bytes_unref(frame);  // the text has it now
+    }
+    g_ptr_array_free(frames, TRUE);
+    g_task_return_pointer(task, text, (GDestroyNotify)g_byte_array_unref);
+}
+
+static gboolean spill_history_step(gpointer user_data) {
+    SpillHistory* h = user_data;
+    h->source = 0;
+    gsize n = MIN(h->text->len - h->fed, (gsize)SPILL_STEP_BYTES);
+    vte_terminal_feed(h->vt, (const char*)h->text->data + h->fed, (gssize)n);
+    h->fed += n;
+    if (h->fed < h->text->len)
+        h->source = g_idle_add(spill_history_step, h);  // below redraw priority: frames get through
+    return G_SOURCE_REMOVE;
+}
+
+static void on_spill_history_loaded(GObject* source, GAsyncResult* res, gpointer user_data) {
+    (void)source;
+    SpillHistory* h = user_data;
+    GError* err = NULL;
+    h->text = g_task_propagate_pointer(G_TASK(res), &err);
+    TabContext* ctx = tab_context_get(h->vt);
+    if (!h->text || !ctx || !ctx->notebook) {
+        if (err)
+            g_printerr("History %s\n", err->message);
+        g_clear_error(&err);
+        g_object_unref(h->vt);
+        spill_history_free(h);
+        return;
+    }
+    h->source = g_idle_add(spill_history_step, h);
+    g_object_set_data_full(G_OBJECT(h->vt), SPILL_HISTORY_KEY, h, spill_history_free);
+    g_object_unref(h->vt);
+}
+
+// A new tab next to vt with the history its snapshots archived, spilled or not
+void spill_open_history(VteTerminal* vt) {
+    TabContext* ctx = tab_context_get(vt);
+    g_autofree char* path = compress_scrollback_last_path(vt);
+    if (!ctx || !ctx->notebook)
+        return;
+    if (!path || !g_file_test(path, G_FILE_TEST_EXISTS)) {
+        g_print("No archived history for this tab yet (Ctrl+Shift+B archives it)\n");
+        return;
+    }
+
+    SpillHistory* h = g_new0(SpillHistory, 1);
+    h->vt = g_object_ref(add_tab_feed(ctx->notebook));
+    h->path = g_strdup(path);
+    vte_terminal_set_scrollback_lines(h->vt, -1);  // the load is bounded instead
+    spill_watch(h->vt, TRUE);
+
+    // title escape: the tab label follows it like a shell's
+    g_autofree char* title = g_strdup_printf("History: %s", ctx->title ? ctx->title : "");
+    for (char* c = title; *c; c++) {
+        if ((guchar)*c < 0x20 || *c == 0x7f)
+            *c = ' ';
+    }
+    g_autofree char* osc = g_strdup_printf("\033]2;%s\007", title);
+    vte_terminal_feed(h->vt, osc, -1);
+
+    GTask* task = g_task_new(NULL, NULL, on_spill_history_loaded, h);
+    g_task_set_task_data(task, g_strdup(path), g_free);
+    g_task_run_in_thread(task, spill_history_load);
+    g_object_unref(task);
+}
@@ -0,0 +1,15 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+extern guint spill_budget_mib;
+
+void spill_watch_terminal(VteTerminal* vt);
+void spill_open_history(VteTerminal* vt);
+
+G_END_DECLS
+
+#endif  // SPILL_H
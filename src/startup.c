@@ -0,0 +1,195 @@
+#include "startup.h"
+
+// Launch-time instrumentation. Each phase is stamped once with the monotonic
+// clock; first paint comes from the window's GdkFrameClock and first output
+// from the first tab. ONETERM_STARTUP_TRACE=1 prints the phases to stderr.
+// `--startup-bench N` runs the binary N times in report mode and prints JSON
+// statistics. CLOCK_MONOTONIC is shared by all processes, so each phase is
+// measured from the moment the bench spawned the child, including exec and
+// dynamic linking.
+
+#define STARTUP_REPORT_FLAG "--startup-report"
+#define STARTUP_REPORT_TIMEOUT_S 10
+
+static const char* const phase_names[STARTUP_N_PHASES] = {
+    "main", "a11y", "activate", "window", "css", "tab", "pty", "spawn", "first_frame", "first_output",
+};
+
+static gint64 marks[STARTUP_N_PHASES];
+static gboolean report_mode = FALSE;
+static gboolean reported = FALSE;
+static gboolean watching_window = FALSE;
+static gboolean watching_terminal = FALSE;
+
+static void startup_report(void) {
+    if (reported)
+        return;
+    reported = TRUE;
+
+    if (report_mode) {
+        // read by startup_bench() in the parent
+        for (int i = 0; i < STARTUP_N_PHASES; i++) {
+            if (marks[i])
+                g_print("%s %" G_GINT64_FORMAT "\n", phase_names[i], marks[i]);
+        }
+        fflush(stdout);
+        GApplication* app = g_application_get_default();
+        if (app)
+            g_application_quit(app);
+        return;
+    }
+
+    if (g_getenv("ONETERM_STARTUP_TRACE")) {
+        for (int i = 0; i < STARTUP_N_PHASES; i++) {
+            if (marks[i])
+                g_printerr("Startup: %-12s +%.1f ms\n", phase_names[i], (marks[i] - marks[STARTUP_MAIN]) / 1000.0);
+        }
+    }
+}
+
+void startup_mark(StartupPhase phase) {
+    if (marks[phase])
+        return;
+    marks[phase] = g_get_monotonic_time();
+    if (marks[STARTUP_FIRST_FRAME] && marks[STARTUP_FIRST_OUTPUT])
+        startup_report();
+}
+
+static void on_first_paint(GdkFrameClock* clock, gpointer user_data) {
+    startup_mark(STARTUP_FIRST_FRAME);
+    g_signal_handlers_disconnect_by_func(clock, on_first_paint, user_data);
+}
+
+static void on_window_realize(GtkWidget* win, gpointer user_data) {
+    g_signal_handlers_disconnect_by_func(win, on_window_realize, user_data);
+    GdkFrameClock* clock = gtk_widget_get_frame_clock(win);
+    if (clock)
+        g_signal_connect(clock, "after-paint", G_CALLBACK(on_first_paint), NULL);
+}
+
+// First frame of the first window
+void startup_watch_window(GtkWidget* win) {
+    if (watching_window)
+        return;
+    watching_window = TRUE;
+    g_signal_connect(win, "realize", G_CALLBACK(on_window_realize), NULL);
+}
+
+static void on_first_contents(VteTerminal* vt, gpointer user_data) {
+    // VTE also reports changes of its own, e.g. the initial resize; wait for the shell to write
+    if (!marks[STARTUP_PTY])
+        return;
+    glong col = 0, row = 0;
+    vte_terminal_get_cursor_position(vt, &col, &row);
+    if (col == 0 && row == 0)
+        return;
+    g_signal_handlers_disconnect_by_func(vt, on_first_contents, user_data);
+    startup_mark(STARTUP_FIRST_OUTPUT);
+}
+
+// First shell output in the first tab
+void startup_watch_terminal(VteTerminal* vt) {
+    if (watching_terminal)
+        return;
+    watching_terminal = TRUE;
+    g_signal_connect(vt, "contents-changed", G_CALLBACK(on_first_contents), NULL);
+}
+
+static gboolean on_report_timeout(gpointer unused) {
+    g_printerr("1term: no first frame and shell output within %d s\n", STARTUP_REPORT_TIMEOUT_S);
+    startup_report();
+    return G_SOURCE_REMOVE;
+}
+
+// Child of --startup-bench: print the marks and quit once the shell has drawn something.
+void startup_set_report_mode(void) {
+    report_mode = TRUE;
+    g_timeout_add_seconds(STARTUP_REPORT_TIMEOUT_S, on_report_timeout, NULL);
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_stats(const char* name, GArray* values, gboolean last) {
+    g_array_sort(values, compare_double);
+    double sum = 0;
+    for (guint i = 0; i < values->len; i++)
+        sum += g_array_index(values, double, i);
+    guint n = values->len;
+    double median = n % 2 ? g_array_index(values, double, n / 2)
+                          : (g_array_index(values, double, n / 2 - 1) + g_array_index(values, double, n / 2)) / 2;
+    g_print("    \"%s\": {\"n\": %u, \"min\": %.3f, \"median\": %.3f, \"mean\": %.3f, \"max\": %.3f}%s\n", name, n,
+            g_array_index(values, double, 0), median, sum / n, g_array_index(values, double, n - 1), last ? "" : ",");
+}
+
+// Launch 1term runs times and print, per phase, milliseconds since the launch as JSON.
+int startup_bench(int runs) {
+    gchar* self = g_file_read_link("/proc/self/exe", NULL);
+    if (!self) {
+        g_printerr("--startup-bench: cannot find our own executable\n");
+        return 1;
+    }
+
+    GArray* values[STARTUP_N_PHASES + 1];  // the last one is the time until the child exited
+    for (int i = 0; i <= STARTUP_N_PHASES; i++)
+        values[i] = g_array_new(FALSE, FALSE, sizeof(double));
+    int failed = 0;
+
+    for (int run = 0; run < runs; run++) {
+        char* argv[] = {self, STARTUP_REPORT_FLAG, NULL};
+        gchar* out = NULL;
+        gint status = 0;
+        GError* err = NULL;
+        gint64 t0 = g_get_monotonic_time();
+        if (!g_spawn_sync(NULL, argv, NULL, G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL, &out, NULL, &status, &err)) {
+            g_printerr("--startup-bench: %s\n", err->message);
+            g_clear_error(&err);
+            failed++;
+            continue;
+        }
+        double exit_ms = (g_get_monotonic_time() - t0) / 1000.0;
+
+        gint64 seen[STARTUP_N_PHASES] = {0};
+        gchar** lines = g_strsplit(out, "\n", -1);
+        for (int l = 0; lines[l]; l++) {
+            gchar name[32];
+            gint64 t = 0;
+            if (sscanf(lines[l], "%31s %" G_GINT64_FORMAT, name, &t) != 2)
+                continue;
+            for (int i = 0; i < STARTUP_N_PHASES; i++) {
+                if (g_str_equal(name, phase_names[i]))
+                    seen[i] = t;
+            }
+        }
+        g_strfreev(lines);
+        g_free(out);
+
+        if (!g_spawn_check_wait_status(status, NULL) || !seen[STARTUP_FIRST_FRAME] || !seen[STARTUP_FIRST_OUTPUT]) {
+            failed++;
+            continue;
+        }
+        for (int i = 0; i < STARTUP_N_PHASES; i++) {
+            double ms = (seen[i] - t0) / 1000.0;
+            if (seen[i])
+                g_array_append_val(values[i], ms);
+        }
+        g_array_append_val(values[STARTUP_N_PHASES], exit_ms);
+    }
+
+    g_print("{\n  \"runs\": %d,\n  \"failed\": %d,\n  \"unit\": \"ms since launch\",\n  \"phases\": {\n", runs, failed);
+    int last = STARTUP_N_PHASES;
+    while (last >= 0 && values[last]->len == 0)
+        last--;
+    for (int i = 0; i <= last; i++) {
+        if (values[i]->len > 0)
+            print_stats(i < STARTUP_N_PHASES ? phase_names[i] : "exit", values[i], i == last);
+    }
+    g_print("  }\n}\n");
+
+    for (int i = 0; i <= STARTUP_N_PHASES; i++)
+        g_array_free(values[i], TRUE);
+    g_free(self);
+    return failed == runs ? 1 : 0;
+}
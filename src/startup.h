@@ -0,0 +1,31 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+// Launch phases, in the order they normally happen
+typedef enum {
+    STARTUP_MAIN,          // main() entered
+    STARTUP_A11Y,          // accessibility disabled, about to create the GtkApplication
+    STARTUP_ACTIVATE,      // GTK initialized, activate handler running
+    STARTUP_WINDOW,        // first create_window() entered
+    STARTUP_CSS,           // CSS provider loaded
+    STARTUP_TAB,           // first add_tab() returned
+    STARTUP_PTY,           // first PTY attached to its terminal
+    STARTUP_SPAWN,         // first shell spawned
+    STARTUP_FIRST_FRAME,   // first frame painted
+    STARTUP_FIRST_OUTPUT,  // first shell output on screen
+    STARTUP_N_PHASES
+} StartupPhase;
+
+void startup_mark(StartupPhase phase);
+void startup_watch_window(GtkWidget* win);
+void startup_watch_terminal(VteTerminal* vt);
+void startup_set_report_mode(void);
+int startup_bench(int runs);
+
+G_END_DECLS
+
+#endif  // STARTUP_H
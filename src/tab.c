@@ -1,20 +1,92 @@
 #include "tab.h"
 #include "terminal.h"
 #include "window.h"
+#include "sessionlog.h"
+#include "clipboard.h"
+#include "paste.h"
+#include "startup.h"
+#include "latency.h"
+#include "renderbench.h"
+#include "spill.h"
+#include "throttle.h"
+#include "trace.h"
+#include "watchdog.h"
 
-VteTerminal* add_tab(GtkNotebook* notebook) {
+#define TAB_CONTEXT_KEY "1term-tab"
+
+static void tab_context_free(gpointer data) {
+    TabContext* ctx = data;
+    g_free(ctx->title);
+    g_free(ctx);
+}
+
+// Pages are a GtkScrolledWindow around the terminal, or with --overlay-scrollbar
+// the terminal itself (VTE is a GtkScrollable) in a GtkOverlay with a scrollbar
+gboolean tab_overlay_scrollbar = FALSE;
+
+TabContext* tab_context_get(VteTerminal* vt) {
+    return g_object_get_data(G_OBJECT(vt), TAB_CONTEXT_KEY);
+}
+
+// The terminal of a notebook page, with either layout
+VteTerminal* tab_page_get_terminal(GtkWidget* page) {
+    GtkWidget* child = NULL;
+    if (page && GTK_IS_SCROLLED_WINDOW(page))
+        child = gtk_scrolled_window_get_child(GTK_SCROLLED_WINDOW(page));
+    else if (page && GTK_IS_OVERLAY(page))
+        child = gtk_overlay_get_child(GTK_OVERLAY(page));
+    return child && VTE_IS_TERMINAL(child) ? VTE_TERMINAL(child) : NULL;
+}
+
+// Like GTK_POLICY_AUTOMATIC: the scrollbar only shows while there is history to scroll
+static void on_page_adjustment_changed(GtkAdjustment* adj, gpointer user_data) {
+    GtkWidget* bar = user_data;
+    gboolean scrollable = gtk_adjustment_get_upper(adj) - gtk_adjustment_get_lower(adj) >
+                          gtk_adjustment_get_page_size(adj);
+    if (gtk_widget_get_visible(bar) != scrollable)
+        gtk_widget_set_visible(bar, scrollable);
+}
+
+static GtkWidget* tab_page_new(VteTerminal* vt) {
+    if (!tab_overlay_scrollbar) {
+        GtkWidget* scr = gtk_scrolled_window_new();
+        gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scr), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+        gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scr), GTK_WIDGET(vt));
+        return scr;
+    }
+
+    // No viewport, no horizontal adjustment: the overlay allocates the terminal
+    // its full size and the scrollbar, drawn over its right edge, follows VTE's
+    // own vertical adjustment
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(vt));
+    GtkWidget* overlay = gtk_overlay_new();
+    gtk_overlay_set_child(GTK_OVERLAY(overlay), GTK_WIDGET(vt));
+    GtkWidget* bar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, adj);
+    gtk_widget_set_halign(bar, GTK_ALIGN_END);
+    gtk_widget_add_css_class(bar, "overlay-indicator");  // the theme's thin style, as in a GtkScrolledWindow
+    gtk_widget_set_visible(bar, FALSE);
+    gtk_overlay_add_overlay(GTK_OVERLAY(overlay), bar);
+    g_signal_connect_object(adj, "changed", G_CALLBACK(on_page_adjustment_changed), bar, 0);
+    return overlay;
+}
+
+static VteTerminal* add_tab_internal(GtkNotebook* notebook,
+                                     gboolean spawn,
+                                     const char* cwd,
+                                     char** command,
+                                     char** env) {
+    WATCHDOG_SCOPE("add_tab");
+    TRACE_SCOPE("add_tab");
     g_print("add_tab called\n");
     // Create terminal
-    VteTerminal* vt = VTE_TERMINAL(vte_terminal_new());
+    VteTerminal* vt = VTE_TERMINAL(my_terminal_new());
 
     // Setup terminal
     setup_terminal(vt);
     setup_background_color(vt);
 
-    // Create scrolled window
-    GtkWidget* scr = gtk_scrolled_window_new();
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scr), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scr), GTK_WIDGET(vt));
+    // Create the page holding it
+    GtkWidget* page = tab_page_new(vt);
 
     // Create tab label with close button
     GtkWidget* hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
@@ -26,10 +98,19 @@ VteTerminal* add_tab(GtkNotebook* notebook) {
     gtk_box_append(GTK_BOX(hbox), close_btn);
     gtk_widget_set_visible(hbox, TRUE);
 
+    // Everything per-tab code needs to reach, so nothing has to search the notebook
+    TabContext* ctx = g_new0(TabContext, 1);
+    ctx->vt = vt;
+    ctx->notebook = notebook;
+    ctx->page = page;
+    ctx->tab_label = hbox;
+    ctx->label = label;
+    g_object_set_data_full(G_OBJECT(vt), TAB_CONTEXT_KEY, ctx, tab_context_free);
+
     // Append to notebook
-    gtk_notebook_append_page(notebook, scr, hbox);
+    gtk_notebook_append_page(notebook, page, hbox);
     // Switch to the new tab
-    int page_num = gtk_notebook_page_num(notebook, scr);
+    int page_num = gtk_notebook_page_num(notebook, page);
     if (page_num >= 0) {
         gtk_notebook_set_current_page(notebook, page_num);
     }
@@ -38,65 +119,72 @@ VteTerminal* add_tab(GtkNotebook* notebook) {
     g_signal_connect(vt, "selection-changed", G_CALLBACK(on_selection_changed), NULL);
     setup_key_events(vt);
 
-    // Connect child-exit with notebook as user_data
-    g_signal_connect(vt, "child-exited", G_CALLBACK(on_child_exit_tab), notebook);
+    // ahead of on_child_exit_tab, which closes the tab the benchmark reports on
+    render_bench_watch_terminal(vt);
+    g_signal_connect(vt, "child-exited", G_CALLBACK(on_child_exit_tab), ctx);
 
     // Connect title updates
 #if VTE_CHECK_VERSION(0, 78, 0)
-    g_signal_connect(vt, "termprop-changed", G_CALLBACK(title_tab_sig_cb_new), notebook);
+    g_signal_connect(vt, "termprop-changed", G_CALLBACK(title_tab_sig_cb_new), ctx);
 #else
-    g_signal_connect(vt, "window-title-changed", G_CALLBACK(title_tab_sig_cb_old), notebook);
-    g_signal_connect(vt, "current-directory-uri-changed", G_CALLBACK(title_tab_sig_cb_old), notebook);
+    g_signal_connect(vt, "window-title-changed", G_CALLBACK(title_tab_sig_cb_old), ctx);
+    g_signal_connect(vt, "current-directory-uri-changed", G_CALLBACK(title_tab_sig_cb_old), ctx);
 #endif
 
     // Spawn shell
-    setup_pty_and_shell(vt);
+    if (spawn) {
+        setup_pty_and_shell(vt, cwd, command, env);
+        spill_watch_terminal(vt);
+    }
+
+    if (session_logging_enabled)
+        session_log_start(vt);
 
     // Connect close button
-    g_signal_connect(close_btn, "clicked", G_CALLBACK(on_tab_close_clicked), notebook);
+    g_signal_connect(close_btn, "clicked", G_CALLBACK(on_tab_close_clicked), ctx);
 
     // Set initial tab label
-    update_tab_title(vt, notebook);
+    update_tab_title(ctx);
 
+    throttle_watch_terminal(vt);
+    startup_watch_terminal(vt);
+    latency_watch_terminal(vt);
+    startup_mark(STARTUP_TAB);
     return vt;
 }
 
-void on_tab_close_clicked(GtkButton* btn, gpointer user_data) {
-    GtkNotebook* notebook = GTK_NOTEBOOK(user_data);
-    if (!notebook)
-        return;
-    // Iterate pages to find which page has this button
-    int n = gtk_notebook_get_n_pages(notebook);
-    for (int i = 0; i < n; i++) {
-        GtkWidget* page = gtk_notebook_get_nth_page(notebook, i);
-        GtkWidget* tab_label = gtk_notebook_get_tab_label(notebook, page);
-        if (tab_label && gtk_widget_is_ancestor(GTK_WIDGET(btn), tab_label)) {
-            // Close the page
-            gtk_notebook_remove_page(notebook, i);
-            break;
-        }
-    }
+VteTerminal* add_tab(GtkNotebook* notebook) {
+    return add_tab_full(notebook, NULL, NULL, NULL);
+}
+
+// A tab running command (the user's shell if NULL) in cwd (ours if NULL) with env (ours if NULL)
+VteTerminal* add_tab_full(GtkNotebook* notebook, const char* cwd, char** command, char** env) {
+    return add_tab_internal(notebook, TRUE, cwd, command, env);
 }
 
-void on_child_exit_tab(VteTerminal* vt, int status, GtkNotebook* notebook) {
-    if (!notebook)
+// A tab without a PTY; its contents come from vte_terminal_feed()
+VteTerminal* add_tab_feed(GtkNotebook* notebook) {
+    return add_tab_internal(notebook, FALSE, NULL, NULL, NULL);
+}
+
+static void remove_tab(TabContext* ctx) {
+    if (!ctx->notebook)
         return;
+    int page_num = gtk_notebook_page_num(ctx->notebook, ctx->page);
+    if (page_num >= 0)
+        gtk_notebook_remove_page(ctx->notebook, page_num);
+}
+
+void on_tab_close_clicked(GtkButton* btn, gpointer user_data) {
+    (void)btn;
+    remove_tab(user_data);
+}
+
+void on_child_exit_tab(VteTerminal* vt, int status, gpointer user_data) {
+    (void)vt;
     g_print("Shell exited (status=%d). Closing tab\n", status);
-    // Find page index for this terminal
-    int n = gtk_notebook_get_n_pages(notebook);
-    for (int i = 0; i < n; i++) {
-        GtkWidget* page = gtk_notebook_get_nth_page(notebook, i);
-        // page is scrolled window, its child is terminal
-        GtkWidget* child = gtk_scrolled_window_get_child(GTK_SCROLLED_WINDOW(page));
-        if (GTK_WIDGET(vt) == child) {
-            gtk_notebook_remove_page(notebook, i);
-            break;
-        }
-    }
-    // If no pages left, close window
-    if (gtk_notebook_get_n_pages(notebook) == 0) {
-        // Handled in on_notebook_page_removed
-    }
+    // If no pages are left, on_notebook_page_removed closes the window
+    remove_tab(user_data);
 }
 
 static char* get_terminal_title(VteTerminal* vt) {
@@ -130,36 +218,52 @@ static char* get_terminal_title(VteTerminal* vt) {
     return title;
 }
 
-void update_tab_title(VteTerminal* vt, GtkNotebook* notebook) {
-    if (!notebook)
+static gboolean tab_is_current(TabContext* ctx) {
+    int current = gtk_notebook_get_current_page(ctx->notebook);
+    return current >= 0 && gtk_notebook_get_nth_page(ctx->notebook, current) == ctx->page;
+}
+
+static void set_window_title(GtkNotebook* notebook, const char* title) {
+    GtkWidget* window = gtk_widget_get_ancestor(GTK_WIDGET(notebook), GTK_TYPE_WINDOW);
+    if (window)
+        gtk_window_set_title(GTK_WINDOW(window), title);
+}
+
+void update_tab_title(TabContext* ctx) {
+    WATCHDOG_SCOPE("update_tab_title");
+    TRACE_SCOPE("update_tab_title");
+    if (ctx->title_tick) {
+        gtk_widget_remove_tick_callback(ctx->label, ctx->title_tick);
+        ctx->title_tick = 0;
+    }
+    if (!ctx->notebook)
+        return;
+
+    char* title = get_terminal_title(ctx->vt);
+    if (g_strcmp0(title, ctx->title) == 0) {
+        g_free(title);
         return;
-    // Find page index for this terminal
-    int n = gtk_notebook_get_n_pages(notebook);
-    for (int i = 0; i < n; i++) {
-        GtkWidget* page = gtk_notebook_get_nth_page(notebook, i);
-        if (!page || !GTK_IS_SCROLLED_WINDOW(page))
-            continue;
-        GtkWidget* child = gtk_scrolled_window_get_child(GTK_SCROLLED_WINDOW(page));
-        if (GTK_WIDGET(vt) == child) {
-            GtkWidget* tab_label = gtk_notebook_get_tab_label(notebook, page);
-            if (!tab_label)
-                break;
-            // tab_label is the hbox, its first child is GtkLabel
-            GtkWidget* label = gtk_widget_get_first_child(tab_label);
-            if (label && GTK_IS_LABEL(label)) {
-                g_autofree char* title = get_terminal_title(vt);
-                gtk_label_set_text(GTK_LABEL(label), title);
-
-                // Also update window title if this is the active tab
-                if (i == gtk_notebook_get_current_page(notebook)) {
-                    GtkWidget* window = gtk_widget_get_ancestor(GTK_WIDGET(notebook), GTK_TYPE_WINDOW);
-                    if (window)
-                        gtk_window_set_title(GTK_WINDOW(window), title);
-                }
-            }
-            break;
-        }
     }
+    g_free(ctx->title);
+    ctx->title = title;
+    gtk_label_set_text(GTK_LABEL(ctx->label), title);
+    if (tab_is_current(ctx))
+        set_window_title(ctx->notebook, title);
+}
+
+static gboolean tab_title_tick(GtkWidget* widget, GdkFrameClock* clock, gpointer user_data) {
+    (void)widget;
+    (void)clock;
+    TabContext* ctx = user_data;
+    ctx->title_tick = 0;
+    update_tab_title(ctx);
+    return G_SOURCE_REMOVE;
+}
+
+// Shells set the title on every prompt; apply it at most once per frame of the tab bar.
+static void schedule_tab_title(TabContext* ctx) {
+    if (!ctx->title_tick && ctx->notebook)
+        ctx->title_tick = gtk_widget_add_tick_callback(ctx->label, tab_title_tick, ctx, NULL);
 }
 
 void on_notebook_page_added(GtkNotebook* notebook, GtkWidget* child, guint page_num, gpointer user_data) {
@@ -172,9 +276,26 @@ void on_notebook_page_added(GtkNotebook* notebook, GtkWidget* child, guint page_
 }
 
 void on_notebook_page_removed(GtkNotebook* notebook, GtkWidget* child, guint page_num, gpointer user_data) {
-    (void)child;
+    WATCHDOG_SCOPE("on_notebook_page_removed");
     (void)page_num;
     (void)user_data;
+
+    // Flush the session log while the terminal's buffer is still readable, and
+    // cancel a snapshot or paste still in flight, which would keep the closed terminal alive
+    VteTerminal* removed_vt = tab_page_get_terminal(child);
+    if (removed_vt) {
+        TabContext* ctx = tab_context_get(removed_vt);
+        if (ctx) {
+            if (ctx->title_tick)
+                gtk_widget_remove_tick_callback(ctx->label, ctx->title_tick);
+            ctx->title_tick = 0;
+            ctx->notebook = NULL;  // the label goes away with the page
+        }
+        session_log_stop(removed_vt);
+        compress_scrollback_cancel(removed_vt);
+        paste_cancel(removed_vt);
+    }
+
     // Always show tabs
     gtk_notebook_set_show_tabs(notebook, TRUE);
 
@@ -189,39 +310,50 @@ void on_notebook_page_removed(GtkNotebook* notebook, GtkWidget* child, guint pag
         // Update window title for the now-current page
         int current = gtk_notebook_get_current_page(notebook);
         if (current >= 0) {
-            GtkWidget* page = gtk_notebook_get_nth_page(notebook, current);
-            GtkWidget* vt_child = gtk_scrolled_window_get_child(GTK_SCROLLED_WINDOW(page));
-            if (vt_child && VTE_IS_TERMINAL(vt_child)) {
-                g_autofree char* title = get_terminal_title(VTE_TERMINAL(vt_child));
-                GtkWidget* window = gtk_widget_get_ancestor(GTK_WIDGET(notebook), GTK_TYPE_WINDOW);
-                if (window)
-                    gtk_window_set_title(GTK_WINDOW(window), title);
-                gtk_widget_grab_focus(vt_child);
+            VteTerminal* current_vt = tab_page_get_terminal(gtk_notebook_get_nth_page(notebook, current));
+            if (current_vt) {
+                TabContext* ctx = tab_context_get(current_vt);
+                if (ctx && ctx->title)
+                    set_window_title(notebook, ctx->title);
+                gtk_widget_grab_focus(GTK_WIDGET(current_vt));
             }
         }
     }
 }
 
+// Only the current page's terminal is visible. A hidden widget is neither
+// measured nor allocated, so resizing the window leaves background tabs alone:
+// no reflow of their scroll-back and no SIGWINCH to their shells. A tab gets
+// the window's final size once, in the allocation after it is shown again.
+static void tab_page_set_shown(GtkWidget* page, gboolean shown) {
+    VteTerminal* vt = tab_page_get_terminal(page);
+    if (vt)
+        gtk_widget_set_visible(GTK_WIDGET(vt), shown);
+}
+
 void on_notebook_switch_page(GtkNotebook* notebook, GtkWidget* page, guint page_num, gpointer user_data) {
+    WATCHDOG_SCOPE("on_notebook_switch_page");
     (void)page_num;
     (void)user_data;
 
-    if (!page || !GTK_IS_SCROLLED_WINDOW(page))
-        return;
-    GtkWidget* child = gtk_scrolled_window_get_child(GTK_SCROLLED_WINDOW(page));
-    if (!child || !VTE_IS_TERMINAL(child))
-        return;
-
-    VteTerminal* vt = VTE_TERMINAL(child);
+    // Runs before the notebook switches: the current page is still the one being left
+    int current = gtk_notebook_get_current_page(notebook);
+    GtkWidget* previous = current >= 0 ? gtk_notebook_get_nth_page(notebook, current) : NULL;
+    if (previous != page)
+        tab_page_set_shown(previous, FALSE);
+    tab_page_set_shown(page, TRUE);
 
-    // Update window title explicitly using the new page's terminal
-    g_autofree char* title = get_terminal_title(vt);
-    GtkWidget* window = gtk_widget_get_ancestor(GTK_WIDGET(notebook), GTK_TYPE_WINDOW);
-    if (window)
-        gtk_window_set_title(GTK_WINDOW(window), title);
+    VteTerminal* vt = tab_page_get_terminal(page);
+    if (!vt)
+        return;
 
-    // Also update the tab label just in case
-    update_tab_title(vt, notebook);
+    // The window shows the new page's title, which may still be waiting for the next frame
+    TabContext* ctx = tab_context_get(vt);
+    if (ctx) {
+        update_tab_title(ctx);
+        if (ctx->title)
+            set_window_title(notebook, ctx->title);
+    }
 
     // Ensure the terminal has focus
     gtk_widget_grab_focus(GTK_WIDGET(vt));
@@ -234,12 +366,14 @@ void close_current_tab(GtkNotebook* notebook) {
 }
 
 void title_tab_sig_cb_new(VteTerminal* vt, guint prop_id, gpointer user_data) {
+    (void)vt;
     (void)prop_id;
-    update_tab_title(vt, GTK_NOTEBOOK(user_data));
+    schedule_tab_title(user_data);
 }
 
 #if !VTE_CHECK_VERSION(0, 78, 0)
 void title_tab_sig_cb_old(VteTerminal* vt, gpointer user_data) {
-    update_tab_title(vt, GTK_NOTEBOOK(user_data));
+    (void)vt;
+    schedule_tab_title(user_data);
 }
 #endif
@@ -5,11 +5,28 @@
 
 G_BEGIN_DECLS
 
+// Per-tab state, attached to the terminal for the lifetime of the tab
+typedef struct {
+    VteTerminal* vt;
+    GtkNotebook* notebook;  // NULL once the page has been removed
+    GtkWidget* page;        // notebook page holding vt, see tab_page_get_terminal()
+    GtkWidget* tab_label;   // box: label, close button
+    GtkWidget* label;
+    char* title;  // last title shown
+    guint title_tick;
+} TabContext;
+
+extern gboolean tab_overlay_scrollbar;
+
+TabContext* tab_context_get(VteTerminal* vt);
+VteTerminal* tab_page_get_terminal(GtkWidget* page);
 VteTerminal* add_tab(GtkNotebook* notebook);
+VteTerminal* add_tab_full(GtkNotebook* notebook, const char* cwd, char** command, char** env);
+VteTerminal* add_tab_feed(GtkNotebook* notebook);
 void close_current_tab(GtkNotebook* notebook);
 void on_tab_close_clicked(GtkButton* btn, gpointer user_data);
-void on_child_exit_tab(VteTerminal* vt, int status, GtkNotebook* notebook);
-void update_tab_title(VteTerminal* vt, GtkNotebook* notebook);
+void on_child_exit_tab(VteTerminal* vt, int status, gpointer user_data);
+void update_tab_title(TabContext* ctx);
 void on_notebook_page_added(GtkNotebook* notebook, GtkWidget* child, guint page_num, gpointer user_data);
 void on_notebook_page_removed(GtkNotebook* notebook, GtkWidget* child, guint page_num, gpointer user_data);
 void on_notebook_switch_page(GtkNotebook* notebook, GtkWidget* page, guint page_num, gpointer user_data);
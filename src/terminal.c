@@ -1,26 +1,126 @@
 #include "terminal.h"
 #include "window.h"
 #include "clipboard.h"
+#include "paste.h"
 #include "tab.h"
+#include "shellpool.h"
+#include "startup.h"
+#include "hud.h"
+#include "latency.h"
+#include "record.h"
+#include "spill.h"
+#include "trace.h"
+#include "watchdog.h"
 
-#include <pwd.h>
+struct _MyTerminal {
+    VteTerminal parent_instance;
+    gint64 frame_interval;  // µs between drawn frames; 0 draws every frame
+    gint64 frame_time;      // when frame was drawn
+    GskRenderNode* frame;   // last drawn frame, shown again until the interval is up
+    int frame_width;
+    int frame_height;
+    guint redraw_source;
+};
+
+G_DEFINE_TYPE(MyTerminal, my_terminal, VTE_TYPE_TERMINAL)
+
+static gboolean my_terminal_redraw(gpointer user_data) {
+    MyTerminal* self = user_data;
+    self->redraw_source = 0;
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+    return G_SOURCE_REMOVE;
+}
+
+// While an interval is set, VTE draws at most once per interval. In between,
+// the widget repeats its previous frame and a timer queues the skipped redraw,
+// so output only shows up later; VTE still processes every byte.
+static void my_terminal_snapshot(GtkWidget* widget, GtkSnapshot* snapshot) {
+    MyTerminal* self = MY_TERMINAL(widget);
+    GtkWidgetClass* parent = GTK_WIDGET_CLASS(my_terminal_parent_class);
+    if (!self->frame_interval) {
+        parent->snapshot(widget, snapshot);
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    int width = gtk_widget_get_width(widget);
+    int height = gtk_widget_get_height(widget);
+    if (self->frame && now - self->frame_time < self->frame_interval && width == self->frame_width &&
+        height == self->frame_height) {
+        gtk_snapshot_append_node(snapshot, self->frame);
+        if (!self->redraw_source) {
+            guint delay_ms = (guint)((self->frame_time + self->frame_interval - now + 999) / 1000);
+            self->redraw_source = g_timeout_add(delay_ms, my_terminal_redraw, self);
+        }
+        return;
+    }
+
+    GtkSnapshot* own = gtk_snapshot_new();
+    parent->snapshot(widget, own);
+    g_clear_pointer(&self->frame, gsk_render_node_unref);
+    self->frame = gtk_snapshot_free_to_node(own);
+    self->frame_time = now;
+    self->frame_width = width;
+    self->frame_height = height;
+    if (self->frame)
+        gtk_snapshot_append_node(snapshot, self->frame);
+}
+
+static void my_terminal_dispose(GObject* object) {
+    MyTerminal* self = MY_TERMINAL(object);
+    g_clear_handle_id(&self->redraw_source, g_source_remove);
+    g_clear_pointer(&self->frame, gsk_render_node_unref);
+    G_OBJECT_CLASS(my_terminal_parent_class)->dispose(object);
+}
+
+static void my_terminal_class_init(MyTerminalClass* klass) {
+    G_OBJECT_CLASS(klass)->dispose = my_terminal_dispose;
+    GTK_WIDGET_CLASS(klass)->snapshot = my_terminal_snapshot;
+}
+
+static void my_terminal_init(MyTerminal* self) {
+    (void)self;
+}
+
+GtkWidget* my_terminal_new(void) {
+    return g_object_new(MY_TYPE_TERMINAL, NULL);
+}
+
+void my_terminal_set_frame_interval(MyTerminal* self, gint64 interval_us) {
+    if (self->frame_interval == interval_us)
+        return;
+    self->frame_interval = interval_us;
+    if (!interval_us) {
+        // back to every frame: drop the held frame and show the current contents
+        g_clear_handle_id(&self->redraw_source, g_source_remove);
+        g_clear_pointer(&self->frame, gsk_render_node_unref);
+        gtk_widget_queue_draw(GTK_WIDGET(self));
+    }
+}
 
 static void spawn_finished_cb(GObject* source_object, GAsyncResult* res, gpointer user_data) {
+    WATCHDOG_SCOPE("spawn_finished_cb");
+    TRACE_SCOPE("spawn_finished_cb");
     VtePty* pty = VTE_PTY(source_object);
     VteTerminal* vt = VTE_TERMINAL(user_data);
     GPid child_pid = 0;
     GError* error = NULL;
 
     gboolean success = vte_pty_spawn_finish(pty, res, &child_pid, &error);
+    trace_async_end("shell_start", vt);
     if (!success || child_pid <= 0) {
         g_printerr("Error spawning shell: %s\n", (error ? error->message : "(unknown)"));
         g_clear_error(&error);
+        g_object_unref(vt);
         return;
     }
 
     g_print("Spawned shell (PID=%d)\n", (int)child_pid);
+    startup_mark(STARTUP_SPAWN);
 
     vte_terminal_watch_child(vt, child_pid);
+    record_start(vt);
+    g_object_unref(vt);
 }
 
 void setup_background_color(VteTerminal* vt) {
@@ -39,7 +139,7 @@ void setup_terminal(VteTerminal* vt) {
     vte_terminal_set_font(vt, fd);
     pango_font_description_free(fd);
 
-    vte_terminal_set_scrollback_lines(vt, scrollback_enabled ? 100000 : 0);
+    vte_terminal_set_scrollback_lines(vt, scrollback_enabled ? TERMINAL_SCROLLBACK_LINES : 0);
     vte_terminal_set_scroll_on_output(vt, FALSE);
     vte_terminal_set_scroll_on_keystroke(vt, TRUE);
 #if VTE_CHECK_VERSION(0, 78, 0)
@@ -61,12 +161,11 @@ void setup_key_events(VteTerminal* vt) {
 }
 
 void on_selection_changed(VteTerminal* vt, gpointer user_data) {
+    WATCHDOG_SCOPE("on_selection_changed");
     (void)user_data;
 
-    if (!vte_terminal_get_has_selection(vt))
-        return;
-
-    vte_terminal_copy_clipboard_format(vt, VTE_FORMAT_TEXT);
+    // copied once the selection stops changing, not on every drag step
+    clipboard_selection_changed(vt);
 }
 
 gboolean on_key_pressed(GtkEventControllerKey* ctrl,
@@ -74,23 +173,36 @@ gboolean on_key_pressed(GtkEventControllerKey* ctrl,
                         guint keycode,
                         GdkModifierType state,
                         gpointer user_data) {
+    WATCHDOG_SCOPE("on_key_pressed");
     VteTerminal* vt = VTE_TERMINAL(user_data);
 
     if ((state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) == (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) {
         switch (keyval) {
             case GDK_KEY_C:
-                vte_terminal_copy_clipboard_format(vt, VTE_FORMAT_TEXT);
+                clipboard_copy_selection(vt);
                 return TRUE;
             case GDK_KEY_V:
-                vte_terminal_paste_clipboard(vt);
+                paste_clipboard_async(vt);
                 return TRUE;
             case GDK_KEY_A:
-                vte_terminal_select_all(vt);
-                vte_terminal_copy_clipboard_format(vt, VTE_FORMAT_TEXT);
+                clipboard_copy_all(vt);
                 return TRUE;
             case GDK_KEY_B:
-                // compress via select-all -> copy -> read clipboard
-                compress_scrollback_via_clipboard_async(vt);
+                // capture scrollback rows in chunks and compress them off-thread
+                switch (compress_scrollback_async(vt)) {
+                    case COMPRESS_MERGED:
+                        g_print("Scroll-back snapshot already running for this tab; extended to the current end\n");
+                        break;
+                    case COMPRESS_THROTTLED:
+                        g_print("Scroll-back snapshot queued behind other snapshots\n");
+                        break;
+                    case COMPRESS_STARTED:
+                        break;
+                }
+                return TRUE;
+
+            case GDK_KEY_O:
+                spill_open_history(vt);
                 return TRUE;
 
             case GDK_KEY_T: {
@@ -104,6 +216,17 @@ gboolean on_key_pressed(GtkEventControllerKey* ctrl,
                 update_scrollback_all();
                 return TRUE;
             }
+            case GDK_KEY_L: {
+                session_logging_enabled = !session_logging_enabled;
+                update_session_logging_all();
+                return TRUE;
+            }
+            case GDK_KEY_H:
+                hud_toggle_all();
+                return TRUE;
+            case GDK_KEY_K:
+                latency_toggle();
+                return TRUE;
             case GDK_KEY_N: {
                 GtkNotebook* notebook = get_notebook_from_terminal(vt);
                 if (notebook) {
@@ -111,6 +234,13 @@ gboolean on_key_pressed(GtkEventControllerKey* ctrl,
                 }
                 return TRUE;
             }
+            case GDK_KEY_R: {
+                GtkNotebook* notebook = get_notebook_from_terminal(vt);
+                if (notebook) {
+                    record_new_tab(notebook);
+                }
+                return TRUE;
+            }
             case GDK_KEY_W: {
                 GtkNotebook* notebook = get_notebook_from_terminal(vt);
                 if (notebook) {
@@ -123,39 +253,88 @@ gboolean on_key_pressed(GtkEventControllerKey* ctrl,
     return FALSE;
 }
 
-static const char* get_user_shell(void) {
-    const char* shell = g_getenv("SHELL");
-    if (shell && *shell)
-        return shell;
-
-    struct passwd* pw = getpwuid(getuid());
-    if (pw && pw->pw_shell && *pw->pw_shell)
-        return pw->pw_shell;
+typedef struct {
+    VteTerminal* vt;
+    gchar* cwd;
+    gchar** command;
+    gchar** env;
+    gboolean record;
+    VtePty* term_pty;  // recorded tabs: the terminal's PTY, while the shell's is opened
+} ShellRequest;
 
-    return "/bin/sh";
+static void shell_request_free(ShellRequest* req) {
+    g_object_unref(req->vt);
+    g_clear_object(&req->term_pty);
+    g_free(req->cwd);
+    g_strfreev(req->command);
+    g_strfreev(req->env);
+    g_free(req);
 }
 
-void setup_pty_and_shell(VteTerminal* vt) {
-    const char* shell = get_user_shell();
-
-    char* argv[] = {(char*)shell, NULL};
-    char** envp = g_environ_setenv(g_get_environ(), "TERM", "xterm-256color", TRUE);
-
+static void on_pty_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+    WATCHDOG_SCOPE("on_pty_ready");
+    TRACE_SCOPE("on_pty_ready");
+    ShellRequest* req = user_data;
+    VteTerminal* vt = req->vt;
     GError* err = NULL;
-    VtePty* pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, &err);
+    VtePty* pty = shell_pty_new_finish(res, &err);
     if (!pty) {
         g_printerr("Failed to create PTY: %s\n", err ? err->message : "(unknown error)");
         g_clear_error(&err);
-        g_strfreev(envp);
+        if (!req->term_pty) {
+            trace_async_end("shell_start", vt);
+            shell_request_free(req);
+            return;
+        }
+        // no second PTY: run the shell unrecorded
+        pty = g_steal_pointer(&req->term_pty);
+        req->record = FALSE;
+    }
+
+    // the tab may have been closed while the PTY was being opened
+    TabContext* ctx = tab_context_get(vt);
+    if (ctx && !ctx->notebook) {
+        trace_async_end("shell_start", vt);
+        g_object_unref(pty);
+        shell_request_free(req);
         return;
     }
 
-    vte_terminal_set_pty(vt, pty);
+    // a recorded tab's shell runs on a PTY of its own, relayed to the terminal's (see record.c)
+    if (req->record && !req->term_pty) {
+        req->term_pty = pty;
+        shell_pty_new_async(NULL, on_pty_ready, req);
+        return;
+    }
+    VtePty* shell_pty = pty;
+    vte_terminal_set_pty(vt, req->term_pty ? req->term_pty : pty);
+    if (req->term_pty && !record_prepare(vt, pty))
+        shell_pty = req->term_pty;
     vte_terminal_set_input_enabled(vt, TRUE);
+    startup_mark(STARTUP_PTY);
+    shell_spawn_async(shell_pty, req->cwd, req->command, req->env, spawn_finished_cb, g_object_ref(vt));
+    g_object_unref(pty);
+    shell_request_free(req);
+}
 
-    GSpawnFlags spawn_flags = g_path_is_absolute(shell) ? (GSpawnFlags)0 : G_SPAWN_SEARCH_PATH;
-    vte_pty_spawn_async(pty, NULL, argv, envp, spawn_flags, NULL, NULL, NULL, -1, NULL, spawn_finished_cb, vt);
+// Start command (the user's shell if NULL) in cwd (ours if NULL) with env (ours if NULL) on a new PTY for vt.
+void setup_pty_and_shell(VteTerminal* vt, const char* cwd, char** command, char** env) {
+    TRACE_SCOPE("setup_pty_and_shell");
+    // a pooled shell has already drawn its prompt, but only a default, unrecorded one will do
+    gboolean record = record_wanted();
+    if (!cwd && !command && !env && !record && shell_pool_adopt(vt)) {
+        vte_terminal_set_input_enabled(vt, TRUE);
+        startup_mark(STARTUP_PTY);
+        startup_mark(STARTUP_SPAWN);
+        return;
+    }
 
-    g_strfreev(envp);
-    g_object_unref(pty);
+    ShellRequest* req = g_new0(ShellRequest, 1);
+    req->vt = g_object_ref(vt);
+    req->cwd = g_strdup(cwd);
+    req->command = g_strdupv(command);
+    req->env = g_strdupv(env);
+    req->record = record;
+    trace_async_begin("shell_start", vt);  // ends when the shell is running
+    shell_pty_new_async(NULL, on_pty_ready, req);
 }
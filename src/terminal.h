@@ -5,11 +5,20 @@
 
 G_BEGIN_DECLS
 
+#define TERMINAL_SCROLLBACK_LINES 100000  // per tab, while scrollback is on
+
+// VteTerminal that can be held to a lower frame rate (see throttle.c)
+#define MY_TYPE_TERMINAL (my_terminal_get_type())
+G_DECLARE_FINAL_TYPE(MyTerminal, my_terminal, MY, TERMINAL, VteTerminal)
+
+GtkWidget* my_terminal_new(void);
+void my_terminal_set_frame_interval(MyTerminal* self, gint64 interval_us);
+
 void setup_background_color(VteTerminal* vt);
 void setup_terminal(VteTerminal* vt);
 void vte_set_robust_word_chars(VteTerminal* vt);
 void setup_key_events(VteTerminal* vt);
-void setup_pty_and_shell(VteTerminal* vt);
+void setup_pty_and_shell(VteTerminal* vt, const char* cwd, char** command, char** env);
 void on_selection_changed(VteTerminal* vt, gpointer user_data);
 gboolean on_key_pressed(GtkEventControllerKey* ctrl,
                         guint keyval,
@@ -0,0 +1,143 @@
+#include "throttle.h"
+#include "tab.h"
+#include "terminal.h"
+#include "watchdog.h"
+
+// Firehose protection. All tabs of all windows share the main loop, so a tab
+// printing as fast as its shell can write takes frame time from every other
+// one. While any tab prints, each tab's output rate is sampled every
+// THROTTLE_SAMPLE_MS. A tab over the firehose rate for a while is drawn at
+// --firehose-fps only (VTE still reads and processes everything, frames in
+// between are skipped) and its tab label gets a marker, until it has been calm
+// for a second. Tabs in the background are not drawn at all: their terminals
+// are hidden (see on_notebook_switch_page), so VTE works through their output
+// in whatever chunks it reads without laying out or painting anything.
+
+#define THROTTLE_KEY "1term-throttle"
+#define THROTTLE_SAMPLE_MS 250
+#define THROTTLE_SAMPLE_ROWS 64  // newest rows read to estimate bytes per row
+#define THROTTLE_FIREHOSE_ROWS 10000
+#define THROTTLE_FIREHOSE_BYTES (8 << 20)
+#define THROTTLE_BUSY_SAMPLES 2  // over the firehose rate for this many samples to throttle
+#define THROTTLE_CALM_SAMPLES 4  // under a quarter of it for this many samples to stop
+
+guint throttle_firehose_fps = 15;
+
+typedef struct {
+    VteTerminal* vt;  // not a reference: the entry goes with the terminal
+    gint64 time;
+    glong row;  // end of the buffer at the last sample
+    double rows_per_s;
+    double bytes_per_s;
+    guint busy;
+    guint calm;
+    gboolean firehose;
+    GtkWidget* marker;  // in the tab label while firehosing
+} ThrottleTab;
+
+static GList* tabs = NULL;
+static guint sample_source = 0;
+
+static void throttle_tab_free(gpointer data) {
+    ThrottleTab* t = data;
+    tabs = g_list_remove(tabs, t);
+    g_free(t);
+}
+
+// Rows and bytes per second since the previous sample. VTE reads the PTY
+// itself and does not count bytes, so bytes are rows times the average text
+// length of the newest rows; escape sequences are not counted.
+static void throttle_sample(ThrottleTab* t, gint64 now) {
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(t->vt));
+    glong first = (glong)gtk_adjustment_get_lower(adj);
+    glong end = (glong)gtk_adjustment_get_upper(adj);  // grows with output, see hud.c
+    glong rows = t->time && end >= t->row ? end - t->row : 0;
+    double dt = t->time ? (now - t->time) / (double)G_USEC_PER_SEC : 0;
+    t->time = now;
+    t->row = end;
+    if (rows == 0 || dt <= 0) {
+        t->rows_per_s = 0;
+        t->bytes_per_s = 0;
+        return;
+    }
+
+    glong from = MAX(end - MIN(rows, THROTTLE_SAMPLE_ROWS), first);
+    gsize len = 0;
+    if (end > from) {
+        char* text = vte_terminal_get_text_range_format(t->vt, VTE_FORMAT_TEXT, from, 0, end, 0, &len);
+        g_free(text);
+    }
+    t->rows_per_s = rows / dt;
+    t->bytes_per_s = end > from ? (double)len * rows / (end - from) / dt : 0;
+}
+
+static void throttle_update_marker(ThrottleTab* t) {
+    TabContext* ctx = tab_context_get(t->vt);
+    if (!ctx || !ctx->notebook)
+        return;  // the label went with the page
+    if (!t->firehose) {
+        if (t->marker)
+            gtk_box_remove(GTK_BOX(ctx->tab_label), t->marker);
+        t->marker = NULL;
+        return;
+    }
+    if (!t->marker) {
+        t->marker = gtk_label_new("»");
+        gtk_box_prepend(GTK_BOX(ctx->tab_label), t->marker);
+    }
+    g_autofree char* rate = g_format_size((guint64)t->bytes_per_s);
+    g_autofree char* tip = throttle_firehose_fps
+                               ? g_strdup_printf("Heavy output: %s/s, %.0f rows/s; drawn at %u fps",
+                                                 rate, t->rows_per_s, throttle_firehose_fps)
+                               : g_strdup_printf("Heavy output: %s/s, %.0f rows/s", rate, t->rows_per_s);
+    gtk_widget_set_tooltip_text(t->marker, tip);
+}
+
+static gboolean throttle_check(gpointer user_data) {
+    WATCHDOG_SCOPE("throttle_check");
+    (void)user_data;
+    gint64 now = g_get_monotonic_time();
+    gboolean active = FALSE;
+    for (GList* l = tabs; l; l = l->next) {
+        ThrottleTab* t = l->data;
+        throttle_sample(t, now);
+        active = active || t->rows_per_s > 0 || t->firehose;
+        gboolean busy = t->rows_per_s >= THROTTLE_FIREHOSE_ROWS || t->bytes_per_s >= THROTTLE_FIREHOSE_BYTES;
+        gboolean calm =
+            t->rows_per_s < THROTTLE_FIREHOSE_ROWS / 4 && t->bytes_per_s < THROTTLE_FIREHOSE_BYTES / 4;
+        t->busy = busy ? t->busy + 1 : 0;
+        t->calm = calm ? t->calm + 1 : 0;
+
+        gboolean firehose = t->firehose ? t->calm < THROTTLE_CALM_SAMPLES : t->busy >= THROTTLE_BUSY_SAMPLES;
+        if (firehose != t->firehose) {
+            t->firehose = firehose;
+            if (MY_IS_TERMINAL(t->vt)) {
+                gint64 interval = firehose && throttle_firehose_fps ? G_USEC_PER_SEC / throttle_firehose_fps : 0;
+                my_terminal_set_frame_interval(MY_TERMINAL(t->vt), interval);
+            }
+        }
+        if (t->firehose || t->marker)
+            throttle_update_marker(t);
+    }
+    if (!active) {
+        sample_source = 0;  // idle: the next output starts sampling again
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_throttle_contents_changed(VteTerminal* vt, gpointer user_data) {
+    (void)vt;
+    (void)user_data;
+    if (!sample_source)
+        sample_source = g_timeout_add(THROTTLE_SAMPLE_MS, throttle_check, NULL);
+}
+
+// Sample vt's output rate and throttle it while it firehoses
+void throttle_watch_terminal(VteTerminal* vt) {
+    ThrottleTab* t = g_new0(ThrottleTab, 1);
+    t->vt = vt;
+    g_object_set_data_full(G_OBJECT(vt), THROTTLE_KEY, t, throttle_tab_free);
+    tabs = g_list_prepend(tabs, t);
+    g_signal_connect(vt, "contents-changed", G_CALLBACK(on_throttle_contents_changed), NULL);
+}
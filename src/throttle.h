@@ -0,0 +1,14 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+extern guint throttle_firehose_fps;
+
+void throttle_watch_terminal(VteTerminal* vt);
+
+G_END_DECLS
+
+#endif  // THROTTLE_H
@@ -0,0 +1,257 @@
+#define _GNU_SOURCE  // syscall(), pthread_getname_np()
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <sys/syscall.h>
+
+// Trace-event export (--trace=FILE or ONETERM_TRACE=FILE) in the JSON array
+// format that Perfetto and chrome://tracing load. Each thread appends events
+// to a chunk of its own without locking; a full chunk goes to a writer
+// thread, which formats it, so recording an event costs a clock read and a
+// few stores. Timestamps are g_get_monotonic_time() microseconds, the same
+// clock the startup marks and the HUD use. At exit the chunks still being
+// filled are written too and the array is closed; a trace cut short by a
+// crash still loads.
+
+#define TRACE_CHUNK_EVENTS 1024
+#define TRACE_MAX_BYTES ((gint64)256 << 20)  // later events are counted, not written
+
+typedef struct {
+    const char* name;
+    const char* cat;
+    gint64 ts;
+    gint64 dur;
+    gconstpointer id;  // async events
+    gint64 bytes;      // -1 for none
+    char ph;
+} TraceEvent;
+
+typedef struct {
+    int tid;
+    char thread_name[16];
+    guint n;  // written last, so a reader sees only complete events
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+} TraceChunk;
+
+// One per thread that has recorded an event
+typedef struct {
+    int tid;
+    char name[16];
+    TraceChunk* chunk;
+} TraceThread;
+
+gboolean trace_enabled = FALSE;
+
+static void trace_thread_exit(gpointer data);
+static GPrivate current_thread = G_PRIVATE_INIT(trace_thread_exit);
+
+static GMutex lock;  // threads, stopped and the chunk each thread is filling
+static GPtrArray* threads;
+static gboolean stopped;
+static GAsyncQueue* queue;
+static GThread* writer;
+static char writer_end;
+
+// Only the writer thread, or the main thread once it has been joined
+static FILE* out;
+static char* out_path;
+static gint64 out_bytes;
+static guint64 dropped;
+static GHashTable* named_tids;
+static int pid;
+
+static TraceChunk* trace_chunk_new(const TraceThread* t) {
+    TraceChunk* c = g_new(TraceChunk, 1);
+    c->tid = t->tid;
+    memcpy(c->thread_name, t->name, sizeof(c->thread_name));
+    c->n = 0;
+    return c;
+}
+
+static void trace_submit(TraceChunk* c) {
+    if (c->n == 0) {
+        g_free(c);
+        return;
+    }
+    g_async_queue_push(queue, c);
+}
+
+static TraceThread* trace_thread_get(void) {
+    TraceThread* t = g_private_get(&current_thread);
+    if (t)
+        return t;
+    t = g_new0(TraceThread, 1);
+    t->tid = (int)syscall(SYS_gettid);
+    if (pthread_getname_np(pthread_self(), t->name, sizeof(t->name)) != 0)
+        g_strlcpy(t->name, "?", sizeof(t->name));
+    t->chunk = trace_chunk_new(t);
+    g_mutex_lock(&lock);
+    g_ptr_array_add(threads, t);
+    g_mutex_unlock(&lock);
+    g_private_set(&current_thread, t);
+    return t;
+}
+
+static void trace_thread_exit(gpointer data) {
+    TraceThread* t = data;
+    g_mutex_lock(&lock);
+    g_ptr_array_remove_fast(threads, t);
+    if (!stopped)
+        trace_submit(t->chunk);
+    // after shutdown the chunk has been written; leave it to the exiting process
+    g_mutex_unlock(&lock);
+    g_free(t);
+}
+
+static void trace_record(char ph, const char* cat, const char* name, gint64 ts, gint64 dur, gconstpointer id,
+                         gint64 bytes) {
+    TraceThread* t = trace_thread_get();
+    TraceChunk* c = t->chunk;
+    if (c->n == TRACE_CHUNK_EVENTS) {
+        g_mutex_lock(&lock);
+        if (stopped) {
+            g_mutex_unlock(&lock);
+            return;
+        }
+        trace_submit(c);
+        c = t->chunk = trace_chunk_new(t);
+        g_mutex_unlock(&lock);
+    }
+    TraceEvent* e = &c->events[c->n];
+    e->ph = ph;
+    e->cat = cat;
+    e->name = name;
+    e->ts = ts;
+    e->dur = dur;
+    e->id = id;
+    e->bytes = bytes;
+    g_atomic_int_set((gint*)&c->n, (gint)c->n + 1);
+}
+
+static void trace_write_chunk(const TraceChunk* c, guint n) {
+    if (!g_hash_table_contains(named_tids, GINT_TO_POINTER(c->tid))) {
+        g_hash_table_add(named_tids, GINT_TO_POINTER(c->tid));
+        g_autofree char* name = g_strescape(c->thread_name, NULL);
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", pid,
+                c->tid, name);
+    }
+    for (guint i = 0; i < n; i++) {
+        if (out_bytes >= TRACE_MAX_BYTES) {
+            dropped += n - i;
+            return;
+        }
+        const TraceEvent* e = &c->events[i];
+        int len = fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT
+                          ",\"pid\":%d,\"tid\":%d",
+                          e->name, e->cat, e->ph, e->ts, pid, c->tid);
+        if (e->ph == 'X')
+            len += fprintf(out, ",\"dur\":%" G_GINT64_FORMAT, e->dur);
+        else
+            len += fprintf(out, ",\"id\":\"%p\"", e->id);
+        if (e->bytes >= 0)
+            len += fprintf(out, ",\"args\":{\"bytes\":%" G_GINT64_FORMAT "}", e->bytes);
+        len += fprintf(out, "}");
+        out_bytes += MAX(len, 0);
+    }
+}
+
+static gpointer trace_writer(gpointer data) {
+    (void)data;
+    for (;;) {
+        TraceChunk* c = g_async_queue_pop(queue);
+        if (c == (gpointer)&writer_end)
+            break;
+        trace_write_chunk(c, c->n);
+        g_free(c);
+    }
+    return NULL;
+}
+
+TraceSpan trace_span_begin(const char* name) {
+    TraceSpan span = {name, trace_enabled ? g_get_monotonic_time() : 0};
+    return span;
+}
+
+void trace_span_end(TraceSpan* span) {
+    if (span->start)
+        trace_complete(span->name, span->start, g_get_monotonic_time(), -1);
+}
+
+// 0 while tracing is off, so callers can skip trace_complete() cheaply
+gint64 trace_now(void) {
+    return trace_enabled ? g_get_monotonic_time() : 0;
+}
+
+void trace_complete(const char* name, gint64 start_us, gint64 end_us, gint64 bytes) {
+    if (trace_enabled && start_us)
+        trace_record('X', "1term", name, start_us, end_us - start_us, NULL, bytes);
+}
+
+// Spans that begin in one callback and end in another; id tells overlapping ones apart
+void trace_async_begin(const char* name, gconstpointer id) {
+    if (trace_enabled)
+        trace_record('b', "1term", name, g_get_monotonic_time(), 0, id, -1);
+}
+
+void trace_async_end(const char* name, gconstpointer id) {
+    if (trace_enabled)
+        trace_record('e', "1term", name, g_get_monotonic_time(), 0, id, -1);
+}
+
+// LogzOptions.phase: compress, write and fsync of archive frames
+void trace_logz_phase(const char* name, gint64 start_us, gint64 end_us, gsize bytes) {
+    if (trace_enabled)
+        trace_record('X', "logz", name, start_us, end_us - start_us, NULL, (gint64)bytes);
+}
+
+gboolean trace_start(const char* path) {
+    if (trace_enabled)
+        return TRUE;
+    out = fopen(path, "w");
+    if (!out) {
+        g_printerr("1term: trace %s: %s\n", path, g_strerror(errno));
+        return FALSE;
+    }
+    out_path = g_strdup(path);
+    pid = getpid();
+    fprintf(out, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"1term\"}}",
+            pid, pid);
+    named_tids = g_hash_table_new(NULL, NULL);
+    threads = g_ptr_array_new();
+    queue = g_async_queue_new();
+    writer = g_thread_new("1term-trace", trace_writer, NULL);
+    trace_enabled = TRUE;
+    return TRUE;
+}
+
+void trace_shutdown(void) {
+    if (!trace_enabled)
+        return;
+    trace_enabled = FALSE;
+
+    g_mutex_lock(&lock);
+    stopped = TRUE;
+    g_mutex_unlock(&lock);
+    g_async_queue_push(queue, &writer_end);
+    g_thread_join(writer);
+
+    // what every thread still running has recorded since its last full chunk
+    g_mutex_lock(&lock);
+    for (guint i = 0; i < threads->len; i++) {
+        TraceChunk* c = ((TraceThread*)g_ptr_array_index(threads, i))->chunk;
+        trace_write_chunk(c, (guint)g_atomic_int_get((gint*)&c->n));
+    }
+    g_mutex_unlock(&lock);
+
+    fprintf(out, "\n]\n");
+    if (fclose(out) != 0)
+        g_printerr("1term: trace %s: %s\n", out_path, g_strerror(errno));
+    else if (dropped)
+        g_printerr("1term: trace %s: %" G_GUINT64_FORMAT " events past the size limit were dropped\n", out_path,
+                   dropped);
+    else
+        g_printerr("1term: trace written to %s\n", out_path);
+    out = NULL;
+    g_clear_pointer(&out_path, g_free);
+}
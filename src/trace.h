@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+extern gboolean trace_enabled;
+
+typedef struct {
+    const char* name;
+    gint64 start;  // 0 while tracing is off
+} TraceSpan;
+
+// Records the enclosing block as a span named name (a string literal)
+#define TRACE_SCOPE(name) \
+    G_GNUC_UNUSED __attribute__((cleanup(trace_span_end))) TraceSpan trace_span_ = trace_span_begin(name)
+
+TraceSpan trace_span_begin(const char* name);
+void trace_span_end(TraceSpan* span);
+
+gint64 trace_now(void);
+void trace_complete(const char* name, gint64 start_us, gint64 end_us, gint64 bytes);
+void trace_async_begin(const char* name, gconstpointer id);
+void trace_async_end(const char* name, gconstpointer id);
+void trace_logz_phase(const char* name, gint64 start_us, gint64 end_us, gsize bytes);
+
+gboolean trace_start(const char* path);
+void trace_shutdown(void);
+
+G_END_DECLS
+
+#endif  // TRACE_H
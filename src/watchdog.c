@@ -0,0 +1,227 @@
+#define _GNU_SOURCE  // pthread_kill(), SA_RESTART
+
+#include "watchdog.h"
+
+#include <pthread.h>
+#include <signal.h>
+#ifdef __GLIBC__
+#include <execinfo.h>
+#endif
+
+// Main-loop stall watchdog (--watchdog[=MS]). A thread queues a high-priority
+// idle source on the main context several times per threshold; when the loop
+// has not run one for longer than the threshold, the main thread is stuck in
+// a handler. The thread then notes which 1term handlers are on the main
+// thread's stack (the WATCHDOG_SCOPE tags), interrupts the main thread once to
+// take a stack sample, waits for the loop to come back and appends the report
+// to ~/.1term/logs/stalls.log. The first heartbeat waits without a deadline,
+// so startup before the main loop runs is not reported.
+
+#define WATCHDOG_DEFAULT_MS 100
+#define WATCHDOG_DEPTH 8
+#define WATCHDOG_FRAMES 48
+#define WATCHDOG_SAMPLE_WAIT_MS 50
+#define WATCHDOG_SIGNAL SIGPROF
+
+// Handlers open on the main thread, innermost last. Only the main thread
+// writes; the watchdog reads a possibly torn but always printable copy.
+static const char* volatile scopes[WATCHDOG_DEPTH];
+static volatile gint scope_depth;
+static const char* volatile last_scope;
+static gboolean scopes_enabled = FALSE;
+
+static GThread* thread;
+static GMutex lock;
+static GCond cond;
+static gboolean stopping;
+static guint64 acked;
+static gint64 alive_us;  // when the main loop last ran a heartbeat
+static guint threshold_us;
+static pthread_t main_thread;
+static gboolean sampling;
+
+static void* sample[WATCHDOG_FRAMES];
+static volatile int sample_frames;
+static volatile gint sample_ready;
+
+const char* watchdog_enter(const char* name) {
+    if (!scopes_enabled)
+        return NULL;
+    gint depth = g_atomic_int_get(&scope_depth);
+    if (depth < WATCHDOG_DEPTH)
+        scopes[depth] = name;
+    g_atomic_int_set(&scope_depth, depth + 1);
+    return name;
+}
+
+void watchdog_leave(const char** scope) {
+    if (!*scope)
+        return;
+    last_scope = *scope;
+    g_atomic_int_add(&scope_depth, -1);
+}
+
+#ifdef __GLIBC__
+// backtrace() is not on the async-signal-safe list only because its first call
+// may load libgcc; watchdog_start() makes that call before installing this.
+static void on_sample_signal(int sig) {
+    (void)sig;
+    sample_frames = backtrace(sample, WATCHDOG_FRAMES);
+    g_atomic_int_set(&sample_ready, 1);
+}
+#endif
+
+static gboolean on_heartbeat(gpointer user_data) {
+    g_mutex_lock(&lock);
+    acked = MAX(acked, GPOINTER_TO_SIZE(user_data));
+    alive_us = g_get_monotonic_time();
+    g_cond_signal(&cond);
+    g_mutex_unlock(&lock);
+    return G_SOURCE_REMOVE;
+}
+
+static void send_heartbeat(guint64 seq) {
+    GSource* source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_HIGH);
+    g_source_set_callback(source, on_heartbeat, GSIZE_TO_POINTER(seq), NULL);
+    g_source_set_static_name(source, "1term-watchdog");
+    g_source_attach(source, NULL);
+    g_source_unref(source);
+}
+
+// Interrupts the main thread and waits briefly for its stack
+static int take_sample(void) {
+    if (!sampling)
+        return 0;
+    g_atomic_int_set(&sample_ready, 0);
+    if (pthread_kill(main_thread, WATCHDOG_SIGNAL) != 0)
+        return 0;
+    for (int waited = 0; waited < WATCHDOG_SAMPLE_WAIT_MS; waited++) {
+        if (g_atomic_int_get(&sample_ready))
+            return sample_frames;
+        g_usleep(1000);
+    }
+    return 0;
+}
+
+static void write_report(gint64 start_us, gint64 stall_us, const char* where, int frames) {
+    g_autofree char* dir = g_build_filename(g_get_home_dir(), ".1term", "logs", NULL);
+    g_autofree char* path = g_build_filename(dir, "stalls.log", NULL);
+    g_printerr("1term: main loop stalled %" G_GINT64_FORMAT " ms in %s (see %s)\n", stall_us / 1000, where, path);
+
+    if (g_mkdir_with_parents(dir, 0700) != 0)
+        return;
+    FILE* f = fopen(path, "a");
+    if (!f)
+        return;
+    g_autoptr(GDateTime) when = g_date_time_new_from_unix_local(start_us / G_USEC_PER_SEC);
+    g_autofree char* stamp = g_date_time_format(when, "%Y-%m-%d %H:%M:%S");
+    fprintf(f, "%s  stall %" G_GINT64_FORMAT " ms  %s\n", stamp, stall_us / 1000, where);
+#ifdef __GLIBC__
+    // Resolve the 1term frames with: addr2line -f -e 1term <offset>
+    char** symbols = frames > 0 ? backtrace_symbols(sample, frames) : NULL;
+    for (int i = 2; symbols && i < frames; i++)  // skip the signal handler and its trampoline
+        fprintf(f, "    #%-2d %s\n", i - 2, symbols[i]);
+    free(symbols);
+#else
+    (void)frames;
+#endif
+    fclose(f);
+}
+
+// "outer > inner" for the open scopes, or the last one that ran when none is open
+static char* describe_scopes(void) {
+    gint depth = g_atomic_int_get(&scope_depth);
+    if (depth <= 0) {
+        const char* last = last_scope;
+        return last ? g_strdup_printf("GTK/VTE, outside 1term handlers (last: %s)", last)
+                    : g_strdup("GTK/VTE, outside 1term handlers");
+    }
+    GString* s = g_string_new(NULL);
+    for (gint i = 0; i < MIN(depth, WATCHDOG_DEPTH); i++) {
+        const char* name = scopes[i];
+        g_string_append_printf(s, "%s%s", i ? " > " : "", name ? name : "?");
+    }
+    if (depth > WATCHDOG_DEPTH)
+        g_string_append(s, " > ...");
+    return g_string_free(s, FALSE);
+}
+
+static gpointer watchdog_main(gpointer data) {
+    (void)data;
+    guint64 seq = 0;
+
+    g_mutex_lock(&lock);
+    send_heartbeat(++seq);
+    while (!stopping && acked < seq)
+        g_cond_wait(&cond, &lock);
+
+    while (!stopping) {
+        // Four heartbeats per threshold: a stall is caught at most a quarter threshold late
+        gint64 next = g_get_monotonic_time() + threshold_us / 4;
+        while (!stopping && g_cond_wait_until(&cond, &lock, next))
+            ;
+        if (stopping)
+            break;
+
+        gint64 alive = alive_us;
+        send_heartbeat(++seq);
+        while (!stopping && acked < seq && g_cond_wait_until(&cond, &lock, alive + threshold_us))
+            ;
+        if (stopping || acked >= seq)
+            continue;
+
+        // Stalled: attribute while the handler is still running
+        gint64 start_real = g_get_real_time() - (g_get_monotonic_time() - alive);
+        g_autofree char* where = describe_scopes();
+        g_mutex_unlock(&lock);
+        int frames = take_sample();
+        g_mutex_lock(&lock);
+        while (!stopping && acked < seq)
+            g_cond_wait(&cond, &lock);
+        if (stopping)
+            break;  // the loop has quit; exiting is not a stall
+        gint64 stall_us = alive_us - alive;
+        g_mutex_unlock(&lock);
+        write_report(start_real, stall_us, where, frames);
+        g_mutex_lock(&lock);
+    }
+    g_mutex_unlock(&lock);
+    return NULL;
+}
+
+// Call from the main thread before the main loop runs; 0 picks the default threshold
+void watchdog_start(guint threshold_ms) {
+    if (thread)
+        return;
+    threshold_us = (threshold_ms ? threshold_ms : WATCHDOG_DEFAULT_MS) * 1000;
+    main_thread = pthread_self();
+
+#ifdef __GLIBC__
+    // Leave any existing SIGPROF user (a profiler) alone and go without stacks
+    struct sigaction old;
+    if (sigaction(WATCHDOG_SIGNAL, NULL, &old) == 0 && old.sa_handler == SIG_DFL) {
+        void* prime[1];
+        backtrace(prime, 1);
+        struct sigaction sa = {0};
+        sa.sa_handler = on_sample_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sampling = sigaction(WATCHDOG_SIGNAL, &sa, NULL) == 0;
+    }
+#endif
+
+    scopes_enabled = TRUE;
+    thread = g_thread_new("1term-watchdog", watchdog_main, NULL);
+}
+
+void watchdog_stop(void) {
+    if (!thread)
+        return;
+    g_mutex_lock(&lock);
+    stopping = TRUE;
+    g_cond_signal(&cond);
+    g_mutex_unlock(&lock);
+    g_thread_join(thread);
+    thread = NULL;
+}
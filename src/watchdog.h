@@ -0,0 +1,20 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "1term.h"
+
+G_BEGIN_DECLS
+
+// Names the enclosing block in stall reports while it runs on the main thread
+#define WATCHDOG_SCOPE(name) \
+    G_GNUC_UNUSED __attribute__((cleanup(watchdog_leave))) const char* watchdog_scope_ = watchdog_enter(name)
+
+const char* watchdog_enter(const char* name);
+void watchdog_leave(const char** scope);
+
+void watchdog_start(guint threshold_ms);
+void watchdog_stop(void);
+
+G_END_DECLS
+
+#endif  // WATCHDOG_H
@@ -1,12 +1,19 @@
 #include "window.h"
 #include "terminal.h"
 #include "tab.h"
+#include "sessionlog.h"
+#include "startup.h"
+#include "hud.h"
+#include "renderbench.h"
+#include "trace.h"
+#include "watchdog.h"
 
 G_DEFINE_TYPE(MyWindow, my_window, GTK_TYPE_APPLICATION_WINDOW)
 
 // Global settings
 gboolean transparency_enabled = TRUE;
 gboolean scrollback_enabled = TRUE;
+gboolean session_logging_enabled = FALSE;
 GtkCssProvider* css_provider = NULL;
 
 static void my_window_css_changed(GtkWidget* w, GtkCssStyleChange* c) {
@@ -68,6 +75,8 @@ static void apply_css(GtkWidget* win) {
 }
 
 void update_css_transparency(void) {
+    WATCHDOG_SCOPE("update_css_transparency");
+    TRACE_SCOPE("update_css_transparency");
     if (!css_provider)
         return;
     gdouble alpha = transparency_enabled ? 0.95 : 1.0;
@@ -79,7 +88,9 @@ void update_css_transparency(void) {
         "notebook > stack{background-color:rgba(0,0,0,0);} "
         "scrolledwindow{background-color:rgba(0,0,0,0);} "
         "scrollbar{background-color:rgba(0,0,0,%g);} "
-        "vte-terminal{background-color:rgba(0,0,0,0);}",
+        "vte-terminal{background-color:rgba(0,0,0,0);} "
+        ".hud{font-family:monospace;font-size:8pt;color:#ddd;background-color:rgba(0,0,0,0.75);"
+        "padding:4px 8px;margin:8px 16px;border-radius:4px;}",
         alpha, alpha);
 #ifdef __GNUC__
 #pragma GCC diagnostic push
@@ -96,17 +107,15 @@ void update_transparency_for_notebook(GtkNotebook* notebook) {
         return;
     int n = gtk_notebook_get_n_pages(notebook);
     for (int i = 0; i < n; i++) {
-        GtkWidget* page = gtk_notebook_get_nth_page(notebook, i);
-        if (!page || !GTK_IS_SCROLLED_WINDOW(page))
-            continue;
-        GtkWidget* child = gtk_scrolled_window_get_child(GTK_SCROLLED_WINDOW(page));
-        if (child && VTE_IS_TERMINAL(child)) {
-            setup_background_color(VTE_TERMINAL(child));
+        VteTerminal* vt = tab_page_get_terminal(gtk_notebook_get_nth_page(notebook, i));
+        if (vt) {
+            setup_background_color(vt);
         }
     }
 }
 
 void update_transparency_all(void) {
+    WATCHDOG_SCOPE("update_transparency_all");
     GList* toplevels = gtk_window_list_toplevels();
     for (GList* l = toplevels; l; l = l->next) {
         GtkWindow* win = GTK_WINDOW(l->data);
@@ -125,17 +134,15 @@ void update_scrollback_for_notebook(GtkNotebook* notebook) {
         return;
     int n = gtk_notebook_get_n_pages(notebook);
     for (int i = 0; i < n; i++) {
-        GtkWidget* page = gtk_notebook_get_nth_page(notebook, i);
-        if (!page || !GTK_IS_SCROLLED_WINDOW(page))
-            continue;
-        GtkWidget* child = gtk_scrolled_window_get_child(GTK_SCROLLED_WINDOW(page));
-        if (child && VTE_IS_TERMINAL(child)) {
-            vte_terminal_set_scrollback_lines(VTE_TERMINAL(child), scrollback_enabled ? 100000 : 0);
+        VteTerminal* vt = tab_page_get_terminal(gtk_notebook_get_nth_page(notebook, i));
+        if (vt) {
+            vte_terminal_set_scrollback_lines(vt, scrollback_enabled ? TERMINAL_SCROLLBACK_LINES : 0);
         }
     }
 }
 
 void update_scrollback_all(void) {
+    WATCHDOG_SCOPE("update_scrollback_all");
     GList* toplevels = gtk_window_list_toplevels();
     for (GList* l = toplevels; l; l = l->next) {
         GtkWindow* win = GTK_WINDOW(l->data);
@@ -149,11 +156,44 @@ void update_scrollback_all(void) {
     g_list_free(toplevels);
 }
 
+void update_session_logging_for_notebook(GtkNotebook* notebook) {
+    if (!notebook)
+        return;
+    int n = gtk_notebook_get_n_pages(notebook);
+    for (int i = 0; i < n; i++) {
+        VteTerminal* vt = tab_page_get_terminal(gtk_notebook_get_nth_page(notebook, i));
+        if (vt) {
+            if (session_logging_enabled)
+                session_log_start(vt);
+            else
+                session_log_stop(vt);
+        }
+    }
+}
+
+void update_session_logging_all(void) {
+    GList* toplevels = gtk_window_list_toplevels();
+    for (GList* l = toplevels; l; l = l->next) {
+        GtkWindow* win = GTK_WINDOW(l->data);
+        if (MY_IS_WINDOW(win)) {
+            MyWindow* mywin = MY_WINDOW(win);
+            if (mywin->notebook) {
+                update_session_logging_for_notebook(mywin->notebook);
+            }
+        }
+    }
+    g_list_free(toplevels);
+}
+
 GtkNotebook* get_notebook_from_terminal(VteTerminal* vt) {
+    TabContext* ctx = tab_context_get(vt);
+    if (ctx && ctx->notebook)
+        return ctx->notebook;
+
     GtkWidget* widget = GTK_WIDGET(vt);
-    GtkWidget* scr = gtk_widget_get_parent(widget);  // scrolled window
+    GtkWidget* scr = gtk_widget_get_parent(widget);  // page: scrolled window or overlay
     if (!scr) {
-        g_print("get_notebook_from_terminal: no scrolled window parent, trying window fallback\n");
+        g_print("get_notebook_from_terminal: no page parent, trying window fallback\n");
         // Fallback: get window and access its notebook member
         GtkWidget* window = gtk_widget_get_ancestor(widget, GTK_TYPE_WINDOW);
         if (window && MY_IS_WINDOW(window)) {
@@ -277,7 +317,22 @@ static void on_notebook_drag_begin(GtkGestureDrag* gesture, double start_x, doub
 }
 
 void create_window(GtkApplication* app) {
+    create_window_full(app, NULL, NULL, NULL);
+}
+
+// A window whose first tab runs command (the user's shell if NULL) in cwd (ours if NULL) with env (ours if NULL)
+GtkWidget* create_window_full(GtkApplication* app, const char* cwd, char** command, char** env) {
+    GtkWidget* win = create_window_bare(app);
+    add_tab_full(my_window_get_notebook(MY_WINDOW(win)), cwd, command, env);
+    gtk_window_present(GTK_WINDOW(win));
+    // Window title will be set via update_tab_title
+    return win;
+}
+
+// A window without tabs; the caller adds the first one and presents it
+GtkWidget* create_window_bare(GtkApplication* app) {
     static int window_count = 0;
+    startup_mark(STARTUP_WINDOW);
 
     GtkWidget* win = my_window_new(app);
     MyWindow* mywin = MY_WINDOW(win);
@@ -331,8 +386,11 @@ void create_window(GtkApplication* app) {
     gtk_widget_set_visible(action_box, TRUE);
     gtk_notebook_set_action_widget(notebook, action_box, GTK_PACK_END);
 
-    // Set notebook as window child (no wrapper)
-    gtk_window_set_child(GTK_WINDOW(win), GTK_WIDGET(notebook));
+    // Notebook in an overlay that only holds the (usually hidden) HUD
+    GtkWidget* overlay = gtk_overlay_new();
+    gtk_overlay_set_child(GTK_OVERLAY(overlay), GTK_WIDGET(notebook));
+    gtk_window_set_child(GTK_WINDOW(win), overlay);
+    hud_attach(win, notebook, GTK_OVERLAY(overlay));
 
     setup_window_size(win, window_count);
     window_count++;
@@ -340,10 +398,8 @@ void create_window(GtkApplication* app) {
     gtk_window_set_icon_name(GTK_WINDOW(win), "1term");
 
     apply_css(win);
-
-    // Add first tab
-    add_tab(notebook);
-
-    gtk_window_present(GTK_WINDOW(win));
-    // Window title will be set via update_tab_title
+    startup_mark(STARTUP_CSS);
+    startup_watch_window(win);
+    render_bench_watch_window(win);
+    return win;
 }
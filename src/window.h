@@ -17,10 +17,14 @@ GtkWidget* my_window_new(GtkApplication* app);
 GtkNotebook* my_window_get_notebook(MyWindow* self);
 
 void create_window(GtkApplication* app);
+GtkWidget* create_window_full(GtkApplication* app, const char* cwd, char** command, char** env);
+GtkWidget* create_window_bare(GtkApplication* app);
 void update_transparency_for_notebook(GtkNotebook* notebook);
 void update_transparency_all(void);
 void update_scrollback_for_notebook(GtkNotebook* notebook);
 void update_scrollback_all(void);
+void update_session_logging_for_notebook(GtkNotebook* notebook);
+void update_session_logging_all(void);
 void update_css_transparency(void);
 GtkNotebook* get_notebook_from_terminal(VteTerminal* vt);
 
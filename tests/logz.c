@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "logz.h"
+
+#include <glib/gstdio.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+// Round trips through the .logz writer and reader: `meson test`.
+
+static gchar* tmp_dir = NULL;
+
+static gchar* test_path(const char* name) {
+    return g_build_filename(tmp_dir, name, NULL);
+}
+
+static LogzWriter* test_writer(const char* path, LogzOptions* opts) {
+    int fd = g_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    g_assert_cmpint(fd, >=, 0);
+    return logz_writer_new_full(fd, path, opts);
+}
+
+static void assert_text(LogzReader* r, const char* expected, gsize expected_len) {
+    gsize len = 0;
+    gchar* text = logz_reader_read_lines(r, 0, logz_reader_get_n_lines(r), &len);
+    g_assert_nonnull(text);
+    g_assert_cmpuint(len, ==, expected_len);
+    g_assert_true(memcmp(text, expected, len) == 0);
+    g_free(text);
+}
+
+// Every frame refreshes the index: the file is readable while it grows, past
+// the point where index blocks are linked instead of rewritten.
+static void test_linked_index(void) {
+    g_autofree gchar* path = test_path("linked.logz");
+    LogzOptions opts = {.level = 1};
+    LogzWriter* w = test_writer(path, &opts);
+    GString* all = g_string_new(NULL);
+    for (guint i = 0; i < 700; i++) {
+        g_autofree gchar* line = g_strdup_printf("line %u\n", i);
+        g_string_append(all, line);
+        g_assert_true(logz_writer_append(w, line, strlen(line)));
+        g_assert_true(logz_writer_flush(w));
+        if (i == 600) {
+            LogzReader* r = logz_reader_open(path);
+            g_assert_nonnull(r);
+            g_assert_cmpuint(logz_reader_get_n_frames(r), ==, 601);
+            g_assert_cmpuint(logz_reader_get_n_lines(r), ==, 601);
+            assert_text(r, all->str, all->len);
+            logz_reader_free(r);
+        }
+    }
+    g_assert_true(logz_writer_close(w, FALSE));
+
+    LogzReader* r = logz_reader_open(path);
+    g_assert_nonnull(r);
+    g_assert_cmpuint(logz_reader_get_n_frames(r), ==, 700);
+    g_assert_cmpuint(logz_reader_find_line(r, 650), ==, 650);
+    assert_text(r, all->str, all->len);
+    logz_reader_free(r);
+    g_string_free(all, TRUE);
+}
+
+// A plain zstd file without an index, as `zstd` or 1term before .logz wrote them
+static void test_scan_fallback(void) {
+    g_autofree gchar* path = test_path("plain.logz");
+    const char text[] = "first\nsecond\nthird\n";
+    gsize bound = ZSTD_compressBound(sizeof(text) - 1);
+    g_autofree guint8* z = g_malloc(bound);
+    size_t zlen = ZSTD_compress(z, bound, text, sizeof(text) - 1, 1);
+    g_assert_false(ZSTD_isError(zlen));
+    g_assert_true(g_file_set_contents(path, (const char*)z, (gssize)zlen, NULL));
+
+    LogzReader* r = logz_reader_open(path);
+    g_assert_nonnull(r);
+    g_assert_cmpuint(logz_reader_get_n_frames(r), ==, 1);
+    g_assert_cmpuint(logz_reader_get_n_lines(r), ==, 3);
+    assert_text(r, text, sizeof(text) - 1);
+    logz_reader_free(r);
+}
+
+// Text this process already archived in the same directory becomes a reference.
+static void test_reference(void) {
+    g_autofree gchar* first = test_path("terminal_first.logz");
+    g_autofree gchar* second = test_path("terminal_second.logz");
+    const char text[] = "the same output\nin both tabs\n";
+    for (int i = 0; i < 2; i++) {
+        const char* path = i == 0 ? first : second;
+        LogzOptions opts = {.level = 1, .dedup_path = path};
+        LogzWriter* w = test_writer(path, &opts);
+        g_assert_true(logz_writer_append(w, text, sizeof(text) - 1));
+        g_assert_true(logz_writer_close(w, FALSE));
+    }
+
+    LogzReader* r = logz_reader_open(second);
+    g_assert_nonnull(r);
+    g_assert_cmpuint(logz_reader_get_n_frames(r), ==, 1);
+    g_assert_cmpuint(logz_reader_get_frame(r, 0)->csize, ==, 0);
+    gchar** refs = logz_reader_get_references(r);
+    g_assert_cmpstr(refs[0], ==, "terminal_first.logz");
+    g_assert_null(refs[1]);
+    g_strfreev(refs);
+    assert_text(r, text, sizeof(text) - 1);
+    logz_reader_free(r);
+
+    // another file under the name, or none, is not where the text went
+    g_autofree gchar* third = test_path("terminal_third.logz");
+    g_assert_true(g_file_set_contents(first, "not an archive", -1, NULL));
+    LogzOptions opts = {.level = 1, .dedup_path = third};
+    LogzWriter* w = test_writer(third, &opts);
+    g_assert_true(logz_writer_append(w, text, sizeof(text) - 1));
+    g_assert_true(logz_writer_close(w, FALSE));
+    r = logz_reader_open(third);
+    g_assert_nonnull(r);
+    g_assert_cmpuint(logz_reader_get_frame(r, 0)->csize, >, 0);
+    logz_reader_free(r);
+}
+
+// A frame bigger than any writer makes is cut up, not copied into its buffer.
+static void test_rewrite_huge_frame(void) {
+    g_autofree gchar* path = test_path("huge.logz");
+    gsize len = (LOGZ_MAX_FRAME_SIZE + LOGZ_MAX_FRAME_SIZE / 2) / 100 * 100;  // whole 100-byte lines
+    gchar* text = g_malloc(len);
+    for (gsize i = 0; i < len; i++)
+        text[i] = i % 100 == 99 ? '\n' : (char)('a' + i % 26);
+
+    gsize bound = ZSTD_compressBound(len);
+    guint8* z = g_malloc(bound);
+    size_t zlen = ZSTD_compress(z, bound, text, len, 1);
+    g_assert_false(ZSTD_isError(zlen));
+    g_assert_true(g_file_set_contents(path, (const char*)z, (gssize)zlen, NULL));
+    g_free(z);
+
+    LogzOptions opts = {.level = 1};
+    g_assert_true(logz_archive_rewrite(path, &opts, NULL, NULL));
+
+    LogzReader* r = logz_reader_open(path);
+    g_assert_nonnull(r);
+    g_assert_true(logz_reader_is_compacted(r));
+    g_assert_cmpuint(logz_reader_get_n_frames(r), >, 1);
+    for (guint i = 0; i < logz_reader_get_n_frames(r); i++)
+        g_assert_cmpuint(logz_reader_get_frame(r, i)->dsize, <=, LOGZ_MAX_FRAME_SIZE);
+    g_assert_cmpuint(logz_reader_get_n_lines(r), ==, len / 100);
+    assert_text(r, text, len);
+    logz_reader_free(r);
+    g_free(text);
+}
+
+int main(int argc, char** argv) {
+    g_test_init(&argc, &argv, NULL);
+    tmp_dir = g_dir_make_tmp("1term-logz-XXXXXX", NULL);
+    g_assert_nonnull(tmp_dir);
+
+    g_test_add_func("/logz/linked-index", test_linked_index);
+    g_test_add_func("/logz/scan-fallback", test_scan_fallback);
+    g_test_add_func("/logz/reference", test_reference);
+    g_test_add_func("/logz/rewrite-huge-frame", test_rewrite_huge_frame);
+    int status = g_test_run();
+
+    GDir* d = g_dir_open(tmp_dir, 0, NULL);
+    for (const char* name; d && (name = g_dir_read_name(d));) {
+        g_autofree gchar* path = test_path(name);
+        g_unlink(path);
+    }
+    if (d)
+        g_dir_close(d);
+    g_rmdir(tmp_dir);
+    g_free(tmp_dir);
+    return status;
+}